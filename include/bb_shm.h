@@ -0,0 +1,100 @@
+#ifndef BB_SHM_H
+#define BB_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Blackboard state shared in memory.
+ *
+ * The router creates the segment before forking (like the shm rings, the
+ * object is unlinked at once and reaches the children as an inherited
+ * descriptor). The Blackboard is the only writer; readers (the Drone, the
+ * Map, the Obstacles and Targets generators) copy a consistent snapshot
+ * without any routed message.
+ *
+ * Seqlock: the writer makes seq odd, stores the state, makes seq even again.
+ * A reader retries while seq is odd or changed during its copy. seq also
+ * tells a reader whether anything changed since its last snapshot.
+ *
+ * The segment holds every obstacle and target: when the state outgrows it,
+ * the writer enlarges the object (ftruncate) inside a write section and
+ * publishes the new capacity; a reader that sees a capacity larger than
+ * its mapping maps the object again. Nothing is ever left out.
+ *
+ * Every entry carries its entity_store id, so a reader that mirrors the
+ * stores updates them by id instead of rebuilding them.
+ */
+#define BB_SHM_INIT_CAP 256         // Entries per column at creation
+
+// Local copy of the state; the columns grow with bb_snapshot_reserve()
+struct bb_snapshot {
+    int32_t W, H;                   // Game area
+    int32_t drone_x, drone_y;
+    int32_t num_obs;
+    int32_t num_tgs;                // Oldest (the current one) first
+    uint32_t *obs_id, *tgs_id;      // Ids in the Blackboard stores
+    int32_t *obs_x, *obs_y;
+    int32_t *tgs_x, *tgs_y;
+    int32_t *tgs_tag;               // Target number shown on the map
+    int cap;                        // Entries allocated per column
+    int32_t *block;                 // Single allocation behind the columns
+};
+
+// Mapping of the segment in one process
+struct bb_shm {
+    int fd;
+    int writable;
+    int cap;                        // Entries per column the mapping covers
+    size_t len;                     // Bytes mapped
+    struct bb_seg *seg;
+};
+
+/**
+ * Create the (already unlinked) segment, inheritable across exec.
+ * Returns its descriptor, -1 on error.
+ */
+int bb_shm_create(void);
+
+/**
+ * Map the segment from the descriptor spec received on the command line
+ * ("-" = none). Returns NULL if there is no segment.
+ */
+struct bb_shm *bb_shm_open(const char *spec, int writable);
+
+/**
+ * Room for n obstacles and n targets in a local snapshot. Returns 0, -1 if
+ * out of memory.
+ */
+int bb_snapshot_reserve(struct bb_snapshot *s, int n);
+
+/**
+ * Release the columns of a local snapshot.
+ */
+void bb_snapshot_free(struct bb_snapshot *s);
+
+/**
+ * Publish a new state (single writer), growing the segment if needed.
+ * Nothing is written, and seq does not move, when the state is unchanged.
+ * Returns 0, -1 if the segment could not grow (the old state stays).
+ */
+int bb_shm_publish(struct bb_shm *shm, const struct bb_snapshot *s);
+
+/**
+ * Copy a consistent snapshot, growing out's columns and the mapping as
+ * needed. Returns the seq it was taken at (even). Exits if the segment
+ * cannot be mapped again or out cannot hold it.
+ */
+uint32_t bb_shm_read(struct bb_shm *shm, struct bb_snapshot *out);
+
+/**
+ * Returns the current seq, to skip a copy when nothing changed.
+ */
+uint32_t bb_shm_seq(const struct bb_shm *shm);
+
+/**
+ * Unmap the segment and close its descriptor.
+ */
+void bb_shm_close(struct bb_shm *shm);
+
+#endif
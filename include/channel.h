@@ -0,0 +1,135 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <sys/types.h>
+#include "common.h"
+
+/*
+ * Message transport for one route-table edge.
+ *
+ * TRANSPORT_PIPE: classic anonymous pipe, one write()/read() per message.
+ * TRANSPORT_SHM:  POSIX shared-memory single-producer/single-consumer ring
+ *                 of struct msg, with an eventfd used only to wake up a
+ *                 consumer that found the ring empty.
+ *
+ * The router creates every edge (struct link) before forking; the child
+ * receives a textual spec of its end on the command line ("<fd>" for pipes,
+ * "shm:<shmfd>,<eventfd>" for rings) and opens it with channel_open().
+ * Every descriptor is close-on-exec: a child keeps only the ends it marks
+ * with link_inherit().
+ *
+ * A ring has no kernel object that notices a dead peer: a process killed
+ * before channel_close() leaves the flags untouched, so the router marks
+ * them with channel_peer_gone() when it reaps the child.
+ */
+enum { TRANSPORT_PIPE = 0, TRANSPORT_SHM };
+
+// Number of struct msg slots in every shared-memory ring (power of two)
+#define SHM_RING_SLOTS 1024
+
+// Largest batch whose writev() on a pipe is still atomic (PIPE_BUF = 4096)
+#define CHANNEL_BATCH (4096 / (int)sizeof(struct msg))
+
+struct shm_ring;
+
+// One end of an edge, as seen by the process using it
+struct channel {
+    int fd;                 // pollable descriptor: pipe end or eventfd (-1 if closed)
+    int shm_fd;             // shared-memory object backing the ring (-1 for pipes)
+    struct shm_ring *ring;  // mapped ring, NULL for pipes
+    int tx;                 // 1 if this end produces messages
+    int nonblock;           // recv/send return EAGAIN instead of waiting
+};
+
+// One edge, created by the router before fork
+struct link {
+    int transport;
+    int fds[2];             // pipe: [0] read end, [1] write end; shm: [0] shm fd, [1] eventfd
+};
+
+/**
+ * Create an edge with the given transport. Returns 0 on success, -1 on error.
+ */
+int link_create(struct link *l, int transport);
+
+/**
+ * Write in buf the spec string a child uses to open the given end (0 = rx, 1 = tx).
+ */
+void link_spec(const struct link *l, int end, char *buf, size_t len);
+
+/**
+ * Open the given end of an edge inside the router process.
+ */
+int link_open(const struct link *l, int end, struct channel *c);
+
+/**
+ * Close the descriptors of the given end that the caller does not need.
+ * For pipes this closes fds[end]; rings share both descriptors, so nothing is closed.
+ */
+void link_close_end(struct link *l, int end);
+
+/**
+ * In a freshly forked child: keep the given end (0 = rx, 1 = tx) across
+ * exec(). Clears close-on-exec on its descriptors and, for a pipe, closes
+ * the other end.
+ */
+void link_inherit(struct link *l, int end);
+
+/**
+ * Close every descriptor of the edge.
+ */
+void link_close(struct link *l);
+
+/**
+ * Open a channel end from a spec string received on the command line.
+ */
+int channel_open(struct channel *c, const char *spec, int tx);
+
+/**
+ * Switch the channel to non-blocking mode (the pipe fd or the ring semantics).
+ */
+void channel_set_nonblock(struct channel *c);
+
+/**
+ * Shrink (or grow) the kernel buffer of a pipe channel to the given bytes,
+ * bounding how many messages can queue up in it. No-op for rings.
+ * Returns 0 on success, -1 on error.
+ */
+int channel_set_capacity(struct channel *c, int bytes);
+
+/**
+ * Send one message. Returns sizeof(struct msg) on success, -1 on error.
+ */
+ssize_t channel_send(struct channel *c, const struct msg *m);
+
+/**
+ * Receive one message. Returns sizeof(struct msg), 0 on EOF, -1 on error
+ * (errno == EAGAIN when non-blocking and nothing is pending).
+ */
+ssize_t channel_recv(struct channel *c, struct msg *m);
+
+/**
+ * Receive up to max messages in one call (readv on pipes).
+ * Returns the number of messages, 0 on EOF, -1 on error (EAGAIN when drained).
+ */
+int channel_recv_batch(struct channel *c, struct msg *ms, int max);
+
+/**
+ * Send n messages in one call (writev on pipes), waking the consumer at most once.
+ * Returns n on success, -1 on error. A non-blocking channel may accept only
+ * the first k < n messages and return k; it returns -1 with EAGAIN if none fit.
+ */
+int channel_send_batch(struct channel *c, const struct msg *ms, int n);
+
+/**
+ * The process at the other end died without closing it: mark the ring as
+ * if it had (EOF for a consumer, EPIPE for a producer). No-op for pipes.
+ */
+void channel_peer_gone(struct channel *c);
+
+/**
+ * Close the channel; the producer side also marks the ring as closed.
+ */
+void channel_close(struct channel *c);
+
+#endif
@@ -1,18 +1,22 @@
 #ifndef COMMON_H
 #define COMMON_H
 
+#include <stdint.h>
+#include "process_log.h"
+
 // Number of processes in the system
 #define NUM_PROCESSES 7
 
 // Default message size for IPC
 #define MSG_SIZE 64
 
-// Default port for network communication
+// Default port and server host for network communication
+// (overridden at run time by ARP_NET_PORT and ARP_NET_HOST)
 #define DEFAULT_PORT 5001
 //#define HOST_NAME "localhost"
 //#define HOST_NAME "10.40.116.124" // MICHELE 
 //#define HOST_NAME "172.30.228.47" // PC TAX
-#define HOST_NAME "10.40.116.135" // CHIARA
+//#define HOST_NAME "10.40.116.135" // CHIARA
 //#define HOST_NAME "192.168.1.240"
 //#define HOST_NAME "10.40.116.44" // GREG
 #define HOST_NAME "192.168.56.131" // Mahdi
@@ -33,14 +37,266 @@ enum {
 #define MARGIN_X 6
 #define MARGIN_Y 6
 
+/* ========================================================================
+ * BINARY MESSAGE PROTOCOL
+ * Every struct msg carries a small header (version, type tag, payload
+ * length) followed by a fixed-layout packed payload chosen by the type.
+ * Bump MSG_VERSION whenever a payload layout changes.
+ * ======================================================================== */
+#define MSG_VERSION 7
+
+// Message type tags
+enum msg_type {
+    MSG_NONE = 0,
+    MSG_KEY,            // I->B->D   key pressed                     (pl_key)
+    MSG_ESC,            // any->all  shutdown                        (no payload)
+    MSG_RESIZE,         // M->B->D,O,T game area dimensions          (pl_size)
+    MSG_DRONE_POS,      // D->B->M   drone cell position             (pl_pos)
+    MSG_STATS,          // D->B->M   drone dynamics diagnostics      (pl_stats)
+    MSG_OBS_NEAR,       // B->D      obstacles closer than d0        (pl_points)
+    MSG_OBS_GEN_RESET,  // O->B      obstacle layout for this area   (pl_layout)
+    MSG_OBS_LAYOUT,     // O->B      batch of the generated layout   (pl_points)
+    MSG_OBS_NEW,        // O->B      replacement for the oldest one  (pl_pos)
+    MSG_OBS_CLEAR,      // B->M      drop every obstacle             (no payload)
+    MSG_ENT_PUT,        // B->M      insert or move entities by id   (pl_entities)
+    MSG_ENT_DEL,        // B->M      remove entities by id           (pl_entities)
+    MSG_OBS_REDRAW,     // B->M      obstacles are complete          (no payload)
+    MSG_TGT_GEN_RESET,  // T->B      target layout for this area     (pl_layout)
+    MSG_TGT_LAYOUT,     // T->B      batch of the generated layout   (pl_points)
+    MSG_TGT_NEW,        // T->B      new target after a grab         (pl_pos)
+    MSG_TGT_CLEAR,      // B->M      drop every target               (no payload)
+    MSG_TGT_REDRAW,     // B->M      targets are complete            (no payload)
+    MSG_TGT_REACHED,    // B->T      drone grabbed the first target  (no payload)
+    MSG_REMOTE_POS,     // main->B   remote drone moved (network)    (pl_remote)
+    MSG_REMOTE_GONE,    // main->B   remote drone left (network)     (pl_remote, id only)
+    MSG_SUBSCRIBE,      // any->main types the sender consumes       (pl_subscribe)
+    MSG_TYPE_COUNT
+};
+
+_Static_assert(MSG_TYPE_COUNT <= 32, "subscription masks are 32 bits wide");
+
+struct __attribute__((packed)) msg_hdr {
+    uint8_t version;    // MSG_VERSION of the sender
+    uint8_t type;       // enum msg_type
+    uint16_t len;       // Payload bytes in use
+};
+
+#define MSG_PAYLOAD_SIZE (MSG_SIZE - (int)sizeof(struct msg_hdr))
+
+// Payload layouts
+struct __attribute__((packed)) pl_key {
+    int32_t key;
+};
+
+struct __attribute__((packed)) pl_size {
+    int32_t w, h;
+};
+
+struct __attribute__((packed)) pl_pos {
+    int32_t x, y;
+};
+
+#define PL_REMOTE_VEL 0x1   // vx, vy are valid
+
+struct __attribute__((packed)) pl_remote {
+    int32_t id;         // Remote drone: 0 = the SERVER, then one per client
+    int32_t x, y;
+    float vx, vy;       // Velocity, cells/s (PL_REMOTE_VEL)
+    uint32_t flags;
+};
+
+struct __attribute__((packed)) pl_stats {
+    float fx, fy;       // Resulting force
+    float vx, vy;       // Velocity
+    float x, y;         // Continuous position
+    float T;            // Time step in use
+};
+
+// Several coordinates in one message: entries [first, first + count)
+#define PL_POINTS_MAX ((MSG_PAYLOAD_SIZE - 4) / 4)
+
+struct __attribute__((packed)) pl_points {
+    uint16_t first;     // Index of pt[0] in the receiver's list
+    uint16_t count;     // Entries in use
+    struct __attribute__((packed)) { int16_t x, y; } pt[PL_POINTS_MAX];
+};
+
+/*
+ * Obstacle / target layouts (STANDALONE). On a resize the generator sends
+ * GEN_RESET with the area and the number of entries, then the whole layout
+ * at once as LAYOUT batches; the Blackboard takes it when all are in.
+ * Obstacles and targets come from one seeded layout (layout_gen), so they
+ * never overlap, and keep clear of the drone start.
+ */
+#define LAYOUT_MAX UINT16_MAX   // Protocol bound: pl_points.first indexes the layout
+#define LAYOUT_PARTS 2          // Obstacles and targets (ENT_*) share a layout
+#define LAYOUT_MIN_DIST 2       // No two entities in adjacent cells
+#define LAYOUT_SPAWN_CLEAR 5    // Nothing this close to the drone start
+
+#define DRONE_START_X 5
+#define DRONE_START_Y 5
+
+struct __attribute__((packed)) pl_layout {
+    int32_t w, h;       // Area the layout was generated for
+    int32_t count;      // Entries in the LAYOUT batches that follow
+};
+
+// Entries of one kind wanted for an area
+static inline int layout_count(int w, int h) {
+    int n = w * h / 1000;
+    return n < 0 ? 0 : (n > LAYOUT_MAX ? LAYOUT_MAX : n);
+}
+
+// Obstacles and targets by stable id (entity_store), a batch of one kind
+enum { ENT_OBSTACLE = 0, ENT_TARGET };
+
+#define PL_ENTITIES_MAX ((MSG_PAYLOAD_SIZE - 2) / 10)
+
+struct __attribute__((packed)) pl_entities {
+    uint8_t kind;       // ENT_OBSTACLE / ENT_TARGET
+    uint8_t count;      // Entries in use
+    struct __attribute__((packed)) {
+        uint32_t id;
+        int16_t x, y;
+        int16_t tag;    // Target number shown on the map
+    } e[PL_ENTITIES_MAX];
+};
+
+struct __attribute__((packed)) pl_subscribe {
+    uint32_t mask;      // Bit t set = deliver messages of type t
+};
+
 // Message structure for pipe communication
 struct msg {
-    int src;            // Source process index
-    char data[MSG_SIZE]; // Message payload
+    int src;                    // Source process index
+    union {
+        char data[MSG_SIZE];    // Raw bytes
+        struct {
+            struct msg_hdr hdr;
+            unsigned char payload[MSG_PAYLOAD_SIZE];
+        };
+    };
 };
 
-// Logging macro
-#define LOG(msg) process_log(PROCESS_NAME, msg)
+// Typed view of the payload
+#define MSG_PL(m, type) ((type *)(void *)(m)->payload)
+
+/**
+ * Fill the header of a message; the caller writes the payload after.
+ */
+static inline void msg_init(struct msg *m, int src, int type, int len) {
+    m->src = src;
+    m->hdr.version = MSG_VERSION;
+    m->hdr.type = (uint8_t)type;
+    m->hdr.len = (uint16_t)len;
+}
+
+static inline void msg_pos(struct msg *m, int src, int type, int x, int y) {
+    msg_init(m, src, type, sizeof(struct pl_pos));
+    MSG_PL(m, struct pl_pos)->x = x;
+    MSG_PL(m, struct pl_pos)->y = y;
+}
+
+static inline void msg_remote(struct msg *m, int src, int type, int id, int x, int y) {
+    msg_init(m, src, type, sizeof(struct pl_remote));
+    MSG_PL(m, struct pl_remote)->id = id;
+    MSG_PL(m, struct pl_remote)->x = x;
+    MSG_PL(m, struct pl_remote)->y = y;
+    MSG_PL(m, struct pl_remote)->vx = 0;
+    MSG_PL(m, struct pl_remote)->vy = 0;
+    MSG_PL(m, struct pl_remote)->flags = 0;
+}
+
+// Table-driven dispatch: one handler per type, NULL = ignored
+typedef void (*msg_handler)(const struct msg *m, void *ctx);
+
+/**
+ * Run the handler registered for the message type.
+ * Returns 1 if a handler ran, 0 if the message was ignored or has a foreign version.
+ */
+static inline int msg_dispatch(const msg_handler table[MSG_TYPE_COUNT], const struct msg *m, void *ctx) {
+    if (m->hdr.version != MSG_VERSION || m->hdr.type >= MSG_TYPE_COUNT)
+        return 0;
+    msg_handler h = table[m->hdr.type];
+    if (!h)
+        return 0;
+    h(m, ctx);
+    return 1;
+}
+
+/* ========================================================================
+ * SUBSCRIPTIONS
+ * The router forwards a message to a destination only if the destination
+ * subscribed to its type. A process subscribes once at startup with the
+ * types of its dispatch table; until then it receives everything.
+ * ======================================================================== */
+#define MSG_BIT(type) (1u << (type))
+#define MSG_SUB_ALL   0xffffffffu
+
+static inline uint32_t msg_table_mask(const msg_handler table[MSG_TYPE_COUNT]) {
+    uint32_t mask = 0;
+    for (int t = 0; t < MSG_TYPE_COUNT; t++)
+        if (table[t]) mask |= MSG_BIT(t);
+    return mask;
+}
+
+static inline void msg_subscribe(struct msg *m, int src, uint32_t mask) {
+    msg_init(m, src, MSG_SUBSCRIBE, sizeof(struct pl_subscribe));
+    MSG_PL(m, struct pl_subscribe)->mask = mask;
+}
+
+/**
+ * Returns 1 if a destination with the given mask wants the message.
+ * Messages the router cannot classify are always delivered.
+ */
+static inline int msg_wanted(uint32_t mask, const struct msg *m) {
+    if (m->hdr.version != MSG_VERSION || m->hdr.type >= MSG_TYPE_COUNT)
+        return 1;
+    return (mask & MSG_BIT(m->hdr.type)) != 0;
+}
+
+/* ========================================================================
+ * LOGGING
+ * Leveled printf-style macros. Levels below LOG_MIN_LEVEL (set by CMake,
+ * -DLOG_LEVEL=TRACE|DEBUG|INFO|WARN|ERROR|NONE) expand to nothing: the
+ * arguments are not even evaluated.
+ * ======================================================================== */
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) process_logf(PROCESS_NAME, LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) process_logf(PROCESS_NAME, LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) process_logf(PROCESS_NAME, LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) process_logf(PROCESS_NAME, LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) process_logf(PROCESS_NAME, LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+// Plain message at INFO level
+#define LOG(msg) LOG_INFO("%s", msg)
 
 enum {STANDALONE = 0, SERVER, CLIENT};
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef CONFIG_WATCH_H
+#define CONFIG_WATCH_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Change notification for a configuration file.
+ *
+ * inotify watches the file's directory (editors often save by renaming a
+ * new file over the old one) and reports the file once a writer closed it
+ * or it was moved in, never in the middle of a write. Without inotify a
+ * timerfd paces a stat() of the file every CW_POLL_MS, and a change is only
+ * reported once size and mtime held still for one period.
+ *
+ * cw_poll() never blocks and does no file I/O when nothing happened; cw_fd()
+ * can also go in a select()/epoll set.
+ */
+#define CW_POLL_MS 500
+
+struct config_watch {
+    char dir[256];
+    char name[128];
+    int ifd;            // inotify descriptor, -1 in fallback mode
+    int tfd;            // Fallback timerfd, -1 with inotify
+    // Fallback: last reported state and a change waiting to settle
+    time_t mtime;
+    long mtime_ns;
+    off_t size;
+    int pending;
+    time_t p_mtime;
+    long p_mtime_ns;
+    off_t p_size;
+};
+
+/**
+ * Start watching path. Returns 0, -1 if neither inotify nor a timerfd is
+ * available.
+ */
+int cw_open(struct config_watch *cw, const char *path);
+
+/**
+ * Descriptor that becomes readable when cw_poll() may have news.
+ */
+int cw_fd(const struct config_watch *cw);
+
+/**
+ * Returns 1 if the file changed since the last call, 0 if not.
+ */
+int cw_poll(struct config_watch *cw);
+
+/**
+ * Stop watching.
+ */
+void cw_close(struct config_watch *cw);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DRONESIM_H
+#define DRONESIM_H
+
+#include "force_field.h"
+
+/*
+ * Headless drone dynamics: M a = USER_FORCE * u - K v + F_rep(x, y).
+ *
+ * A simulation holds any number of drones as a structure of arrays, and one
+ * call advances all of them by one fixed step, so thousands of drones run
+ * faster than real time in a single process (parameter tuning, regression
+ * runs). The repulsion comes from a shared force_field, a grid lookup or
+ * the exact sum (ds_params.exact); after it, every stage is a plain loop
+ * over float columns that the compiler can vectorize. After each step the
+ * walls of the area stop the drones.
+ *
+ * No I/O and no clock: the caller decides how many steps to take.
+ */
+
+// Integration schemes
+enum {
+    DS_EULER = 0,       // Semi-implicit (symplectic) Euler
+    DS_VERLET,          // Velocity Verlet
+    DS_RK4,             // Classic fourth-order Runge-Kutta
+    DS_INTEGRATORS
+};
+
+struct ds_params {
+    float M;            // Mass
+    float K;            // Viscous coefficient
+    float USER_FORCE;   // User force scaling
+    int integrator;     // DS_EULER, DS_VERLET, DS_RK4
+    int exact;          // Sum every obstacle at each drone instead of the grid lookup
+};
+
+struct dronesim {
+    int n, cap;
+    int w, h;           // Area: positions stay in [1, w-2] x [1, h-2]
+
+    // State and input, one entry per drone
+    float *x, *y;
+    float *vx, *vy;
+    float *ux, *uy;     // User force command
+
+    // Scratch columns for the stages
+    float *fx, *fy;
+    float *sx, *sy, *svx, *svy;
+    float *ax, *ay, *avx, *avy;
+
+    float *block;       // Single allocation behind all columns
+};
+
+/**
+ * Room for n drones, all at rest at the origin with no command. Returns 0,
+ * -1 if out of memory.
+ */
+int ds_init(struct dronesim *ds, int n);
+
+/**
+ * Release the columns.
+ */
+void ds_free(struct dronesim *ds);
+
+/**
+ * Set the area the drones are kept in.
+ */
+void ds_set_area(struct dronesim *ds, int w, int h);
+
+/**
+ * Advance every drone by dt.
+ */
+void ds_step(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt);
+
+/**
+ * Advance every drone by steps * dt.
+ */
+void ds_run(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt, long steps);
+
+/**
+ * Total force on drone i in its current state (diagnostics).
+ */
+void ds_force(const struct dronesim *ds, const struct ds_params *p, struct force_field *ff, int i, float *fx, float *fy);
+
+#endif
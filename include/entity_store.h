@@ -0,0 +1,90 @@
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <stdint.h>
+
+/*
+ * Entity store: obstacles and targets with stable ids.
+ *
+ * A generation-counted slot map: an id is (generation << ES_SLOT_BITS) | slot,
+ * a removed slot goes on a free list and its generation is bumped, so an
+ * old id never finds the entity that reuses the slot. The live entities are
+ * kept packed in structure-of-arrays columns [0, count) for fast scans
+ * (removal moves the last one into the hole). Independently of the packing,
+ * entities are linked in insertion order: first() is the oldest.
+ *
+ * Insert, update, remove and lookup are O(1); capacity grows on demand.
+ * The Blackboard allocates the ids, the Map mirrors them with es_put().
+ */
+#define ES_SLOT_BITS 20
+#define ES_SLOT_MASK ((1u << ES_SLOT_BITS) - 1)
+#define ES_NONE      0xffffffffu    // No entity
+
+struct entity_store {
+    // Packed columns, [0, count)
+    uint32_t *id;
+    int32_t *x, *y;
+    int32_t *tag;                   // Caller data: target number, remote drone id
+    int32_t *aux;                   // Caller data: spatial grid handle
+    int count;
+
+    // Slots, indexed by id & ES_SLOT_MASK
+    uint32_t *gen;                  // Generation of the id living in the slot
+    int32_t *dense;                 // Packed index, -1 if the slot is free
+    uint32_t *prev, *next;          // Insertion order (ids), ES_NONE at the ends
+    int slots;                      // Slots allocated
+    int top;                        // Slots [top, slots) were never used
+    int cap;                        // Packed capacity
+    int32_t free_head;              // First free slot, -1 if none
+    uint32_t head, tail;            // Oldest and newest id
+};
+
+/**
+ * Prepare an empty store.
+ */
+void es_init(struct entity_store *es);
+
+/**
+ * Release the memory of the store.
+ */
+void es_free(struct entity_store *es);
+
+/**
+ * Drop every entity; ids handed out before stay invalid.
+ */
+void es_clear(struct entity_store *es);
+
+/**
+ * Add an entity, newest in insertion order. Returns its id, ES_NONE if out
+ * of memory.
+ */
+uint32_t es_insert(struct entity_store *es, int32_t x, int32_t y, int32_t tag);
+
+/**
+ * Insert or update the entity with a given id (replicas of another store).
+ * Returns 0 on success, -1 if out of memory or the id is invalid.
+ */
+int es_put(struct entity_store *es, uint32_t id, int32_t x, int32_t y, int32_t tag);
+
+/**
+ * Move an entity. Returns 0 on success, -1 if the id is stale.
+ */
+int es_update(struct entity_store *es, uint32_t id, int32_t x, int32_t y);
+
+/**
+ * Drop an entity. Returns 0 on success, -1 if the id is stale.
+ */
+int es_remove(struct entity_store *es, uint32_t id);
+
+/**
+ * Packed index of a live id, -1 if stale.
+ */
+int es_find(const struct entity_store *es, uint32_t id);
+
+/**
+ * Oldest entity and the one inserted after id (ES_NONE at the end).
+ */
+static inline uint32_t es_first(const struct entity_store *es) { return es->head; }
+static inline uint32_t es_next(const struct entity_store *es, uint32_t id) { return es->next[id & ES_SLOT_MASK]; }
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef FORCE_FIELD_H
+#define FORCE_FIELD_H
+
+/*
+ * Repulsive force field over the game area, cached on a grid.
+ *
+ * Every obstacle within RHO pushes with NI * (1/d - 1/RHO) * FF_OBS_GAIN,
+ * every wall with NI * (1/d - 1/RHO), all summed. The field is sampled on a
+ * grid of FF_RES nodes per cell and rebuilt lazily, on the first sample
+ * after the area, RHO/NI or the obstacle set changed; a sample is then a
+ * bilinear lookup, whatever the number of obstacles. ff_sample_exact()
+ * skips the grid and sums every obstacle at the point itself (repulsion
+ * kernel), for when the interpolation error matters.
+ */
+#define FF_RES 2            // Grid nodes per cell
+#define FF_OBS_GAIN 5.0f    // Obstacles push harder than walls
+
+struct force_field {
+    int w, h;               // Game area
+    float rho, ni;          // Range and gain
+    int nw, nh;             // Nodes: (w * FF_RES + 1) x (h * FF_RES + 1)
+    float *fx, *fy;
+
+    int *obs_x, *obs_y;     // Obstacle set the field was asked for
+    float *obs_xf, *obs_yf; // The same as floats, for the exact sum
+    int num_obs, cap_obs;
+
+    int dirty;              // Rebuild before the next sample
+    unsigned long builds;   // Rebuilds so far (diagnostics)
+};
+
+/**
+ * Prepare an empty field (no area yet: every sample is zero).
+ */
+void ff_init(struct force_field *ff);
+
+/**
+ * Release the grid and the obstacle set.
+ */
+void ff_free(struct force_field *ff);
+
+/**
+ * Set the area, the range and gain, the obstacles. Each one only marks the
+ * field dirty when the value really changed.
+ */
+void ff_set_area(struct force_field *ff, int w, int h);
+void ff_set_params(struct force_field *ff, float rho, float ni);
+void ff_set_obstacles(struct force_field *ff, const int *xs, const int *ys, int n);
+
+/**
+ * Force at the continuous position (x, y), rebuilding the grid if needed.
+ */
+void ff_sample(struct force_field *ff, float x, float y, float *fx, float *fy);
+
+/**
+ * Force at (x, y) summed over every obstacle and wall, no grid.
+ */
+void ff_sample_exact(const struct force_field *ff, float x, float y, float *fx, float *fy);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef LAYOUT_GEN_H
+#define LAYOUT_GEN_H
+
+#include <stdint.h>
+
+/*
+ * Layout generator: obstacles and targets from an explicit seed.
+ *
+ * A whole layout comes out of one call, and the same seed, area and layout
+ * number always give the same points on every build (own PRNG, integer
+ * arithmetic only). Placement is blue noise: Poisson-disk dart throwing on
+ * a background grid, the spacing derived from the density so the points
+ * cover the whole area. Points keep out of the exclusion zones (the drone
+ * start) and of the border. Cost is O(n) in the points, not in the area.
+ */
+
+// splitmix64 stream
+struct lg_rng {
+    uint64_t s;
+};
+
+// Disc that no point may enter
+struct lg_zone {
+    int x, y, r;
+};
+
+struct lg_params {
+    int w, h;                       // Area, points in [1, w-2] x [1, h-2]
+    int min_dist;                   // Hard lower bound on the spacing (cells), 0 = none
+    const struct lg_zone *zones;
+    int num_zones;
+    const int *occ_x, *occ_y;       // Cells already taken (layout_gen_point only)
+    int num_occ;
+    uint64_t seed;
+    uint64_t layout;                // Layout number, a new stream per resize
+};
+
+/**
+ * Seed a stream; different stream numbers give independent sequences.
+ */
+void lg_seed(struct lg_rng *r, uint64_t seed, uint64_t stream);
+
+/**
+ * Next 32 random bits, and a value in [lo, hi] (unbiased).
+ */
+uint32_t lg_next(struct lg_rng *r);
+int lg_range(struct lg_rng *r, int lo, int hi);
+
+/**
+ * Generate up to n points into xs/ys. Returns how many were placed: fewer
+ * than n only if the area cannot hold them at min_dist.
+ */
+int layout_gen(const struct lg_params *p, int *xs, int *ys, int n);
+
+/**
+ * One uniform point outside the exclusion zones and at least min_dist from
+ * every occupied cell if possible (later single obstacles and targets). In
+ * a crowded area the try farthest from the occupied cells is taken.
+ * Returns 0, -1 if the area is empty.
+ */
+int layout_gen_point(struct lg_rng *r, const struct lg_params *p, int *x, int *y);
+
+#endif
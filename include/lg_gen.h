@@ -0,0 +1,58 @@
+#ifndef LG_GEN_H
+#define LG_GEN_H
+
+#include <stdint.h>
+
+#include "common.h"
+#include "channel.h"
+#include "bb_shm.h"
+#include "layout_gen.h"
+
+/*
+ * Generator processes (Obstacles, Targets): the same code for both kinds,
+ * on top of layout_gen.
+ * A layout is sent as GEN_RESET with the area and count, then LAYOUT
+ * batches of PL_POINTS_MAX; a single point as NEW. Both keep clear of the
+ * drone start. Single points avoid the live obstacles, targets and drone,
+ * read from the shared Blackboard state; without it, what this generator
+ * knows is taken: the whole last layout (every part) and its own points.
+ */
+struct lg_gen {
+    int kind;                       // ENT_OBSTACLE / ENT_TARGET
+    int w, h;                       // Current area
+    uint64_t seed;                  // Layout seed, the same in Obstacles and Targets
+    uint64_t layout_no;             // Layouts generated so far
+    struct lg_rng rng;              // Single points after the layout
+    int *occ_x, *occ_y;             // Cells known to be taken
+    int num_occ, cap_occ;
+    struct bb_shm *shm;             // Shared Blackboard state, NULL if none
+    struct bb_snapshot live;
+};
+
+/**
+ * Prepare a generator of the given kind for the 155x30 default area; shm
+ * (may be NULL) stays owned by the caller.
+ */
+void lg_gen_init(struct lg_gen *g, int kind, uint64_t seed, struct bb_shm *shm);
+
+/**
+ * Release the occupancy and the snapshot.
+ */
+void lg_gen_free(struct lg_gen *g);
+
+/**
+ * Generate the layout for the current area and send it at once. Obstacles
+ * and targets share one layout, so they never overlap: both generators
+ * make the same LAYOUT_PARTS * n points and send those of their part
+ * (index % LAYOUT_PARTS == kind). Returns the entries sent, -1 if out of
+ * memory (nothing sent).
+ */
+int lg_gen_send_layout(struct lg_gen *g, struct channel *out);
+
+/**
+ * Send one more point, away from what is taken. Returns 0, -1 if none was
+ * sent.
+ */
+int lg_gen_send_point(struct lg_gen *g, struct channel *out);
+
+#endif
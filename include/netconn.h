@@ -0,0 +1,74 @@
+#ifndef NETCONN_H
+#define NETCONN_H
+
+#include <sys/types.h>
+
+/*
+ * Buffered connection for the SERVER/CLIENT text protocol.
+ *
+ * Frames are NUL-terminated strings. Incoming bytes are read in large
+ * chunks into rx and split into frames there; outgoing frames are appended
+ * to tx and written as far as the socket accepts, the rest is flushed when
+ * the socket becomes writable again. The socket is non-blocking.
+ */
+#define NETCONN_RX_SIZE   4096
+#define NETCONN_FRAME_MAX 128       // Longest frame, NUL included
+
+struct netconn {
+    int fd;                         // -1 when closed
+    char rx[NETCONN_RX_SIZE];       // Received bytes not yet returned as frames
+    size_t rx_len;
+    char *tx;                       // Queued bytes, [tx_off, tx_len) still to write
+    size_t tx_off, tx_len, tx_cap;
+    int eof;                        // Peer closed the connection
+};
+
+/**
+ * Take ownership of a connected socket and make it non-blocking
+ * (and close-on-exec).
+ */
+void netconn_init(struct netconn *c, int fd);
+
+/**
+ * Read whatever the socket has. Returns the bytes read, 0 if nothing was
+ * available, -1 on EOF or error (c->eof is set).
+ */
+ssize_t netconn_fill(struct netconn *c);
+
+/**
+ * Extract the next complete frame into out (NUL-terminated).
+ * Returns 1 if a frame was extracted, 0 if more bytes are needed.
+ * Frames longer than max are truncated.
+ */
+int netconn_next_frame(struct netconn *c, char *out, size_t max);
+
+/**
+ * Wait up to timeout_ms (forever if negative) for a complete frame
+ * (startup handshake only).
+ * Returns 1 on success, 0 on timeout, -1 on EOF or error.
+ */
+int netconn_wait_frame(struct netconn *c, char *out, size_t max, int timeout_ms);
+
+/**
+ * Queue one frame (the NUL terminator is sent too) and try to write it.
+ * Returns 0 on success, -1 if the connection failed.
+ */
+int netconn_send(struct netconn *c, const char *frame);
+
+/**
+ * Write queued bytes. Returns 1 if some are still queued, 0 if the queue
+ * is empty, -1 if the connection failed.
+ */
+int netconn_flush(struct netconn *c);
+
+/**
+ * Returns 1 if queued bytes wait for the socket to become writable.
+ */
+int netconn_tx_pending(const struct netconn *c);
+
+/**
+ * Flush for at most timeout_ms, then close the socket.
+ */
+void netconn_close(struct netconn *c, int timeout_ms);
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Periodic loop scheduler on a timerfd.
+ *
+ * Deadlines are absolute (TFD_TIMER_ABSTIME, CLOCK_MONOTONIC): tick k is
+ * due at start + k * period whatever the work took, so the period neither
+ * drifts nor grows with the processing time. A tick that ends after one or
+ * more deadlines passed counts them as overruns and the loop goes on from
+ * the next one, without trying to catch up.
+ *
+ * Every tick records two samples in log2 histograms (bucket i holds values
+ * in [2^i, 2^(i+1)) us, bucket 0 below 2 us): the jitter, how late the loop
+ * woke after its deadline, and the work, from the wake to the next
+ * pt_wait(). pt_stats_due() says when a report is due (every
+ * PT_REPORT_S s), pt_format() writes it one line at a time (short enough
+ * for a log line) and pt_reset_stats() starts the next interval.
+ */
+#define PT_BUCKETS 18       // Last bucket: 131 ms and beyond
+#define PT_REPORT_S 10
+
+// Report lines
+enum { PT_LINE_TICKS = 0, PT_LINE_JITTER, PT_LINE_WORK, PT_LINES };
+
+struct pt_hist {
+    uint64_t count[PT_BUCKETS];
+    uint64_t n;
+    uint64_t max_us;
+};
+
+struct periodic {
+    int tfd;
+    long period_ns;
+    struct timespec deadline;   // Deadline of the current tick
+    struct timespec woke;       // When the current tick started
+    uint64_t ticks;             // Since pt_open()
+    uint64_t overruns;          // Deadlines missed since pt_open()
+    uint64_t ticks_report;      // The same over the current report
+    uint64_t overruns_report;
+    struct pt_hist jitter;
+    struct pt_hist work;
+    struct timespec report_at;  // Next report
+};
+
+/**
+ * Start ticking every period_ns from now. Returns 0, -1 if no timerfd.
+ */
+int pt_open(struct periodic *pt, long period_ns);
+
+/**
+ * Change the period; the next tick comes one new period from now.
+ */
+int pt_set_period(struct periodic *pt, long period_ns);
+
+/**
+ * Close the current tick and block until the next deadline. Returns the
+ * deadlines missed on the way (0 when on time), -1 on error.
+ */
+int pt_wait(struct periodic *pt);
+
+/**
+ * 1 when a report is due (and schedules the next one), 0 if not.
+ */
+int pt_stats_due(struct periodic *pt);
+
+/**
+ * One report line into buf: ticks and overruns over the interval, or a
+ * histogram (p50, p99, max and the non-empty buckets).
+ */
+void pt_format(const struct periodic *pt, int line, char *buf, size_t len);
+
+/**
+ * Empty the histograms and the interval counters.
+ */
+void pt_reset_stats(struct periodic *pt);
+
+/**
+ * Stop the timer.
+ */
+void pt_close(struct periodic *pt);
+
+/**
+ * Real-time setup for the calling process: SCHED_FIFO at priority (0 = leave
+ * the policy alone) and pinning to cpu (-1 = any). Returns 0, -1 if a part
+ * failed (errno set, usually EPERM without CAP_SYS_NICE).
+ */
+int pt_realtime(int priority, int cpu);
+
+#endif
@@ -1,11 +1,28 @@
 #ifndef PROCESS_LOG_H
 #define PROCESS_LOG_H
 
+// Log levels, see the LOG_* macros in common.h
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_NONE  5
+
 /**
  * Log a message with the process name and current timestamp.
+ * The line is queued in memory and written by a background thread.
  */
 void process_log(const char *process_name, const char *message);
 
+/**
+ * Log a printf-style message at the given level (LOG_LEVEL_*).
+ * Every level except INFO is tagged in the line ("DEBUG: ...").
+ * With ARP_LOG_FSYNC=on-error, the batch holding an ERROR line is fsync'ed.
+ */
+void process_logf(const char *process_name, int level, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
 /**
  * Register a process startup in the system logs.
  */
@@ -0,0 +1,49 @@
+#ifndef REPULSION_H
+#define REPULSION_H
+
+/*
+ * Summed repulsion of many obstacles at one point, in one pass over
+ * contiguous x/y float arrays.
+ *
+ * An obstacle at distance d < rho pushes away with k * (1/d - 1/rho);
+ * closer than REP_MIN_DIST it pushes as if at REP_MIN_DIST, fading to zero
+ * at its centre, so there is no singular direction. The SSE and AVX2 paths
+ * are picked at run time (the best the CPU has, ARP_REP_ISA=scalar|sse|avx2
+ * to force a lower one) and are only used after matching the scalar path
+ * within REP_TOLERANCE on a fixed sample.
+ */
+#define REP_MIN_DIST 0.5f
+#define REP_TOLERANCE 1e-4f     // Relative to the size of the sum
+
+enum rep_isa {
+    REP_SCALAR = 0,
+    REP_SSE,
+    REP_AVX2,
+    REP_ISAS
+};
+
+/**
+ * Force at (px, py) from the n obstacles (ox[i], oy[i]), into fx/fy.
+ */
+void rep_sum(const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy);
+
+/**
+ * The same with a given path (REP_SCALAR if the CPU lacks it).
+ */
+void rep_sum_isa(int isa, const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy);
+
+/**
+ * Path rep_sum() uses, whether the CPU has one, its name.
+ */
+int rep_isa(void);
+int rep_supported(int isa);
+const char *rep_isa_name(int isa);
+
+/**
+ * Compare a path with the scalar one on a fixed sample. Returns 0 if it
+ * matches within REP_TOLERANCE, -1 if not; the worst relative error goes in
+ * max_err if not NULL.
+ */
+int rep_verify(int isa, float *max_err);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+/*
+ * Uniform grid over the game area, used for the proximity checks.
+ *
+ * The world is split in square buckets of `cell` cells; every item sits in
+ * the bucket of its position, on a doubly linked list, so insert, remove
+ * and move are O(1). A query within radius r <= cell only visits the 3x3
+ * buckets around the point. Items are referred to by a handle that stays
+ * valid until the item is removed; positions outside the world are kept in
+ * the border buckets.
+ */
+struct sgrid_item {
+    int x, y;
+    int bucket;                 // -1 when the slot is free
+    int prev, next;             // Bucket list (next is the free list when free)
+};
+
+struct sgrid {
+    int cell;                   // Bucket side, in cells
+    int cols, rows;
+    int *head;                  // First item of every bucket, -1 if empty
+    struct sgrid_item *items;
+    int cap, count;
+    int free_head;              // First free slot, -1 if none
+};
+
+/**
+ * Prepare a grid for a w x h world with buckets of `cell` cells.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int sgrid_init(struct sgrid *g, int w, int h, int cell);
+
+/**
+ * Change the world size; the items are kept and rebucketed.
+ * Returns 0 on success, -1 if out of memory (the grid is unchanged).
+ */
+int sgrid_resize(struct sgrid *g, int w, int h);
+
+/**
+ * Add an item at (x, y). Returns its handle, -1 if out of memory.
+ */
+int sgrid_insert(struct sgrid *g, int x, int y);
+
+/**
+ * Drop an item; its handle may be reused by a later insert.
+ */
+void sgrid_remove(struct sgrid *g, int h);
+
+/**
+ * Move an item to (x, y).
+ */
+void sgrid_move(struct sgrid *g, int h, int x, int y);
+
+/**
+ * Drop every item (the buckets are kept).
+ */
+void sgrid_clear(struct sgrid *g);
+
+/**
+ * Collect the items with 0 < distance <= r from (x, y), comparing squared
+ * distances. Up to max handles go to out; returns the number of hits
+ * (which may exceed max).
+ */
+int sgrid_query(const struct sgrid *g, int x, int y, int r, int *out, int max);
+
+/**
+ * Release the memory of the grid.
+ */
+void sgrid_free(struct sgrid *g);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Binary trace backend.
+ *
+ * Each process owns a preallocated file log/trace_<NAME>.bin mapped in
+ * memory: a header followed by a ring of fixed-size records. Writing a
+ * record is a store into the mapping (no syscall, no lock, no formatting);
+ * the kernel writes the pages back, even if the process is killed.
+ * When the ring wraps the oldest records are overwritten.
+ *
+ * Selected with ARP_LOG_BACKEND=binary: process_log() then stores its text
+ * as EV_TEXT records. The logdump tool merges all files by timestamp.
+ */
+#define TRACE_MAGIC   "ARPTRACE"
+#define TRACE_VERSION 1
+#define TRACE_SLOTS   65536         // Records per file (power of two), 2 MB
+#define TRACE_TEXT_BYTES 16         // Text carried by one record
+
+// Event ids
+enum trace_event_id {
+    EV_NONE = 0,
+    EV_TEXT,            // First chunk of a log line         (len bytes of text in args)
+    EV_TEXT_CONT,       // Following chunks of the same line (len bytes of text in args)
+    EV_ROUTER_BATCH,    // Router drained a batch            (src, msgs read, msgs routed)
+    EV_ROUTER_COALESCE, // Stale state message overwritten   (dst, msg type)
+    EV_ROUTER_BLOCKED,  // Destination full, output queued   (dst, msgs queued)
+    EV_COUNT
+};
+
+struct __attribute__((packed)) trace_rec {
+    uint64_t ts_ns;     // CLOCK_MONOTONIC
+    uint8_t proc;       // Process index (IDX_*, NUM_PROCESSES = main)
+    uint8_t event;      // enum trace_event_id
+    uint16_t len;       // EV_TEXT*: text bytes in args
+    uint32_t seq;       // Per-process record number
+    int32_t args[4];
+};
+
+struct trace_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_size;
+    uint32_t slots;
+    uint32_t proc;
+    char name[16];
+    uint64_t head;      // Records written so far, next seq
+    char pad[16];
+};
+
+/**
+ * Create and map the trace file of this process. Returns 0 on success.
+ */
+int trace_open(const char *process_name);
+
+/**
+ * Returns 1 if this process writes a binary trace.
+ */
+int trace_enabled(void);
+
+/**
+ * Append one event record (no-op when the trace is not open).
+ */
+void trace_event(int event, int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+
+/**
+ * Append a text line as EV_TEXT + EV_TEXT_CONT records.
+ */
+void trace_text(const char *text);
+
+/**
+ * Unmap the trace file.
+ */
+void trace_close(void);
+
+/**
+ * Remove the trace files of a previous run.
+ */
+void trace_remove_files(void);
+
+/**
+ * Printable names used by logdump.
+ */
+const char *trace_event_name(int event);
+const char *trace_proc_name(int proc);
+
+#endif
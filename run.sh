@@ -23,4 +23,4 @@ echo "Build completata! Eseguibili in build/"
 cd ..
 
 # Opzionale: lancia main
-./build/main 
+./build/main "$@"
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <sys/select.h>
+#include <sys/timerfd.h>
 #include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
@@ -14,81 +15,711 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "BLACKBOARD"
 #include "../include/common.h"
-
-#define MAX_OBS 100
+#include "../include/channel.h"
+#include "../include/spatial_grid.h"
+#include "../include/bb_shm.h"
+#include "../include/entity_store.h"
+
+#define MAX_REMOTE 16   // Remote drones tracked in network mode
+#define NEAR_DIST 5     // Obstacles within this distance push the drone (d0)
+#define REMOTE_EXTRAP_MS 500    // Longest extrapolation past the last report
+#define REMOTE_BLEND_MS  150    // Time constant of the correction blend
+#define REMOTE_SNAP_CELLS 8.0f  // Corrections larger than this are not blended
+#define REMOTE_VEL_MAX   50.0f  // Estimated velocities are clamped (cells/s)
 
 struct blackboard {
     // Drone state
     int drone_x;
     int drone_y;
-    // Obstacles state
-    int obs_x[MAX_OBS];
-    int obs_y[MAX_OBS];
-    int num_obs;
-    // Targets state
-    int tgs_x[MAX_OBS];
-    int tgs_y[MAX_OBS];
-    int num_tgs;
+    // Obstacles state (aux = spatial grid handle)
+    struct entity_store obs;
+    // Targets state, oldest (the current one) first, tag = number shown
+    struct entity_store tgs;
     // Map state
     int W, H;
     int running;
 };
 
+/*
+ * NETWORK MODE: a remote drone, dead-reckoned between reports.
+ * Shown at report + v * dt + err, where err is the gap left by the last
+ * correction and decays to zero, so a late report never makes it jump.
+ */
+struct remote_drone {
+    int id;
+    float x, y;         // Last report
+    float vx, vy;       // Reported (or estimated) velocity, cells/s
+    int has_vel;        // The peer sends its velocity
+    long t_ms;          // Time of the last report
+    float ex, ey;       // Correction offset at t_ms
+    int cx, cy;         // Cell last published to the Map
+    uint32_t ent;       // Its obstacle in bb.obs
+};
 
-int main(int argc, char *argv[]) {
-    
-    // Register process for logging
-    register_process("Blackboard");
-    LOG("Blackboard process started");
+// A layout being received from a generator (STANDALONE)
+struct layout_rx {
+    int *x, *y;         // Sized by GEN_RESET
+    int cap;
+    int got;            // Entries received
+    int expected;       // Entries announced by GEN_RESET, -1 = not collecting
+};
 
-    double d0 = 5.0;
-    int waiting_reply = 0;
+// Everything the message handlers need besides the message itself
+struct bb_state {
+    struct blackboard bb;
+    int mode;
+    int waiting_reply;
+
+    struct layout_rx obs_rx;
+    struct layout_rx tgs_rx;
+
+    // Spatial index of bb.obs (handles in bb.obs.aux)
+    struct sgrid obs_grid;
+    int *near_hits;     // Every obstacle within NEAR_DIST, sized on demand
+    int near_cap;
+    int near_sent;      // Obstacles in the last OBS_NEAR (0: the Drone has none)
+    int near_cut;       // The last OBS_NEAR left some out
+    int tgt_seq;        // Number of the last target of the layout
+
+    // NETWORK MODE: remote drones by id, shown as the obstacles
+    struct remote_drone remote[MAX_REMOTE];
+    int num_remote;
+
+    struct channel *out;
+
+    // Shared state read directly by the Map (NULL: replicate it with messages)
+    struct bb_shm *shm;
+    struct bb_snapshot snap;    // Built from the stores before publishing
+    int shm_failed;             // The segment could not grow, already logged
+};
+
+/**
+ * Messages that only replicate the state for the Map: not needed when the
+ * Map reads the shared segment.
+ */
+static void map_send(struct bb_state *st, struct msg *m) {
+    if (st->shm) return;
+    channel_send(st->out, m);
+}
+
+/**
+ * Tell the Map about entities of one kind, PL_ENTITIES_MAX per message:
+ * MSG_ENT_PUT with their position, MSG_ENT_DEL with the ids only.
+ */
+static void map_send_entities(struct bb_state *st, int type, int kind, const struct entity_store *es,
+                              const uint32_t *ids, int n) {
+    if (st->shm) return;
+    struct msg m;
+    for (int first = 0; first < n; first += PL_ENTITIES_MAX) {
+        int count = (n - first < PL_ENTITIES_MAX) ? n - first : PL_ENTITIES_MAX;
+        msg_init(&m, IDX_B, type, 2 + count * 10);
+        struct pl_entities *pl = MSG_PL(&m, struct pl_entities);
+        pl->kind = kind;
+        pl->count = count;
+        for (int i = 0; i < count; i++) {
+            int d = es_find(es, ids[first + i]);
+            pl->e[i].id = ids[first + i];
+            pl->e[i].x = d >= 0 ? es->x[d] : 0;
+            pl->e[i].y = d >= 0 ? es->y[d] : 0;
+            pl->e[i].tag = d >= 0 ? es->tag[d] : 0;
+        }
+        channel_send(st->out, &m);
+    }
+}
+
+static void map_send_entity(struct bb_state *st, int type, int kind, const struct entity_store *es, uint32_t id) {
+    map_send_entities(st, type, kind, es, &id, 1);
+}
+
+/**
+ * Publish the state to the shared segment (skipped when unchanged). The
+ * segment grows with the stores; if it cannot, the Map and the Drone keep
+ * the last state and the error is logged.
+ */
+static void bb_publish(struct bb_state *st) {
+    if (!st->shm) return;
+    const struct blackboard *bb = &st->bb;
+    struct bb_snapshot *s = &st->snap;
+    int need = bb->obs.count > bb->tgs.count ? bb->obs.count : bb->tgs.count;
+    if (bb_snapshot_reserve(s, need) < 0) {
+        LOG_ERROR("No memory for a snapshot of %d entities, shared state not updated", need);
+        return;
+    }
+    s->W = bb->W;
+    s->H = bb->H;
+    s->drone_x = bb->drone_x;
+    s->drone_y = bb->drone_y;
+    s->num_obs = bb->obs.count;
+    for (int i = 0; i < s->num_obs; i++) {
+        s->obs_id[i] = bb->obs.id[i];
+        s->obs_x[i] = bb->obs.x[i];
+        s->obs_y[i] = bb->obs.y[i];
+    }
+    s->num_tgs = 0;
+    for (uint32_t id = es_first(&bb->tgs); id != ES_NONE; id = es_next(&bb->tgs, id)) {
+        int d = es_find(&bb->tgs, id);
+        s->tgs_id[s->num_tgs] = id;
+        s->tgs_x[s->num_tgs] = bb->tgs.x[d];
+        s->tgs_y[s->num_tgs] = bb->tgs.y[d];
+        s->tgs_tag[s->num_tgs] = bb->tgs.tag[d];
+        s->num_tgs++;
+    }
+    if (bb_shm_publish(st->shm, s) < 0) {
+        if (!st->shm_failed)
+            LOG_ERROR("Shared segment cannot grow to %d obstacles, %d targets: state not updated",
+                      s->num_obs, s->num_tgs);
+        st->shm_failed = 1;
+    } else {
+        st->shm_failed = 0;
+    }
+}
+
+/* ========================================================================
+ * Obstacles: entity store + spatial grid, kept in step
+ * ======================================================================== */
+static uint32_t obs_add(struct bb_state *st, int x, int y, int tag) {
+    struct entity_store *obs = &st->bb.obs;
+    uint32_t id = es_insert(obs, x, y, tag);
+    if (id != ES_NONE) obs->aux[es_find(obs, id)] = sgrid_insert(&st->obs_grid, x, y);
+    return id;
+}
+
+static void obs_move(struct bb_state *st, uint32_t id, int x, int y) {
+    struct entity_store *obs = &st->bb.obs;
+    int d = es_find(obs, id);
+    if (d < 0) return;
+    es_update(obs, id, x, y);
+    sgrid_move(&st->obs_grid, obs->aux[d], x, y);
+}
+
+static void obs_del(struct bb_state *st, uint32_t id) {
+    struct entity_store *obs = &st->bb.obs;
+    int d = es_find(obs, id);
+    if (d < 0) return;
+    sgrid_remove(&st->obs_grid, obs->aux[d]);
+    es_remove(obs, id);
+}
+
+static void obs_clear(struct bb_state *st) {
+    es_clear(&st->bb.obs);
+    sgrid_clear(&st->obs_grid);
+}
+
+/**
+ * Replace a whole layout (obstacles or targets) and send it to the Map.
+ */
+static void layout_replace(struct bb_state *st, int kind, const int *xs, const int *ys, int n) {
+    struct entity_store *es = kind == ENT_OBSTACLE ? &st->bb.obs : &st->bb.tgs;
+    if (kind == ENT_OBSTACLE) {
+        obs_clear(st);
+    } else {
+        es_clear(es);
+        st->tgt_seq = 0;
+    }
 
-    int tmp_obs_x[MAX_OBS];
-    int tmp_obs_y[MAX_OBS];
-    int tmp_num_obs = 0;
+    for (int i = 0; i < n; i++) {
+        if (kind == ENT_OBSTACLE) obs_add(st, xs[i], ys[i], 0);
+        else es_insert(es, xs[i], ys[i], ++st->tgt_seq);
+    }
+    // Freshly cleared: the packed ids are the new layout, in order
+    map_send_entities(st, MSG_ENT_PUT, kind, es, es->id, es->count);
+}
+
+// Message from Keyboard (I)
+static void on_key(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    LOG_TRACE("BB received Keyboard msg, key=%c", MSG_PL(m, const struct pl_key)->key);
+    // Forward the message to the drone
+    if (channel_send(st->out, m) < 0) {
+        perror("write to drone via router");
+    } else if (st->mode != 0) {
+        LOG_DEBUG("BLACKBOARD: Forwarded Keyboard msg to Drone");
+    }
+    // ESC 
+    if (MSG_PL(m, const struct pl_key)->key == 27){
+        printf("[BB] EXIT\n");
+        LOG("Received ESC from Keyboard, shutting down");
+        struct msg esc;
+        msg_init(&esc, m->src, MSG_ESC, 0);
+        if(channel_send(st->out, &esc) < 0){
+            perror("write to map via router");
+        } 
+        st->bb.running = 0;
+    }
+}
+
+// Message from Drone (D): position update
+static void on_drone_pos(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    st->bb.drone_x = MSG_PL(m, const struct pl_pos)->x;
+    st->bb.drone_y = MSG_PL(m, const struct pl_pos)->y;
+
+    struct msg map_msg;
+    msg_pos(&map_msg, IDX_B, MSG_DRONE_POS, st->bb.drone_x, st->bb.drone_y); 
+    if(channel_send(st->out, &map_msg) < 0){
+        perror("write to map via router");
+    }
+}
+
+// Message from Drone (D): STATS
+static void on_stats(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    // Forward STATS to Map
+    struct msg map_msg = *m;
+    map_msg.src = IDX_B; // Mark as coming from Blackboard forwarding
+    if(channel_send(st->out, &map_msg) < 0){
+        perror("write to map forwarding stats");
+    }
+}
+
+// Message from Map (M)
+static void on_resize(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    st->bb.W = MSG_PL(m, const struct pl_size)->w;
+    st->bb.H = MSG_PL(m, const struct pl_size)->h;
+    sgrid_resize(&st->obs_grid, st->bb.W, st->bb.H);
+    //printf("[M->BB] RESIZE ricevuto %d, %d\n", bb.W, bb.H);
+    {
+        LOG_INFO("Forwarding RESIZE to Obstacles and Targets: %dx%d", st->bb.W, st->bb.H);
+    }
     
-    int received_obs = 0;
+    // Layouts in flight were generated for the old area
+    st->obs_rx.expected = -1;
+    st->tgs_rx.expected = -1;
+    // STANDALONE: the old layout does not fit the new area, a new one follows
+    if (st->mode == STANDALONE) {
+        struct msg map_msg;
+        obs_clear(st);
+        es_clear(&st->bb.tgs);
+        st->tgt_seq = 0;
+        msg_init(&map_msg, IDX_B, MSG_OBS_CLEAR, 0);
+        map_send(st, &map_msg);
+        msg_init(&map_msg, IDX_B, MSG_TGT_CLEAR, 0);
+        map_send(st, &map_msg);
+    }
+
+    struct msg obs_msg = *m;
+    obs_msg.src = IDX_B;
+    if(channel_send(st->out, &obs_msg)< 0){
+        perror("write to obstacles and targets via router");
+    }  
+}
+
+/* ========================================================================
+ * NETWORK MODE: the remote drones are the obstacles, one entry per id
+ * (the SERVER drone and every client connected to the same SERVER)
+ * ======================================================================== */
+static long remote_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Where the remote drone is shown at time now
+static void remote_estimate(const struct remote_drone *r, long now, float *x, float *y) {
+    long age = now - r->t_ms;
+    float dt = (float)(age < REMOTE_EXTRAP_MS ? age : REMOTE_EXTRAP_MS) / 1000.0f;
+    float blend = expf(-(float)age / REMOTE_BLEND_MS);
+    *x = r->x + r->vx * dt + r->ex * blend;
+    *y = r->y + r->vy * dt + r->ey * blend;
+}
+
+static int remote_find(const struct bb_state *st, int id) {
+    for (int i = 0; i < st->num_remote; i++)
+        if (st->remote[i].id == id) return i;
+    return -1;
+}
+
+/**
+ * Move the remote drones along their estimate; the Map gets an update only
+ * for the ones that entered another cell.
+ */
+static void remote_tick(struct bb_state *st) {
+    long now = remote_now_ms();
+    for (int i = 0; i < st->num_remote; i++) {
+        struct remote_drone *r = &st->remote[i];
+        float x, y;
+        remote_estimate(r, now, &x, &y);
+        int cx = (int)roundf(x), cy = (int)roundf(y);
+        // Extrapolation must not leave the map
+        if (cx < 1) cx = 1;
+        if (cy < 1) cy = 1;
+        if (cx > st->bb.W - 2) cx = st->bb.W - 2;
+        if (cy > st->bb.H - 2) cy = st->bb.H - 2;
+        if (cx != r->cx || cy != r->cy) {
+            r->cx = cx;
+            r->cy = cy;
+            obs_move(st, r->ent, cx, cy);
+            map_send_entity(st, MSG_ENT_PUT, ENT_OBSTACLE, &st->bb.obs, r->ent);
+        }
+    }
+}
+
+static void on_remote_pos(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    const struct pl_remote *r = MSG_PL(m, const struct pl_remote);
+    int i = remote_find(st, r->id);
+    if (i < 0) {
+        if (st->num_remote == MAX_REMOTE) {
+            LOG_WARN("Remote drone %d ignored: %d already tracked", r->id, MAX_REMOTE);
+            return;
+        }
+        i = st->num_remote++;
+        memset(&st->remote[i], 0, sizeof(st->remote[i]));
+        st->remote[i].id = r->id;
+        st->remote[i].x = r->x;
+        st->remote[i].y = r->y;
+        st->remote[i].t_ms = remote_now_ms();
+        if (r->flags & PL_REMOTE_VEL) {
+            st->remote[i].vx = r->vx;
+            st->remote[i].vy = r->vy;
+            st->remote[i].has_vel = 1;
+        }
+        st->remote[i].cx = st->remote[i].cy = -1;
+        st->remote[i].ent = obs_add(st, r->x, r->y, r->id);
+        LOG_INFO("Remote drone %d joined", r->id);
+        remote_tick(st);
+        return;
+    }
+
+    struct remote_drone *d = &st->remote[i];
+    long now = remote_now_ms();
+    float shown_x, shown_y;
+    remote_estimate(d, now, &shown_x, &shown_y);
+
+    if (r->flags & PL_REMOTE_VEL) {
+        d->vx = r->vx;
+        d->vy = r->vy;
+        d->has_vel = 1;
+    } else if (!d->has_vel && now > d->t_ms) {
+        // Legacy peer: velocity from the last two reports
+        float dt = (float)(now - d->t_ms) / 1000.0f;
+        d->vx = fmaxf(-REMOTE_VEL_MAX, fminf(REMOTE_VEL_MAX, (r->x - d->x) / dt));
+        d->vy = fmaxf(-REMOTE_VEL_MAX, fminf(REMOTE_VEL_MAX, (r->y - d->y) / dt));
+    }
+    d->x = r->x;
+    d->y = r->y;
+    d->t_ms = now;
+
+    // Blend from where the drone is shown, unless the estimate was far off
+    d->ex = shown_x - d->x;
+    d->ey = shown_y - d->y;
+    if (fabsf(d->ex) > REMOTE_SNAP_CELLS || fabsf(d->ey) > REMOTE_SNAP_CELLS)
+        d->ex = d->ey = 0;
+    remote_tick(st);
+}
+
+static void on_remote_gone(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    int i = remote_find(st, MSG_PL(m, const struct pl_remote)->id);
+    if (i < 0) return;
+    LOG_INFO("Remote drone %d left", st->remote[i].id);
+    uint32_t ent = st->remote[i].ent;
+    map_send_entity(st, MSG_ENT_DEL, ENT_OBSTACLE, &st->bb.obs, ent);
+    obs_del(st, ent);
+    st->remote[i] = st->remote[--st->num_remote];
+}
+
+/* ========================================================================
+ * STANDALONE: layouts from the generators. GEN_RESET announces the area
+ * and the count, the LAYOUT batches follow; the layout replaces the current one when all
+ * its entries are in. A layout for another area (a resize crossed it) is
+ * dropped, the generator sends a new one.
+ * ======================================================================== */
+static void layout_rx_check(struct bb_state *st, struct layout_rx *rx, int kind) {
+    if (rx->expected < 0 || rx->got < rx->expected) return;
+
+    int obs = kind == ENT_OBSTACLE;
+    struct msg map_msg;
+    msg_init(&map_msg, IDX_B, obs ? MSG_OBS_CLEAR : MSG_TGT_CLEAR, 0);
+    map_send(st, &map_msg);
+
+    layout_replace(st, kind, rx->x, rx->y, rx->expected);
+
+    msg_init(&map_msg, IDX_B, obs ? MSG_OBS_REDRAW : MSG_TGT_REDRAW, 0);
+    map_send(st, &map_msg);
+    LOG_INFO("New layout of %d %s, forwarding REDRAW to Map", rx->expected, obs ? "obstacles" : "targets");
+    rx->expected = -1;
+}
+
+static void layout_rx_reset(struct bb_state *st, struct layout_rx *rx, int kind, const struct msg *m) {
+    const struct pl_layout *l = MSG_PL(m, const struct pl_layout);
+    if (l->w != st->bb.W || l->h != st->bb.H) {
+        LOG_DEBUG("Layout for %dx%d dropped, area is %dx%d", l->w, l->h, st->bb.W, st->bb.H);
+        rx->expected = -1;
+        return;
+    }
+    int n = l->count < 0 ? 0 : (l->count > LAYOUT_MAX ? LAYOUT_MAX : l->count);
+    if (n > rx->cap) {
+        int *x = realloc(rx->x, n * sizeof(int));
+        if (x) rx->x = x;
+        int *y = x ? realloc(rx->y, n * sizeof(int)) : NULL;
+        if (y) rx->y = y;
+        if (!x || !y) {
+            LOG_ERROR("No memory for a layout of %d %s, dropped", n, kind == ENT_OBSTACLE ? "obstacles" : "targets");
+            rx->expected = -1;
+            return;
+        }
+        rx->cap = n;
+    }
+    rx->got = 0;
+    rx->expected = n;
+    layout_rx_check(st, rx, kind);
+}
+
+static void layout_rx_points(struct bb_state *st, struct layout_rx *rx, int kind, const struct msg *m) {
+    if (rx->expected < 0) return;
+    const struct pl_points *pts = MSG_PL(m, const struct pl_points);
+    for (int i = 0; i < pts->count && i < PL_POINTS_MAX; i++) {
+        int k = pts->first + i;
+        if (k >= rx->expected) break;
+        rx->x[k] = pts->pt[i].x;
+        rx->y[k] = pts->pt[i].y;
+        rx->got++;
+    }
+    layout_rx_check(st, rx, kind);
+}
+
+// Message from Obstacles (O)
+static void on_obs_gen_reset(const struct msg *m, void *ctx) {
+    layout_rx_reset(ctx, &((struct bb_state *)ctx)->obs_rx, ENT_OBSTACLE, m);
+}
+
+static void on_obs_layout(const struct msg *m, void *ctx) {
+    layout_rx_points(ctx, &((struct bb_state *)ctx)->obs_rx, ENT_OBSTACLE, m);
+}
+
+static void on_obs_new(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    struct blackboard *bb = &st->bb;
+    int x = MSG_PL(m, const struct pl_pos)->x;
+    int y = MSG_PL(m, const struct pl_pos)->y;
+    if (bb->obs.count > 0) {
+        // The oldest obstacle is replaced by the new one
+        uint32_t oldest = es_first(&bb->obs);
+        map_send_entity(st, MSG_ENT_DEL, ENT_OBSTACLE, &bb->obs, oldest);
+        obs_del(st, oldest);
+        uint32_t id = obs_add(st, x, y, 0);
+        map_send_entity(st, MSG_ENT_PUT, ENT_OBSTACLE, &bb->obs, id);
+
+        struct msg map_msg;
+        msg_init(&map_msg, IDX_B, MSG_OBS_REDRAW, 0);
+        map_send(st, &map_msg);
+        LOG("Replaced the oldest obstacle and notified Map");
+    }
+}
+
+// Message from Targets (T)
+static void on_tgt_gen_reset(const struct msg *m, void *ctx) {
+    layout_rx_reset(ctx, &((struct bb_state *)ctx)->tgs_rx, ENT_TARGET, m);
+}
+
+static void on_tgt_layout(const struct msg *m, void *ctx) {
+    layout_rx_points(ctx, &((struct bb_state *)ctx)->tgs_rx, ENT_TARGET, m);
+}
+
+static void on_tgt_new(const struct msg *m, void *ctx) {
+    struct bb_state *st = ctx;
+    struct blackboard *bb = &st->bb;
+    int x = MSG_PL(m, const struct pl_pos)->x;
+    int y = MSG_PL(m, const struct pl_pos)->y;
+    uint32_t id = es_insert(&bb->tgs, x, y, ++st->tgt_seq);
+    if (id != ES_NONE) {
+        // Reset waiting flag
+        st->waiting_reply = 0; 
+        
+        map_send_entity(st, MSG_ENT_PUT, ENT_TARGET, &bb->tgs, id);
+
+        struct msg map_msg;
+        
+        msg_init(&map_msg, IDX_B, MSG_TGT_REDRAW, 0); 
+        map_send(st, &map_msg);
+    }
+}
+
+// Squared distance of a hit from the drone, for the sort
+static int near_x, near_y;
+static const struct sgrid *near_grid;
+
+static int cmp_near(const void *a, const void *b) {
+    const struct sgrid_item *ia = &near_grid->items[*(const int *)a];
+    const struct sgrid_item *ib = &near_grid->items[*(const int *)b];
+    int da = (ia->x - near_x) * (ia->x - near_x) + (ia->y - near_y) * (ia->y - near_y);
+    int db = (ib->x - near_x) * (ib->x - near_x) + (ib->y - near_y) * (ib->y - near_y);
+    return (da > db) - (da < db);
+}
+
+/**
+ * Proximity checks: the obstacles within NEAR_DIST of the drone go to the
+ * Drone in one OBS_NEAR (repulsion), the current target within one cell is
+ * reached. Only the grid buckets around the drone are visited.
+ *
+ * OBS_NEAR is latest-wins in the router, so the list cannot be split over
+ * several messages: past PL_POINTS_MAX hits the nearest ones are sent. An
+ * empty list is sent once when the last near obstacle goes away, so the
+ * Drone never keeps pushing against obstacles that no longer exist.
+ */
+static void bb_check(struct bb_state *st) {
+    struct blackboard *bb = &st->bb;
+    int n = sgrid_query(&st->obs_grid, bb->drone_x, bb->drone_y, NEAR_DIST, st->near_hits, st->near_cap);
+    if (n > st->near_cap) {
+        int *hits = realloc(st->near_hits, n * sizeof(int));
+        if (hits) {
+            st->near_hits = hits;
+            st->near_cap = n;
+        }
+        n = sgrid_query(&st->obs_grid, bb->drone_x, bb->drone_y, NEAR_DIST, st->near_hits, st->near_cap);
+        if (n > st->near_cap) n = st->near_cap;
+    }
 
-    int tmp_tgs_x[MAX_OBS];
-    int tmp_tgs_y[MAX_OBS];
-    int tmp_num_tgs = 0;
+    int sent = n;
+    if (n > PL_POINTS_MAX) {
+        near_x = bb->drone_x;
+        near_y = bb->drone_y;
+        near_grid = &st->obs_grid;
+        qsort(st->near_hits, n, sizeof(int), cmp_near);
+        sent = PL_POINTS_MAX;
+        if (!st->near_cut)
+            LOG_WARN("%d obstacles near the drone, only the %d nearest sent", n, PL_POINTS_MAX);
+    }
+    st->near_cut = n > PL_POINTS_MAX;
+
+    if (sent > 0 || st->near_sent > 0) {
+        struct msg msg_f;
+        msg_init(&msg_f, IDX_B, MSG_OBS_NEAR, 4 + sent * 4);
+        struct pl_points *pts = MSG_PL(&msg_f, struct pl_points);
+        pts->first = 0;
+        pts->count = sent;
+        for (int i = 0; i < sent; i++) {
+            pts->pt[i].x = st->obs_grid.items[st->near_hits[i]].x;
+            pts->pt[i].y = st->obs_grid.items[st->near_hits[i]].y;
+        }
+        channel_send(st->out, &msg_f);
+        LOG_DEBUG("Sent %d of %d near obstacles to Drone", sent, n);
+    }
+    st->near_sent = sent;
+
+    // ---------------------------------------------------------------------------------------------------
+    // Logic to check the distance between drone and the first target
+    // ---------------------------------------------------------------------------------------------------
+
+    // Check distance between drone and the current target
+    uint32_t current = es_first(&bb->tgs);
+    if (current != ES_NONE && !st->waiting_reply) {
+        int d = es_find(&bb->tgs, current);
+        int dx = (bb->drone_x - bb->tgs.x[d]);
+        int dy = (bb->drone_y - bb->tgs.y[d]);
+
+        if (dx*dx + dy*dy <= 1){ // Threshold reached
+            struct msg msg_t;
+
+            // The next target becomes the current one
+            map_send_entity(st, MSG_ENT_DEL, ENT_TARGET, &bb->tgs, current);
+            es_remove(&bb->tgs, current);
+            msg_init(&msg_t, IDX_B, MSG_TGT_REACHED, 0);
+            channel_send(st->out, &msg_t);
+            LOG("Goal reached by the drone");
+
+            st->waiting_reply = 1;
+        }
+    }
+}
+
+static const msg_handler handlers[MSG_TYPE_COUNT] = {
+    [MSG_KEY]           = on_key,
+    [MSG_DRONE_POS]     = on_drone_pos,
+    [MSG_STATS]         = on_stats,
+    [MSG_RESIZE]        = on_resize,
+    [MSG_REMOTE_POS]    = on_remote_pos,
+    [MSG_REMOTE_GONE]   = on_remote_gone,
+    [MSG_OBS_GEN_RESET] = on_obs_gen_reset,
+    [MSG_OBS_NEW]       = on_obs_new,
+    [MSG_OBS_LAYOUT]    = on_obs_layout,
+    [MSG_TGT_GEN_RESET] = on_tgt_gen_reset,
+    [MSG_TGT_NEW]       = on_tgt_new,
+    [MSG_TGT_LAYOUT]    = on_tgt_layout,
+};
 
-    int received_tg = 0;
 
-    int received_resize = 0;
+int main(int argc, char *argv[]) {
+    
+    // Register process for logging
+    register_process("Blackboard");
+    LOG("Blackboard process started");
 
     if(argc < 3){
         fprintf(stderr, "Usage: %s <read_fd> <write_fd>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // fd_in: read from parent/router
-    int fd_in = atoi(argv[1]);
+    // ch_in: read from parent/router
+    struct channel ch_in;
+    channel_open(&ch_in, argv[1], 0);
 
-    // fd_out: write to father
-    int fd_out = atoi(argv[2]);
+    // ch_out: write to father
+    struct channel ch_out;
+    channel_open(&ch_out, argv[2], 1);
+
+    // Tell the router which message types this process consumes
+    struct msg sub;
+    msg_subscribe(&sub, IDX_B, msg_table_mask(handlers));
+    channel_send(&ch_out, &sub);
 
     // Watchdog PID to send alive signals
     pid_t watchdog_pid = atoi(argv[3]);
     
+    static struct bb_state st = {
+        .bb = {.W = 155, .H = 30, .running = 1},
+    };
+    struct blackboard *bb = &st.bb;
+    st.out = &ch_out;
+    es_init(&bb->obs);
+    es_init(&bb->tgs);
+    if (sgrid_init(&st.obs_grid, bb->W, bb->H, NEAR_DIST) < 0) {
+        perror("sgrid_init");
+        exit(EXIT_FAILURE);
+    }
+
     /* ========================================================================
      * NETWORK MODE: Operating mode parameter (0=STANDALONE, 1=SERVER, 2=CLIENT)
      * ======================================================================== */
-    int mode = (argc >= 5) ? atoi(argv[4]) : STANDALONE;
+    st.mode = (argc >= 5) ? atoi(argv[4]) : STANDALONE;
+    st.shm = bb_shm_open(argc >= 6 ? argv[5] : NULL, 1);
+    LOG(st.shm ? "State shared in memory with the Map" : "State replicated to the Map with messages");
+    bb_publish(&st);
+
+    // A ring wakeup can be spurious: never block after select()
+    channel_set_nonblock(&ch_in);
     
-    struct blackboard bb = {0, 0, {0}, {0}, 0, {0}, {0}, 0, 155, 30, 1};
-    int expected_obs = (int)roundf(bb.H*bb.W/1000);
-    int expected_tgs = (int)roundf(bb.H*bb.W/1000);
+    st.obs_rx.expected = -1;
+    st.tgs_rx.expected = -1;
 
-    while (bb.running) {
+    /* ========================================================================
+     * Periodic duties (heartbeat, remote drones, proximity checks) run from a
+     * timerfd: 50 ms in STANDALONE like the other processes, 20 ms in
+     * SERVER/CLIENT mode to move the remote drones smoothly. Messages are
+     * handled as soon as they arrive, all of them per wakeup.
+     * ======================================================================== */
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd == -1) {
+        perror("timerfd_create");
+        exit(EXIT_FAILURE);
+    }
+    long period_ns = (st.mode != STANDALONE ? 20 : 50) * 1000000L;
+    struct itimerspec its = {
+        .it_interval = {0, period_ns},
+        .it_value = {0, period_ns},
+    };
+    timerfd_settime(tfd, 0, &its, NULL);
+
+    while (bb->running) {
         fd_set fds;
         FD_ZERO(&fds);
-        FD_SET(fd_in, &fds);
-        int max_fd = fd_in + 1;
+        FD_SET(ch_in.fd, &fds);
+        FD_SET(tfd, &fds);
+        int max_fd = (ch_in.fd > tfd ? ch_in.fd : tfd) + 1;
 
-        struct timeval tv = {0, 50000};
-        int ready = select(max_fd, &fds, NULL, NULL, &tv);
+        int ready = select(max_fd, &fds, NULL, NULL, NULL);
 
         if (ready < 0) {
             if (errno == EINTR) continue; // interrupt handler
@@ -96,344 +727,59 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        // READ FROM ROUTER/PARENT
-        if (FD_ISSET(fd_in, &fds)){
-            // Read incoming message
-            struct msg m;
-            ssize_t n = read(fd_in, &m, sizeof(m));
-
-            // Message from Keyboard (I)
-            if (m.src == IDX_I) {
-                /*
-                if (mode != 0) {  // Only log in server/client mode
-                    char log_buf[80];
-                    snprintf(log_buf, sizeof(log_buf), "DEBUG: BB received Keyboard msg, key=%c", m.data[0]);
-                    LOG(log_buf);
+        // READ FROM ROUTER/PARENT: drain everything queued, then check once
+        if (FD_ISSET(ch_in.fd, &fds)){
+            struct msg batch[CHANNEL_BATCH];
+            int got = 0;
+            while (bb->running) {
+                int n = channel_recv_batch(&ch_in, batch, CHANNEL_BATCH);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) perror("read from router");
+                    break; // Drained (or a spurious ring wakeup)
                 }
-                */
-                // Forward the message to the drone
-                if (write(fd_out, &m, sizeof(m)) < 0) {
-                    perror("write to drone via router");
-                } else if (mode != 0) {
-                    LOG("BLACKBOARD: Forwarded Keyboard msg to Drone");
-                }
-                // ESC 
-                if (m.data[0] == 27){
-                    printf("[BB] EXIT\n");
-                    LOG("Received ESC from Keyboard, shutting down");
-                    snprintf(m.data, MSG_SIZE, "ESC");
-                    if(write(fd_out, &m, sizeof(m)) < 0){
-                        perror("write to map via router");
-                    } 
-                    bb.running = 0;
+                if (n == 0) {
+                    LOG("Router closed the channel");
+                    bb->running = 0;
+                    break;
                 }
+                for (int i = 0; i < n && bb->running; i++)
+                    msg_dispatch(handlers, &batch[i], &st);
+                got += n;
             }
-            // Message from Drone (D)
-            else if(m.src == IDX_D){
-                // Check if it's a STATS message first
-                if (strncmp(m.data, "STATS", 5) == 0) {
-                     // Forward STATS to Map
-                    struct msg map_msg = m;
-                    map_msg.src = IDX_B; // Mark as coming from Blackboard forwarding
-                    if(write(fd_out, &map_msg, sizeof(map_msg)) < 0){
-                        perror("write to map forwarding stats");
-                    }
-                } else {
-                    // It's a position update
-                    sscanf(m.data, "%d,%d", &bb.drone_x, &bb.drone_y);
-                    /* 
-                    {
-                        char log_msg[64];
-                        snprintf(log_msg, sizeof(log_msg), "Received drone position: %d,%d", bb.drone_x, bb.drone_y);
-                        LOG(log_msg);
-                    } 
-                    */
-
-                    struct msg map_msg;
-                    map_msg.src = IDX_B;
-                    snprintf(map_msg.data, MSG_SIZE, "D=%d,%d", bb.drone_x,bb.drone_y); 
-                    if(write(fd_out, &map_msg, sizeof(map_msg)) < 0){
-                        perror("write to map via router");
-                    } /*else if (mode != 0) {
-                        char log_pos[64];
-                        snprintf(log_pos, sizeof(log_pos), "BLACKBOARD: Received pos [%d,%d] from Drone, forwarded to Map", bb.drone_x, bb.drone_y);
-                        LOG(log_pos);
-                    }*/
-                }
+            if (got > 0) {
+                bb_check(&st);
+                bb_publish(&st);
             }
-            // Message from Map (M)
-            else if (m.src == IDX_M && strncmp(m.data, "RESIZE", 6) == 0){
-                
-                sscanf(m.data, "RESIZE %d %d", &bb.W, &bb.H);
-                //printf("[M->BB] RESIZE ricevuto %d, %d\n", bb.W, bb.H);
-                {
-                    char log_msg[64];
-                    snprintf(log_msg, sizeof(log_msg), "Forwarding RESIZE to Obstacles and Targets: %dx%d", bb.W, bb.H);
-                    LOG(log_msg);
-                }
-                
-                //printf("RESET");
-                
-                expected_obs = (int)roundf(bb.H*bb.W/1000);
-                expected_tgs = (int)roundf(bb.H*bb.W/1000);
-                tmp_num_obs = 0;
-                tmp_num_tgs = 0;
-
-                struct msg obs_msg = m;
-                obs_msg.src = IDX_B;
-                if(write(fd_out, &obs_msg, sizeof(obs_msg))< 0){
-                    perror("write to obstacles and targets via router");
-                }  
-            }
-            /* ====================================================================
-             * NETWORK MODE: Obstacle Message Handling
-             * ==================================================================== */
-            else if(m.src == IDX_O){ 
-                /* NETWORK: CLIENT receives SERVER drone as REMOTE obstacle */
-                if (mode == CLIENT && strncmp(m.data, "REMOTE", 6) == 0) {
-                    int rx, ry;
-                    if (sscanf(m.data, "REMOTE %d, %d", &rx, &ry) == 2) {
-                        struct msg map_msg;
-                        map_msg.src = IDX_B;
-                        snprintf(map_msg.data, MSG_SIZE, "O=%d,%d", rx, ry);
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                        
-                        bb.obs_x[0] = rx;
-                        bb.obs_y[0] = ry;
-                        bb.num_obs=1;
-                    }
-                    continue;
-                }
-                
-                /* NETWORK: SERVER receives CLIENT drone as single obstacle */
-                if (mode == SERVER && strncmp(m.data, "O=", 2) == 0) {
-                    struct msg map_msg = m;
-                    map_msg.src = IDX_B;
-                    write(fd_out, &map_msg, sizeof(map_msg));
-                    sscanf(m.data, "O=%d,%d", &bb.obs_x[0], &bb.obs_y[0]);
-                    bb.num_obs=1;
-                    continue;
-                }
-                
-                /* STANDALONE: Normal obstacle processing */
-                if (strncmp(m.data, "RESET", 5) == 0){ 
-                    
-                    tmp_num_obs = 0;
-                    LOG("Obstacles reset received");
-                    continue;
-                } 
-                else if (strncmp(m.data, "NEW", 3) == 0){
-                    int x, y;
-                    sscanf(m.data, "NEW: %d,%d", &x, &y);
-                    if (bb.num_obs > 0) {
-                        // Shift internal obstacle list
-                        for (int i = 0; i < bb.num_obs - 1; i++) {
-                            bb.obs_x[i] = bb.obs_x[i + 1];
-                            bb.obs_y[i] = bb.obs_y[i + 1];
-                        }
-                        bb.obs_x[bb.num_obs - 1] = x;
-                        bb.obs_y[bb.num_obs - 1] = y;
-
-                        struct msg map_msg;
-                        map_msg.src = IDX_B;
-                        snprintf(map_msg.data, MSG_SIZE, "O_SHIFT=%d,%d", x, y);
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                        
-                        snprintf(map_msg.data, MSG_SIZE, "REDRAW_O");
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                        LOG("Shifted obstacle list and notified Map");
-                    }
-                }
-
-                if (tmp_num_obs < expected_obs){
-                    int x, y; 
-                    sscanf(m.data, "%d,%d", &x, &y);
-                
-                    tmp_obs_x[tmp_num_obs] = x;
-                    tmp_obs_y[tmp_num_obs] = y;
-                    tmp_num_obs++;
-                    /*
-                    {
-                        char log_msg[64];
-                        snprintf(log_msg, sizeof(log_msg), "Received Obstacle at %d,%d", x, y);
-                        LOG(log_msg);
-                    }
-                    */
-                    //printf("[BB] obstacle position: %d,%d; n%d\n", x, y, tmp_num_obs);
-                    
-                    if (tmp_num_obs == expected_obs){
-                        struct msg map_msg;
-                        map_msg.src = IDX_B;
-
-                        snprintf(map_msg.data, MSG_SIZE, "RESET_O");
-                        write(fd_out, &map_msg, sizeof(map_msg));
-
-                        snprintf(map_msg.data, MSG_SIZE, "STOP_O");
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                        LOG("sent STOP_O and RESET_O");
-
-                        for(int i=0; i<tmp_num_obs; i++) {
-                            bb.obs_x[i] = tmp_obs_x[i];
-                            bb.obs_y[i] = tmp_obs_y[i];
-                            bb.num_obs++;
-
-                            snprintf(map_msg.data, MSG_SIZE, "O=%d,%d",  bb.obs_x[i], bb.obs_y[i]);
-                            write(fd_out, &map_msg, sizeof(map_msg));
-                        }
-
-                        snprintf(map_msg.data, MSG_SIZE, "REDRAW_O"); 
-                        write(fd_out, &map_msg, sizeof(map_msg)); 
-                        LOG("Forwarding REDRAW_O to Map");
-                        
-                        tmp_num_obs = 1000; // Safe sentinel
-                    }
-                }
-            }
-            // Message from Targets (T)
-            else if (m.src == IDX_T) {
-                if (strncmp(m.data, "RESET", 5) == 0) {
-                    tmp_num_tgs = 0;
-                    LOG("Targets reset received");
-                    continue;
-                }
-                else if (strncmp(m.data, "NEW", 3) == 0){
-                    int x, y;
-                    sscanf(m.data, "NEW: %d,%d", &x, &y);
-                    if (bb.num_tgs < MAX_OBS) {
-                        bb.tgs_x[bb.num_tgs] = x;
-                        bb.tgs_y[bb.num_tgs] = y;
-                        bb.num_tgs++;
-                        
-                        // Reset waiting flag
-                        waiting_reply = 0; 
-                        
-                        struct msg map_msg;
-                        map_msg.src = IDX_B;
-                        snprintf(map_msg.data, MSG_SIZE, "GOAL=%d,%d", x, y);
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                        
-                        snprintf(map_msg.data, MSG_SIZE, "REDRAW_T"); 
-                        write(fd_out, &map_msg, sizeof(map_msg));
-                    }
-                }
-                else {
-                    int x, y;
-                    sscanf(m.data, "%d,%d", &x, &y);
-
-                    expected_tgs = (int)roundf(bb.H * bb.W / 1000);
-
-                    if (tmp_num_tgs < expected_tgs) {
-                        tmp_tgs_x[tmp_num_tgs] = x;
-                        tmp_tgs_y[tmp_num_tgs] = y;
-                        tmp_num_tgs++;
-
-                        {
-                            char log_msg[64];
-                            snprintf(log_msg, sizeof(log_msg), "Received Target at %d,%d", x, y);
-                            LOG(log_msg);
-                        }
-                        //printf("[BB] target position: %d,%d; n%d\n", x, y, tmp_num_tgs);
-                        
-                        if (tmp_num_tgs == expected_tgs) {
-
-                            struct msg map_msg;
-                            map_msg.src = IDX_B;
-
-                            snprintf(map_msg.data, MSG_SIZE, "RESET_T");
-                            write(fd_out, &map_msg, sizeof(map_msg));
-
-                            // Blocca il generatore di targets
-                            snprintf(map_msg.data, MSG_SIZE, "STOP_T");
-                            write(fd_out, &map_msg, sizeof(map_msg));
-                            LOG("sent STOP_T and RESET_T");
-                            //printf("[BB->T] STOP INVIATO\n");
-
-                            // Salvo target nella BB e li mando alla mappa
-                            bb.num_tgs = 0;
-                            for (int i = 0; i < tmp_num_tgs; i++) {
-                                bb.tgs_x[i] = tmp_tgs_x[i];
-                                bb.tgs_y[i] = tmp_tgs_y[i];
-                                bb.num_tgs++;
-
-                                snprintf(map_msg.data, MSG_SIZE, "T[%d]=%d,%d",
-                                        i, bb.tgs_x[i], bb.tgs_y[i]);
-                                write(fd_out, &map_msg, sizeof(map_msg));
-                            }
-
-                            // Redraw targets
-                            snprintf(map_msg.data, MSG_SIZE, "REDRAW_T");
-                            write(fd_out, &map_msg, sizeof(map_msg));
-                            LOG("Forwarding REDRAW_T to Map");
-                            
-                            tmp_num_tgs = 1000; // Sentinel value
-                        }
-                    }
-                }
-            }
-
-            // Check distance between drone and obstacles
-            for (int i = 0; i < bb.num_obs; i++){
-                int dx = (bb.drone_x - bb.obs_x[i]);
-                int dy = (bb.drone_y - bb.obs_y[i]);
-
-                double dis = sqrt(dx*dx + dy*dy);
-                if (dis <= d0 && dis > 0.0){
-                    struct msg msg_f;
-                    msg_f.src = IDX_B;
+        }
 
-                    snprintf(msg_f.data, MSG_SIZE, "OBS_POS= %d,%d", bb.obs_x[i], bb.obs_y[i]);
-                    write(fd_out, &msg_f, sizeof(msg_f));
-                    LOG("Sent OBS_POS near to Drone");
-                }
-            }
+        if (FD_ISSET(tfd, &fds)) {
+            uint64_t expirations;
+            if (read(tfd, &expirations, sizeof(expirations)) > 0) {
+                if (st.mode != STANDALONE) remote_tick(&st);
+                bb_check(&st);
+                bb_publish(&st);
 
-            // ---------------------------------------------------------------------------------------------------
-            // Logic to check the distance between drone and the first target
-            // ---------------------------------------------------------------------------------------------------
-
-            // Check distance between drone and the current target
-            if (bb.num_tgs > 0 && !waiting_reply) {
-                int dx = (bb.drone_x - bb.tgs_x[0]);
-                int dy = (bb.drone_y - bb.tgs_y[0]);
-
-                double dis = sqrt(dx*dx + dy*dy);
-                if (dis <= 1.0){ // Threshold reached
-                    struct msg msg_t;
-                    msg_t.src = IDX_B;
-
-                    // Shift remaining targets
-                    for (int i = 0; i < bb.num_tgs - 1; i++) {
-                        bb.tgs_x[i] = bb.tgs_x[i + 1];
-                        bb.tgs_y[i] = bb.tgs_y[i + 1];
-                    }
-                    bb.num_tgs--;
-                    snprintf(msg_t.data, MSG_SIZE, "TARGET_REACHED");
-                    write(fd_out, &msg_t, sizeof(msg_t));
-                    LOG("Goal reached by the drone");
-                    
-                    waiting_reply = 1;
-                }
+                union sigval val;
+                val.sival_int = time(NULL);
+                if (watchdog_pid > 0) sigqueue(watchdog_pid, SIGUSR1, val);
             }
         }
-        /* ========================================================================
-         * NETWORK MODE: Timing Adjustment
-         * ========================================================================
-         * Different sleep duration based on mode:
-         *   - STANDALONE: 50ms (20Hz) - matches Watchdog and other processes
-         *   - SERVER/CLIENT: 10ms (100Hz) - faster to handle network messages
-         * ======================================================================== */
-        union sigval val;
-        val.sival_int = time(NULL);
-        if (watchdog_pid > 0) sigqueue(watchdog_pid, SIGUSR1, val);
-        
-        if (mode != STANDALONE)
-            usleep(10000);  // 100Hz in network mode for faster message handling
-        else
-            usleep(50000);  // 20Hz in standalone mode 
     }
-    
-    close(fd_in);
-    close(fd_out);
+
+    close(tfd);
+    sgrid_free(&st.obs_grid);
+    free(st.near_hits);
+    free(st.obs_rx.x);
+    free(st.obs_rx.y);
+    free(st.tgs_rx.x);
+    free(st.tgs_rx.y);
+    es_free(&bb->obs);
+    es_free(&bb->tgs);
+    bb_snapshot_free(&st.snap);
+    bb_shm_close(st.shm);
+    channel_close(&ch_in);
+    channel_close(&ch_out);
     LOG("Blackboard terminated");
     return 0;
 }
\ No newline at end of file
@@ -14,17 +14,28 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "DRONE"
 #include "../include/common.h"
+#include "../include/channel.h"
+#include "../include/bb_shm.h"
+#include "../include/force_field.h"
+#include "../include/dronesim.h"
+#include "../include/repulsion.h"
+#include "../include/config_watch.h"
+#include "../include/periodic.h"
 
-#define MSG_SIZE 64
+#define PARAM_FILE "config/ParameterFile.txt"
+#define MAX_FRAME 0.25f     // Longest gap integrated at once (s): a stall is not replayed in full
 
 
 struct params{
     float M; // Mass
     float K; // Viscous coefficient
-    float T; // Simulation time step (sec)
+    float T; // Publish period (sec): one loop iteration
     float USER_FORCE; // User input force scaling
     float RHO; // Repulsive force range
     float NI; // Repulsive force gain
+    float DT; // Physics step (sec), 0 = T
+    int INTEGRATOR; // DS_EULER (semi-implicit), DS_VERLET, DS_RK4
+    int REPULSION; // 0 = cached grid, 1 = exact sum over the obstacles
 };
 
 struct drone{
@@ -60,6 +71,9 @@ int load_params(const char *filename, struct params *p){
             else if (strcmp(key, "USER_FORCE") == 0) p->USER_FORCE = value;
             else if (strcmp(key, "RHO") == 0) p->RHO = value;
             else if (strcmp(key, "NI") == 0) p->NI = value;
+            else if (strcmp(key, "DT") == 0) p->DT = value;
+            else if (strcmp(key, "INTEGRATOR") == 0) p->INTEGRATOR = (int)value;
+            else if (strcmp(key, "REPULSION") == 0) p->REPULSION = (int)value;
         }
     }
     
@@ -67,6 +81,132 @@ int load_params(const char *filename, struct params *p){
     return 0;
 }
 
+/**
+ * Values the dynamics can run with (a file saved mid-edit may hold others).
+ */
+static int params_valid(const struct params *p) {
+    const float v[] = { p->M, p->K, p->T, p->USER_FORCE, p->RHO, p->NI, p->DT };
+    for (size_t i = 0; i < sizeof(v) / sizeof(v[0]); i++)
+        if (!isfinite(v[i])) return 0;
+    return p->M > 0 && p->K >= 0 && p->T > 0 && p->T <= 1.0f &&
+           p->USER_FORCE >= 0 && p->RHO > 0 && p->NI >= 0 &&
+           (p->DT == 0 || (p->DT >= 0.0001f && p->DT <= 1.0f)) &&
+           p->INTEGRATOR >= 0 && p->INTEGRATOR < DS_INTEGRATORS &&
+           (p->REPULSION == 0 || p->REPULSION == 1);
+}
+
+/**
+ * Parse the file into a copy and swap it in only if it is valid: the
+ * dynamics always see a complete, consistent set.
+ */
+static void reload_params(struct params *p) {
+    struct params next = *p;
+    if (load_params(PARAM_FILE, &next) < 0) return;
+    if (!params_valid(&next)) {
+        LOG_WARN("Parameters rejected (M=%.3f K=%.3f T=%.3f USER_FORCE=%.3f RHO=%.3f NI=%.3f DT=%.4f INTEGRATOR=%d REPULSION=%d), keeping the old ones",
+                 next.M, next.K, next.T, next.USER_FORCE, next.RHO, next.NI, next.DT, next.INTEGRATOR, next.REPULSION);
+        return;
+    }
+    *p = next;
+    LOG_INFO("Parameters loaded: M=%.3f K=%.3f T=%.3f USER_FORCE=%.3f RHO=%.3f NI=%.3f DT=%.4f INTEGRATOR=%d REPULSION=%d (%s)",
+             p->M, p->K, p->T, p->USER_FORCE, p->RHO, p->NI, p->DT, p->INTEGRATOR, p->REPULSION,
+             p->REPULSION ? rep_isa_name(rep_isa()) : "grid");
+}
+
+// Inputs collected from the router during one tick
+struct drone_inbox {
+    int width, height;  // Game area
+    int flag_reset;     // Reset requested (key 'r' or resize)
+    int running;
+    int num_near;       // Last near obstacles reported (no shared segment)
+    int near_x[PL_POINTS_MAX], near_y[PL_POINTS_MAX];
+    struct drone *D;
+    int last_ch;        // Last movement key of the current burst
+};
+
+static void request_reset(struct drone_inbox *in) {
+    in->flag_reset = 1; 
+    printf("RESET\n");
+    LOG("Reset command received");
+}
+
+static void on_key(const struct msg *m, void *ctx) {
+    struct drone_inbox *in = ctx;
+    struct drone *D = in->D;
+    int ch = MSG_PL(m, const struct pl_key)->key;
+
+    LOG_DEBUG("DRONE: Received key '%c' from router (src=%d)", ch, m->src);
+
+    int is_move = (ch == 'w' || ch == 'x' || ch == 'a' || ch == 'd' || 
+                   ch == 'e' || ch == 'c' || ch == 'q' || ch == 'z' || ch == 's');
+    
+    // Dynamics Stabilization: Skip redundant movement keys in a single burst
+    if (is_move && ch == in->last_ch) {
+        return;
+    }
+    if (is_move) in->last_ch = ch;
+
+    // Movement
+    if (ch == 'w') D->Fy--;
+    else if (ch == 'x') D->Fy++;
+    else if (ch == 'a') D->Fx--;
+    else if (ch == 'd') {D->Fx++;}
+    else if (ch == 'e') { D->Fx++; D->Fy--; }
+    else if (ch == 'c') { D->Fx++; D->Fy++; }
+    else if (ch == 'q') { D->Fx--; D->Fy--; }
+    else if (ch == 'z') { D->Fx--; D->Fy++; }
+    else if (ch == 's') { D->Fx = 0; D->Fy = 0; }
+    else if (ch == 'r') request_reset(in); // Reset
+    else if (ch == 27) {
+        printf("[DRONE] EXIT\n");
+        LOG("Received ESC, shutting down");
+        in->running = 0; 
+    } // ESC closes everything
+}
+
+static void on_resize(const struct msg *m, void *ctx) {
+    struct drone_inbox *in = ctx;
+    const struct pl_size *sz = MSG_PL(m, const struct pl_size);
+    in->width = sz->w;
+    in->height = sz->h;
+    LOG_INFO("Window resized to %dx%d", in->width, in->height);
+    request_reset(in);
+}
+
+static void on_obs_near(const struct msg *m, void *ctx) {
+    struct drone_inbox *in = ctx;
+    const struct pl_points *pts = MSG_PL(m, const struct pl_points);
+    // The Blackboard sends every near obstacle at once: the newest list wins
+    in->num_near = pts->count <= PL_POINTS_MAX ? pts->count : PL_POINTS_MAX;
+    for (int i = 0; i < in->num_near; i++) {
+        in->near_x[i] = pts->pt[i].x;
+        in->near_y[i] = pts->pt[i].y;
+    }
+    LOG_DEBUG("%d obstacles detected", in->num_near);
+    //printf("[D] Obstacle NEAR\n");
+}
+
+static void on_esc(const struct msg *m, void *ctx) {
+    (void)m;
+    struct drone_inbox *in = ctx;
+    printf("[DRONE] EXIT\n");
+    in->running = 0;
+}
+
+static const msg_handler handlers[MSG_TYPE_COUNT] = {
+    [MSG_KEY]      = on_key,
+    [MSG_RESIZE]   = on_resize,
+    [MSG_OBS_NEAR] = on_obs_near,
+    [MSG_ESC]      = on_esc,
+};
+
+// Shared state in use: the obstacles come from the segment, all of them
+static const msg_handler shm_handlers[MSG_TYPE_COUNT] = {
+    [MSG_KEY]      = on_key,
+    [MSG_RESIZE]   = on_resize,
+    [MSG_ESC]      = on_esc,
+};
+
 int main(int argc, char *argv[]) {
 
     // Register process for logging
@@ -80,18 +220,31 @@ int main(int argc, char *argv[]) {
     }
     // Drone initialization
     struct drone D;
-    D.x = 5;
-    D.y = 5;
+    D.x = DRONE_START_X;
+    D.y = DRONE_START_Y;
     D.Fx = 0;
     D.Fy = 0;
     D.vx = 0;
     D.vy = 0;
 
-    // fd_in: read from parent/router
-    int fd_in = atoi(argv[1]);
+    // ch_in: read from parent/router
+    struct channel ch_in;
+    channel_open(&ch_in, argv[1], 0);
+
+    // ch_out: write to parent/router
+    struct channel ch_out;
+    channel_open(&ch_out, argv[2], 1);
+
+    // Obstacle set: the whole Blackboard list from the shared segment if
+    // there is one, else the near obstacles the Blackboard sends
+    struct bb_shm *shm = bb_shm_open(argc >= 6 ? argv[5] : NULL, 0);
+    const msg_handler *table = shm ? shm_handlers : handlers;
+    LOG(shm ? "Obstacles read from shared memory" : "Obstacles from the near list messages");
 
-    // fd_out: write to parent/router
-    int fd_out = atoi(argv[2]);
+    // Tell the router which message types this process consumes
+    struct msg sub;
+    msg_subscribe(&sub, IDX_D, msg_table_mask(table));
+    channel_send(&ch_out, &sub);
 
     // Watchdog PID to send alive signals
     pid_t watchdog_pid = atoi(argv[3]);
@@ -100,12 +253,16 @@ int main(int argc, char *argv[]) {
     float Y = D.y;
 
     // Set input pipe to non-blocking to ensure physics keeps running
-    int flags = fcntl(fd_in, F_GETFL, 0);
-    fcntl(fd_in, F_SETFL, flags | O_NONBLOCK);
-
-    //map
-    int height = 30;
-    int width = 155;
+    channel_set_nonblock(&ch_in);
+
+    // Map size, pending reset and last near obstacle
+    struct drone_inbox in = {
+        .width = 155,
+        .height = 30,
+        .flag_reset = 0,
+        .running = 1,
+        .D = &D,
+    };
 
     // Default parameters if file loading fails
     struct params p = {
@@ -114,56 +271,92 @@ int main(int argc, char *argv[]) {
         .T = 0.05,
         .USER_FORCE = 5.0,
         .RHO = 3.0,
-        .NI = 40.0
+        .NI = 40.0,
+        .DT = 0,
+        .INTEGRATOR = DS_EULER,
+        .REPULSION = 0
     };
 
-    int flag_reset = 0;
-    int running = 1;
+    // Repulsion from obstacles and walls, cached on a grid
+    struct force_field ff;
+    ff_init(&ff);
+    uint32_t shm_seq = 1;   // Odd: no snapshot taken yet
+    struct bb_snapshot snap = {0};
+
+    // Continuous state of the drone: a simulation of one
+    struct dronesim sim;
+    if (ds_init(&sim, 1) < 0) {
+        perror("ds_init");
+        exit(EXIT_FAILURE);
+    }
+
+    // Parameters: read once, then again only when the file changes
+    struct config_watch cw;
+    if (cw_open(&cw, PARAM_FILE) < 0) perror("cw_open");
+    reload_params(&p);
+
+    // Optional real-time physics: ARP_DRONE_RT_PRIO (SCHED_FIFO), ARP_DRONE_CPU (pinning)
+    const char *rt_prio = getenv("ARP_DRONE_RT_PRIO");
+    const char *rt_cpu = getenv("ARP_DRONE_CPU");
+    if (rt_prio || rt_cpu) {
+        int prio = rt_prio ? atoi(rt_prio) : 0;
+        int cpu = rt_cpu ? atoi(rt_cpu) : -1;
+        if (pt_realtime(prio, cpu) < 0)
+            LOG_WARN("Real-time setup failed (SCHED_FIFO %d, CPU %d): %s", prio, cpu, strerror(errno));
+        else
+            LOG_INFO("Real-time setup: SCHED_FIFO %d, CPU %d", prio, cpu);
+    }
+
+    // One loop iteration every T, on absolute deadlines
+    struct periodic pt;
+    if (pt_open(&pt, (long)(p.T * 1e9)) < 0) perror("pt_open");
+
+    // Simulated time owed to the physics (fixed steps of DT)
+    float accumulator = 0;
+    struct timespec last_time;
+    clock_gettime(CLOCK_MONOTONIC, &last_time);
 
     // Initial message for the position
     struct msg out_msg;
-    out_msg.src = IDX_D;
-    snprintf(out_msg.data, MSG_SIZE, "%d,%d", D.x, D.y);
-    if (write(fd_out, &out_msg, sizeof(out_msg)) < 0) {
+    msg_pos(&out_msg, IDX_D, MSG_DRONE_POS, D.x, D.y);
+    if (channel_send(&ch_out, &out_msg) < 0) {
         perror("write to router");
     }
 
-    while(running){
-        load_params("config/ParameterFile.txt", &p);
+    while(in.running){
+        // Applied between two steps, never in the middle of one
+        if (cw_poll(&cw)) {
+            reload_params(&p);
+            pt_set_period(&pt, (long)(p.T * 1e9));
+        }
 
         struct timespec start_time;
         clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-        if (flag_reset){
-            D.x = 5;
-            D.y = 5;
+        if (in.flag_reset){
+            D.x = DRONE_START_X;
+            D.y = DRONE_START_Y;
             D.vx = 0;
             D.vy = 0;
             D.Fx = 0;
             D.Fy = 0;
             X = D.x;
             Y = D.y;
-            flag_reset = 0;
-            snprintf(out_msg.data, MSG_SIZE, "%d,%d", D.x, D.y);
-            if (write(fd_out, &out_msg, sizeof(out_msg)) < 0) {
+            accumulator = 0;
+            in.flag_reset = 0;
+            msg_pos(&out_msg, IDX_D, MSG_DRONE_POS, D.x, D.y);
+            if (channel_send(&ch_out, &out_msg) < 0) {
                 perror("write to router");
     }
         }
         
         x = D.x;
         y = D.y;
-        int dx = -100; // Large sentinel
-        int dy = -100; // Large sentinel
+        in.last_ch = -1;
 
-        int last_ch_in_burst = -1;
-        while (1) {
+        while (in.running) {
             struct msg m;
-            ssize_t n = read(fd_in, &m, sizeof(m));
-            if (n > 0) {
-                 char dbg[64];
-                 snprintf(dbg, sizeof(dbg), "DRONE: Received key '%c' from router (src=%d)", m.data[0], m.src);
-                 LOG(dbg);
-            }
+            ssize_t n = channel_recv(&ch_in, &m);
             if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     break; // No more messages in pipe
@@ -173,147 +366,98 @@ int main(int argc, char *argv[]) {
             }
             if (n == 0) break; // EOF
 
-            int ch = (m.data[0]);
-            
-            int is_move = (ch == 'w' || ch == 'x' || ch == 'a' || ch == 'd' || 
-                           ch == 'e' || ch == 'c' || ch == 'q' || ch == 'z' || ch == 's');
-            
-            // Dynamics Stabilization: Skip redundant movement keys in a single burst
-            if (is_move && ch == last_ch_in_burst) {
-                continue;
-            }
-            if (is_move) last_ch_in_burst = ch;
-
-            if (strncmp(m.data, "RESIZE", 6)== 0){
-                ch = 'r';
-                sscanf(m.data, "RESIZE %d %d", &width, &height);
-                {
-                    char log_msg[64];
-                    snprintf(log_msg, sizeof(log_msg), "Window resized to %dx%d", width, height);
-                    LOG(log_msg);
-                }
-            }
-            // Movement
-            if (ch == 'w') D.Fy--;
-            else if (ch == 'x') D.Fy++;
-            else if (ch == 'a') D.Fx--;
-            else if (ch == 'd') {D.Fx++;}
-            else if (ch == 'e') { D.Fx++; D.Fy--; }
-            else if (ch == 'c') { D.Fx++; D.Fy++; }
-            else if (ch == 'q') { D.Fx--; D.Fy--; }
-            else if (ch == 'z') { D.Fx--; D.Fy++; }
-            else if (ch == 's') { D.Fx = 0; D.Fy = 0; }
-            else if (ch == 'r') { 
-                flag_reset = 1; 
-                printf("RESET\n");
-                LOG("Reset command received");
-            } // Reset
-            else if (ch == 27) {
-                printf("[DRONE] EXIT\n");
-                LOG("Received ESC, shutting down");
-                running = 0; 
-                break;
-            } // ESC closes everything
-
-            if (strncmp(m.data, "OBS_POS", 7)== 0){
-                sscanf(m.data, "OBS_POS= %d,%d", &dx, &dy);
-                LOG("Obstacle detected");
-                //printf("[D] Obstacle NEAR\n");
-            }
-            else if (strncmp(m.data, "ESC", 3)== 0){
-                printf("[DRONE] EXIT\n");
-                running = 0;
-                break;
-            }
+            msg_dispatch(table, &m, &in);
         }
         
-        if (!running) break;
-        // Repulsive Force x and y from obstacles
-        float dist_x = X - dx;
-        float dist_y = Y - dy;
-        float dist = sqrt(dist_x*dist_x + dist_y*dist_y);
-        float Frep_x = 0;
-        float Frep_y = 0;
-        if (dist < p.RHO && dist>0){
-            Frep_x = p.NI * (1.0/dist - 1.0/p.RHO) * (dist_x / dist) * 5;
-            Frep_y = p.NI * (1.0/dist - 1.0/p.RHO) * (dist_y / dist) * 5;
+        if (!in.running) break;
+        // Repulsive Force x and y from every obstacle within RHO and the
+        // walls: a lookup in the field, rebuilt only when something changed
+        ff_set_area(&ff, in.width, in.height);
+        ff_set_params(&ff, p.RHO, p.NI);
+        if (shm) {
+            if (bb_shm_seq(shm) != shm_seq) {
+                shm_seq = bb_shm_read(shm, &snap);
+                ff_set_obstacles(&ff, snap.obs_x, snap.obs_y, snap.num_obs);
+            }
+        } else {
+            ff_set_obstacles(&ff, in.near_x, in.near_y, in.num_near);
         }
 
-        // Repulsive Force x and y from the walls
-        // Wall left
-        dist_x = X;
-        if (dist_x < p.RHO){ Frep_x += p.NI * (1.0/dist_x - 1.0/p.RHO)*(dist_x/dist_x);}
-
-        // Wall right
-        dist_x = abs(X - width);
-        if (dist_x < p.RHO) {Frep_x -= p.NI * (1.0/dist_x - 1.0/p.RHO)*(dist_x/dist_x);}
-
-        // Wall top
-        dist_y = Y;
-        if (dist_y < p.RHO) {Frep_y += p.NI * (1.0/dist_y - 1.0/p.RHO)*(dist_y/dist_y);}
-
-        // Wall bottom
-        dist_y = abs(Y- height);
-        if (dist_y < p.RHO) {Frep_y -= p.NI * (1.0/dist_y - 1.0/p.RHO)*(dist_y/dist_y);}
-
-        // printf("Repulsive force: %f, %f", Frep_x, Frep_y);
-
-        // Viscous force X
-        float Fvisc_x = p.K * D.vx;
+        // Advance by the real time elapsed, in whole steps of DT: the rest
+        // stays in the accumulator, so scheduling jitter does not change
+        // the trajectory, only when it is published
+        float dt = p.DT > 0 ? p.DT : p.T;
+        double frame = (start_time.tv_sec - last_time.tv_sec) + (start_time.tv_nsec - last_time.tv_nsec) / 1e9;
+        last_time = start_time;
+        accumulator += frame < MAX_FRAME ? (float)frame : MAX_FRAME;
+
+        struct ds_params dp = {
+            .M = p.M,
+            .K = p.K,
+            .USER_FORCE = p.USER_FORCE,
+            .integrator = p.INTEGRATOR,
+            .exact = p.REPULSION,
+        };
+        ds_set_area(&sim, in.width, in.height);
+        sim.x[0] = X;
+        sim.y[0] = Y;
+        sim.vx[0] = D.vx;
+        sim.vy[0] = D.vy;
+        sim.ux[0] = D.Fx;
+        sim.uy[0] = D.Fy;
+        int steps = 0;
+        while (accumulator >= dt) {
+            ds_step(&sim, &dp, &ff, dt);
+            accumulator -= dt;
+            steps++;
+        }
+        X = sim.x[0];
+        Y = sim.y[0];
+        D.vx = sim.vx[0];
+        D.vy = sim.vy[0];
 
-        // Resulting Force X
-        float Fx_TOT = D.Fx * p.USER_FORCE - Fvisc_x + Frep_x;
-        
-        // Viscous force Y
-        float Fvisc_y = p.K * D.vy;
-        // Resulting Force Y
-        float Fy_TOT = D.Fy * p.USER_FORCE - Fvisc_y + Frep_y;
-
-        // X position update
-        float ax = Fx_TOT/p.M;
-        D.vx = D.vx + ax * p.T;
-        X = X + D.vx * p.T;
-        // Y position update
-        float ay = Fy_TOT/p.M;
-        D.vy = D.vy + ay * p.T;
-        Y = Y + D.vy * p.T;
+        // Resulting force at the published state (diagnostics)
+        float Fx_TOT, Fy_TOT;
+        ds_force(&sim, &dp, &ff, 0, &Fx_TOT, &Fy_TOT);
 
         // Zero out small velocities to prevent jitter
         if (fabs(D.vx) < 0.01) D.vx = 0;
         if (fabs(D.vy) < 0.01) D.vy = 0;
         
-        // Send STATS to Blackboard for Diagnostics
-        // Send STATS to Blackboard for Diagnostics (Reduced frequency)
-        static int stats_count = 0;
-        if (stats_count++ % 10 == 0) {
-            struct msg stats_msg;
-            stats_msg.src = IDX_D;
-            snprintf(stats_msg.data, MSG_SIZE, "STATS Fx=%.2f Fy=%.2f Vx=%.2f Vy=%.2f X=%.2f Y=%.2f (T=%.3f)", Fx_TOT, Fy_TOT, D.vx, D.vy, X, Y, p.T);
-            write(fd_out, &stats_msg, sizeof(stats_msg));
-            LOG(stats_msg.data);
-        }
         // Update the discrete position
         D.x = (int)roundf(X);
         D.y = (int)roundf(Y);
 
-        if (D.x < 1){ D.x = 1; X = 1.0; D.vx = 0;}
-        if (D.y < 1) {D.y = 1; Y = 1.0; D.vy = 0;}
-        if (D.x >= width - 1) {D.x = width - 2; X = (float)(width - 2); D.vx = 0;}
-        if (D.y >= height - 1) {D.y = height - 2; Y = (float)(height - 2); D.vy = 0;}
+        int moved = !(D.x == x && D.y == y);
+
+        // Send STATS to Blackboard for Diagnostics (Reduced frequency).
+        // Also on every cell change: the velocity goes with the position to
+        // the network peers, which extrapolate the drone between updates.
+        static int stats_count = 0;
+        int periodic = stats_count++ % 10 == 0;
+        if (periodic || moved) {
+            struct msg stats_msg;
+            msg_init(&stats_msg, IDX_D, MSG_STATS, sizeof(struct pl_stats));
+            struct pl_stats *st = MSG_PL(&stats_msg, struct pl_stats);
+            st->fx = Fx_TOT; st->fy = Fy_TOT;
+            st->vx = D.vx;   st->vy = D.vy;
+            st->x = X;       st->y = Y;
+            st->T = p.T;
+            channel_send(&ch_out, &stats_msg);
+
+            if (periodic)
+                LOG_DEBUG("STATS Fx=%.2f Fy=%.2f Vx=%.2f Vy=%.2f X=%.2f Y=%.2f (T=%.3f, %d steps of %.4f, field rebuilds %lu)", Fx_TOT, Fy_TOT, D.vx, D.vy, X, Y, p.T, steps, dt, ff.builds);
+        }
 
         //printf("x=%d, y=%d\n", D.x, D.y);
         //printf("Fx=%f, Fy=%f\n", Fx_TOT, Fy_TOT);
     
-        if (!(D.x == x && D.y == y)){
-            snprintf(out_msg.data, MSG_SIZE, "%d,%d", D.x, D.y);
-            if (write(fd_out, &out_msg, sizeof(out_msg)) < 0) {
+        if (moved){
+            msg_pos(&out_msg, IDX_D, MSG_DRONE_POS, D.x, D.y);
+            if (channel_send(&ch_out, &out_msg) < 0) {
                 perror("write to router");
             }
-            /*
-            char log_msg[64];
-            snprintf(log_msg, sizeof(log_msg), "Drone moved to %d,%d", D.x, D.y);
-            LOG(log_msg);
-            */
+            LOG_TRACE("Drone moved to %d,%d", D.x, D.y);
 
         }
         // Send alive signal to watchdog - ALWAYS guard with watchdog_pid > 0
@@ -323,21 +467,33 @@ int main(int argc, char *argv[]) {
             sigqueue(watchdog_pid, SIGUSR1, val);
         }
 
-        // Precise, signal-safe sleep to maintain constant frequency
-        struct timespec end_time, sleep_req;
-        clock_gettime(CLOCK_MONOTONIC, &end_time);
-        long elapsed_ns = (end_time.tv_sec - start_time.tv_sec) * 1000000000L + (end_time.tv_nsec - start_time.tv_nsec);
-        long target_ns = (long)(p.T * 1000000000L);
-        if (elapsed_ns < target_ns) {
-            sleep_req.tv_sec = (target_ns - elapsed_ns) / 1000000000L;
-            sleep_req.tv_nsec = (target_ns - elapsed_ns) % 1000000000L;
-            // Use while to resume sleep if interrupted by EINTR
-            while (nanosleep(&sleep_req, &sleep_req) == -1 && errno == EINTR);
+        // Wait for the next deadline; a late tick is counted, not replayed
+        int missed = pt_wait(&pt);
+        if (missed < 0) {
+            long ns = (long)(p.T * 1e9);
+            struct timespec period = { ns / 1000000000L, ns % 1000000000L };
+            while (nanosleep(&period, &period) == -1 && errno == EINTR);
+        } else if (missed > 0) {
+            LOG_DEBUG("Physics loop missed %d deadlines", missed);
+        }
+        if (pt_stats_due(&pt)) {
+            for (int l = 0; l < PT_LINES; l++) {
+                char stats[160];
+                pt_format(&pt, l, stats, sizeof(stats));
+                LOG_INFO("Loop %s", stats);
+            }
+            pt_reset_stats(&pt);
         }
     }
 
-    close(fd_in);
-    close(fd_out);
+    pt_close(&pt);
+    ds_free(&sim);
+    ff_free(&ff);
+    cw_close(&cw);
+    bb_snapshot_free(&snap);
+    bb_shm_close(shm);
+    channel_close(&ch_in);
+    channel_close(&ch_out);
     LOG("Drone terminated");
     return 0;
 }
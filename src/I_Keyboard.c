@@ -12,6 +12,7 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "KEYBOARD"
 #include "../include/common.h"
+#include "../include/channel.h"
 
 #define ROWS 3
 #define COLS 3
@@ -64,7 +65,8 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    int fd_out = atoi(argv[2]);
+    struct channel ch_out;
+    channel_open(&ch_out, argv[2], 1);
     // Watchdog PID to send alive signals
     pid_t watchdog_pid = atoi(argv[3]);
 
@@ -106,9 +108,7 @@ int main(int argc, char *argv[]) {
         ch = getch(); // Get user input
 
         if (ch != ERR) {
-            char debug_buf[64];
-            snprintf(debug_buf, 64, "DEBUG: Key detected: %d", ch);
-            LOG(debug_buf);
+            LOG_DEBUG("Key detected: %d", ch);
 
             if (ch == KEY_RESIZE) {
                 getmaxyx(stdscr, height, width);
@@ -123,16 +123,12 @@ int main(int argc, char *argv[]) {
                 continue;
             }
 
-            m.src = IDX_I;
-            snprintf(m.data, MSG_SIZE, "%c", ch);
-            {
-                char log_msg[64];
-                snprintf(log_msg, sizeof(log_msg), "KEYBOARD: Sent key '%c' to router", ch);
-                LOG(log_msg);
-            }
+            msg_init(&m, IDX_I, MSG_KEY, sizeof(struct pl_key));
+            MSG_PL(&m, struct pl_key)->key = ch;
+            LOG_DEBUG("KEYBOARD: Sent key '%c' to router", ch);
 
             // Write message to parent/router
-            if (write(fd_out, &m, sizeof(m)) < 0) {
+            if (channel_send(&ch_out, &m) < 0) {
                 perror("write");
             }
 
@@ -160,7 +156,7 @@ int main(int argc, char *argv[]) {
     }
 
     endwin();
-    close(fd_out);
+    channel_close(&ch_out);
     LOG("Keyboard terminated");
     return 0;
 }
\ No newline at end of file
@@ -12,7 +12,59 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "TARGETS"
 #include "../include/common.h"
-
+#include "../include/channel.h"
+#include "../include/lg_gen.h"
+
+
+// Generator state touched by the message handlers
+struct tgt_state {
+    struct lg_gen gen;      // Layouts and single targets
+    int window_changed;
+    int running;
+    struct channel *out;
+};
+
+static void on_resize(const struct msg *m, void *ctx) {
+    struct tgt_state *st = ctx;
+    const struct pl_size *sz = MSG_PL(m, const struct pl_size);
+    if (sz->w != st->gen.w || sz->h != st->gen.h) {
+        st->gen.w = sz->w;
+        st->gen.h = sz->h;
+        st->window_changed = 1;                        
+    }
+}
+
+/**
+ * Send the layout of the current area.
+ */
+static void send_layout(struct channel *out, struct tgt_state *st) {
+    int n = lg_gen_send_layout(&st->gen, out);
+    if (n < 0)
+        LOG_ERROR("No memory for a layout of %dx%d", st->gen.w, st->gen.h);
+    else
+        LOG_INFO("Window change detected, sent %d targets for %dx%d (layout %llu)", n, st->gen.w, st->gen.h,
+                 (unsigned long long)(st->gen.layout_no - 1));
+}
+
+static void on_reached(const struct msg *m, void *ctx) {
+    (void)m;
+    struct tgt_state *st = ctx;
+    lg_gen_send_point(&st->gen, st->out);
+}
+
+static void on_esc(const struct msg *m, void *ctx) {
+    (void)m;
+    struct tgt_state *st = ctx;
+    printf("[TARGETS] EXIT\n");
+    LOG("Received ESC, exiting");
+    st->running = 0;
+}
+
+static const msg_handler handlers[MSG_TYPE_COUNT] = {
+    [MSG_RESIZE]      = on_resize,
+    [MSG_TGT_REACHED] = on_reached,
+    [MSG_ESC]         = on_esc,
+};
 
 int main(int argc, char *argv[]) {
 
@@ -25,80 +77,41 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    int fd_in = atoi(argv[1]);
-    int fd_out = atoi(argv[2]);
+    struct channel ch_in;
+    channel_open(&ch_in, argv[1], 0);
+    struct channel ch_out;
+    channel_open(&ch_out, argv[2], 1);
+
+    // Tell the router which message types this process consumes
+    struct msg sub;
+    msg_subscribe(&sub, IDX_T, msg_table_mask(handlers));
+    channel_send(&ch_out, &sub);
     // Watchdog PID to send alive signals
     pid_t watchdog_pid = atoi(argv[3]);
 
-    fcntl(fd_in, F_SETFL, O_NONBLOCK);
-
-    int W = 155, H = 30;
-
-    srand(time(NULL)^ getpid());
+    channel_set_nonblock(&ch_in);
 
-    struct msg bb_msg;
-    bb_msg.src = IDX_T;
+    struct tgt_state st = { .window_changed = 1, .running = 1, .out = &ch_out };
 
-    int window_changed = 1;
-    int reset_sent = 0;
-    int goal = 0;
+    // Layout seed from the router (the same for Obstacles and Targets)
+    uint64_t seed = (argc >= 5) ? strtoull(argv[4], NULL, 10) : (uint64_t)(time(NULL) ^ getpid());
+    // Live Blackboard state, to keep new targets away from everything
+    struct bb_shm *shm = bb_shm_open(argc >= 6 ? argv[5] : NULL, 0);
+    lg_gen_init(&st.gen, ENT_TARGET, seed, shm);
 
     while(1){
         struct msg m;
-        ssize_t n = read(fd_in, &m, sizeof(m));
-        
+        ssize_t n = channel_recv(&ch_in, &m);
 
         if (n > 0) {
-            if (m.src == IDX_B){
-                if (strncmp(m.data, "RESIZE", 6)==0){
-                    int newW, newH;
-                    sscanf(m.data, "RESIZE %d %d", &newW, &newH);
-                    //printf("[BB->T] RESIZE received %d, %d\n", W, H);
-                    if (newW != W || newH != H){
-                        W = newW;
-                        H = newH;
-                        window_changed = 1;                        
-                    }
-                }
-                if (strncmp(m.data, "STOP_T", 6) == 0){
-                    window_changed = 0;
-                    //printf("[T] STOP\n");
-                }
-                if (strncmp(m.data, "TARGET_REACHED", 14)==0) {
-                    int x = (rand() % (W-2)) + 1;
-                    int y = (rand() % (H-2)) + 1;
-
-                    snprintf(bb_msg.data, MSG_SIZE, "NEW: %d,%d", x, y);
-                    write(fd_out, &bb_msg, sizeof(bb_msg));
-                }
-            }
-            if (strncmp(m.data, "ESC", 3)== 0){
-                printf("[TARGETS] EXIT\n");
-                LOG("Received ESC, exiting");
-                break;
-            }
+            msg_dispatch(handlers, &m, &st);
+            if (!st.running) break;
         }
 
-        bb_msg.data[0] = '\0';
-
-        if(window_changed){
-            if (!reset_sent){
-                snprintf(bb_msg.data, MSG_SIZE, "RESET"); 
-                write(fd_out, &bb_msg, sizeof(bb_msg)); 
-                reset_sent = 1;
-                //printf("[T] RESET SENT\n");
-                LOG("Window change detected, regenerating targets...");
-            }
-
-            int x = (rand() % (W-2)) + 1;
-            int y = (rand() % (H-2)) + 1;
-
-            snprintf(bb_msg.data, MSG_SIZE, "%d,%d", x, y);
-            write(fd_out, &bb_msg, sizeof(bb_msg));
-
-            //printf("[T] target position %d, %d\n", x, y);
-        } else {
-            reset_sent = 0;
+        // New area: the whole layout goes out in this iteration
+        if(st.window_changed){
+            send_layout(&ch_out, &st);
+            st.window_changed = 0;
         }
 
         // Send alive signal to watchdog
@@ -110,8 +123,10 @@ int main(int argc, char *argv[]) {
 
         usleep(50000);
     }
-    close(fd_in);
-    close(fd_out);
+    channel_close(&ch_in);
+    channel_close(&ch_out);
+    lg_gen_free(&st.gen);
+    bb_shm_close(shm);
     LOG("Targets terminated");
     return 0;
 }
\ No newline at end of file
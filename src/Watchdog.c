@@ -12,6 +12,7 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "WATCHDOG"
 #include "../include/common.h"
+#include "../include/channel.h"
 
 
 typedef struct {
@@ -190,9 +191,10 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // fd_in: read from parent/router
-    int fd_in = atoi(argv[1]);
-    fcntl(fd_in, F_SETFL, O_NONBLOCK);
+    // ch_in: read from parent/router
+    struct channel ch_in;
+    channel_open(&ch_in, argv[1], 0);
+    channel_set_nonblock(&ch_in);
 
     while (1) {
         time_t now = time(NULL);
@@ -202,9 +204,7 @@ int main(int argc, char *argv[]) {
             if(now - process_table[i].last_signal > TIMEOUT){
                 if (process_table[i].alive){
                     // Log the timeout
-                    char log_msg[82];
-                    snprintf(log_msg, sizeof(log_msg), "Alert: Process %s (PID %d) not responding!", process_table[i].name, process_table[i].pid);
-                    LOG(log_msg);
+                    LOG_WARN("Alert: Process %s (PID %d) not responding!", process_table[i].name, process_table[i].pid);
                     process_table[i].alive = 0;
                 }
             } else {
@@ -224,9 +224,9 @@ int main(int argc, char *argv[]) {
 
         //terminate the execution if the user pressed ESC
         struct msg m;
-        ssize_t n = read(fd_in, &m, sizeof(m));
+        ssize_t n = channel_recv(&ch_in, &m);
         if(n > 0){
-            if (strncmp(m.data, "ESC", 3)== 0){
+            if (m.hdr.type == MSG_ESC){
                 printf("[WATCHDOG] EXIT\n");
                 LOG("Watchdog received ESC, exiting");
                 break;
@@ -235,7 +235,7 @@ int main(int argc, char *argv[]) {
 
         usleep(50000); // 50ms
     }
-    close(fd_in);
+    channel_close(&ch_in);
     LOG("Watchdog terminated");
     return 0;
 }
@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/bb_shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Columns of the state, cap entries each: obstacles, then targets
+enum { COL_OBS_ID = 0, COL_OBS_X, COL_OBS_Y, COL_TGS_ID, COL_TGS_X, COL_TGS_Y, COL_TGS_TAG, BB_COLUMNS };
+
+struct bb_seg {
+    uint32_t seq;                   // Odd while the writer is inside
+    uint32_t cap;                   // Entries per column, only changed inside a write
+    int32_t W, H;
+    int32_t drone_x, drone_y;
+    int32_t num_obs, num_tgs;
+    int32_t col[];                  // BB_COLUMNS columns of cap entries
+};
+
+static size_t seg_size(int cap)
+{
+    return sizeof(struct bb_seg) + (size_t)BB_COLUMNS * cap * sizeof(int32_t);
+}
+
+// Column c of a local snapshot and the entries in use
+static int32_t *snap_col(const struct bb_snapshot *s, int c, int *n)
+{
+    *n = c <= COL_OBS_Y ? s->num_obs : s->num_tgs;
+    switch (c) {
+    case COL_OBS_ID: return (int32_t *)s->obs_id;
+    case COL_OBS_X: return s->obs_x;
+    case COL_OBS_Y: return s->obs_y;
+    case COL_TGS_ID: return (int32_t *)s->tgs_id;
+    case COL_TGS_X: return s->tgs_x;
+    case COL_TGS_Y: return s->tgs_y;
+    default:        return s->tgs_tag;
+    }
+}
+
+/*
+ * Map the whole object as it is now. The writer enlarges it before it
+ * publishes a larger cap, so the mapping always covers the published cap.
+ */
+static int seg_map(struct bb_shm *shm)
+{
+    struct stat sb;
+    if (fstat(shm->fd, &sb) == -1 || (size_t)sb.st_size < seg_size(0))
+        return -1;
+    void *p = mmap(NULL, sb.st_size, shm->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, shm->fd, 0);
+    if (p == MAP_FAILED)
+        return -1;
+    if (shm->seg)
+        munmap(shm->seg, shm->len);
+    shm->seg = p;
+    shm->len = sb.st_size;
+    shm->cap = (int)((sb.st_size - seg_size(0)) / (BB_COLUMNS * sizeof(int32_t)));
+    return 0;
+}
+
+int bb_shm_create(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/arp_bb_%d", getpid());
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1)
+        return -1;
+    // The object lives as long as someone holds the descriptor or the mapping
+    shm_unlink(name);
+
+    struct bb_seg *g;
+    if (ftruncate(fd, seg_size(BB_SHM_INIT_CAP)) == -1 ||
+        (g = mmap(NULL, seg_size(0), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    g->cap = BB_SHM_INIT_CAP;
+    munmap(g, seg_size(0));
+
+    // Must survive exec() in the children
+    fcntl(fd, F_SETFD, 0);
+    return fd;
+}
+
+struct bb_shm *bb_shm_open(const char *spec, int writable)
+{
+    if (!spec || strcmp(spec, "-") == 0)
+        return NULL;
+    struct bb_shm *shm = calloc(1, sizeof(*shm));
+    if (!shm)
+        return NULL;
+    // The descriptor stays open: the object may grow and be mapped again
+    shm->fd = atoi(spec);
+    shm->writable = writable;
+    if (seg_map(shm) < 0) {
+        close(shm->fd);
+        free(shm);
+        return NULL;
+    }
+    return shm;
+}
+
+int bb_snapshot_reserve(struct bb_snapshot *s, int n)
+{
+    if (n <= s->cap)
+        return 0;
+    int cap = s->cap ? 2 * s->cap : 64;
+    if (cap < n)
+        cap = n;
+    // The columns move: their contents are not kept
+    int32_t *block = realloc(s->block, (size_t)BB_COLUMNS * cap * sizeof(int32_t));
+    if (!block)
+        return -1;
+    s->block = block;
+    s->cap = cap;
+    s->obs_id = (uint32_t *)(block + (size_t)COL_OBS_ID * cap);
+    s->obs_x = block + (size_t)COL_OBS_X * cap;
+    s->obs_y = block + (size_t)COL_OBS_Y * cap;
+    s->tgs_id = (uint32_t *)(block + (size_t)COL_TGS_ID * cap);
+    s->tgs_x = block + (size_t)COL_TGS_X * cap;
+    s->tgs_y = block + (size_t)COL_TGS_Y * cap;
+    s->tgs_tag = block + (size_t)COL_TGS_TAG * cap;
+    return 0;
+}
+
+void bb_snapshot_free(struct bb_snapshot *s)
+{
+    free(s->block);
+    memset(s, 0, sizeof(*s));
+}
+
+// Only this process writes: comparing with the segment is race-free
+static int seg_equal(const struct bb_seg *g, const struct bb_snapshot *s)
+{
+    if (g->W != s->W || g->H != s->H || g->drone_x != s->drone_x || g->drone_y != s->drone_y ||
+        g->num_obs != s->num_obs || g->num_tgs != s->num_tgs)
+        return 0;
+    for (int c = 0; c < BB_COLUMNS; c++) {
+        int n;
+        const int32_t *v = snap_col(s, c, &n);
+        if (n > 0 && memcmp(g->col + (size_t)c * g->cap, v, n * sizeof(int32_t)) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+int bb_shm_publish(struct bb_shm *shm, const struct bb_snapshot *s)
+{
+    int need = s->num_obs > s->num_tgs ? s->num_obs : s->num_tgs;
+    int cap = (int)shm->seg->cap;
+    if (need > cap) {
+        cap = 2 * cap > need ? 2 * cap : need;
+        // Enlarge the object first: readers map it again when they see the cap
+        if (cap > shm->cap && (ftruncate(shm->fd, seg_size(cap)) == -1 || seg_map(shm) < 0))
+            return -1;
+    } else if (seg_equal(shm->seg, s)) {
+        return 0;
+    }
+
+    struct bb_seg *g = shm->seg;
+    uint32_t seq = g->seq;
+    __atomic_store_n(&g->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&g->cap, (uint32_t)cap, __ATOMIC_RELAXED);
+    g->W = s->W;
+    g->H = s->H;
+    g->drone_x = s->drone_x;
+    g->drone_y = s->drone_y;
+    g->num_obs = s->num_obs;
+    g->num_tgs = s->num_tgs;
+    for (int c = 0; c < BB_COLUMNS; c++) {
+        int n;
+        const int32_t *v = snap_col(s, c, &n);
+        if (n > 0)
+            memcpy(g->col + (size_t)c * cap, v, n * sizeof(int32_t));
+    }
+    __atomic_store_n(&g->seq, seq + 2, __ATOMIC_RELEASE);
+    return 0;
+}
+
+uint32_t bb_shm_read(struct bb_shm *shm, struct bb_snapshot *out)
+{
+    while (1) {
+        const struct bb_seg *g = shm->seg;
+        uint32_t before = __atomic_load_n(&g->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+
+        int cap = (int)__atomic_load_n(&g->cap, __ATOMIC_RELAXED);
+        if (cap > shm->cap) {
+            // The writer grew the object: follow it
+            if (seg_map(shm) < 0 || cap > shm->cap) {
+                perror("bb_shm: mapping the grown segment");
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+        int num_obs = g->num_obs, num_tgs = g->num_tgs;
+        if (num_obs < 0 || num_tgs < 0 || num_obs > cap || num_tgs > cap)
+            continue;   // Torn by a write in progress
+        if (bb_snapshot_reserve(out, num_obs > num_tgs ? num_obs : num_tgs) < 0) {
+            perror("bb_shm: snapshot");
+            exit(EXIT_FAILURE);
+        }
+
+        out->W = g->W;
+        out->H = g->H;
+        out->drone_x = g->drone_x;
+        out->drone_y = g->drone_y;
+        out->num_obs = num_obs;
+        out->num_tgs = num_tgs;
+        for (int c = 0; c < BB_COLUMNS; c++) {
+            int n;
+            int32_t *v = snap_col(out, c, &n);
+            if (n > 0)
+                memcpy(v, g->col + (size_t)c * cap, n * sizeof(int32_t));
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&g->seq, __ATOMIC_RELAXED) == before)
+            return before;
+    }
+}
+
+uint32_t bb_shm_seq(const struct bb_shm *shm)
+{
+    return __atomic_load_n(&shm->seg->seq, __ATOMIC_ACQUIRE);
+}
+
+void bb_shm_close(struct bb_shm *shm)
+{
+    if (!shm)
+        return;
+    munmap(shm->seg, shm->len);
+    close(shm->fd);
+    free(shm);
+}
@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+
+#include "../include/channel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+/*
+ * Shared-memory SPSC ring.
+ * head is only written by the consumer, tail only by the producer; they live
+ * on separate cache lines so the two processes never bounce the same line.
+ * The producer signals the eventfd only when it pushes into an empty ring,
+ * so a consumer that keeps up never costs a syscall on the send side.
+ */
+struct shm_ring {
+    uint32_t slots;
+    uint32_t tx_closed;     // producer closed its end (EOF for the consumer)
+    uint32_t rx_closed;     // consumer closed its end (EPIPE for the producer)
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+    struct msg msg[SHM_RING_SLOTS] __attribute__((aligned(64)));
+};
+
+#define RING_MASK (SHM_RING_SLOTS - 1)
+
+static int ring_push(struct shm_ring *r, const struct msg *m, int *was_empty)
+{
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+    if (tail - head >= SHM_RING_SLOTS)
+        return 0;
+
+    r->msg[tail & RING_MASK] = *m;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+    // Consumer had drained everything before this push: it may be waiting
+    *was_empty = (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail);
+    return 1;
+}
+
+static int ring_pop(struct shm_ring *r, struct msg *m)
+{
+    uint64_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    uint64_t tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+    if (head == tail)
+        return 0;
+
+    *m = r->msg[head & RING_MASK];
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+static void ring_wake(int efd)
+{
+    uint64_t one = 1;
+    if (write(efd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("eventfd write");
+}
+
+static struct shm_ring *ring_map(int shm_fd)
+{
+    void *p = mmap(NULL, sizeof(struct shm_ring), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    return (p == MAP_FAILED) ? NULL : (struct shm_ring *)p;
+}
+
+int link_create(struct link *l, int transport)
+{
+    static int counter = 0;
+
+    l->transport = transport;
+    l->fds[0] = l->fds[1] = -1;
+
+    // Nothing crosses exec() unless the child asks for it (link_inherit)
+    if (transport == TRANSPORT_PIPE)
+        return pipe2(l->fds, O_CLOEXEC);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/arp_ring_%d_%d", getpid(), counter++);
+    int shm_fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm_fd == -1)
+        return -1;
+    // The object lives as long as someone holds the descriptor or the mapping
+    shm_unlink(name);
+
+    if (ftruncate(shm_fd, sizeof(struct shm_ring)) == -1) {
+        close(shm_fd);
+        return -1;
+    }
+
+    struct shm_ring *r = ring_map(shm_fd);
+    if (!r) {
+        close(shm_fd);
+        return -1;
+    }
+    r->slots = SHM_RING_SLOTS;
+    munmap(r, sizeof(*r));
+
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd == -1) {
+        close(shm_fd);
+        return -1;
+    }
+
+    l->fds[0] = shm_fd;
+    l->fds[1] = efd;
+    return 0;
+}
+
+void link_spec(const struct link *l, int end, char *buf, size_t len)
+{
+    if (l->transport == TRANSPORT_PIPE)
+        snprintf(buf, len, "%d", l->fds[end]);
+    else
+        snprintf(buf, len, "shm:%d,%d", l->fds[0], l->fds[1]);
+}
+
+static int channel_attach(struct channel *c, int transport, int fd, int shm_fd, int tx)
+{
+    memset(c, 0, sizeof(*c));
+    c->tx = tx;
+    c->fd = fd;
+    c->shm_fd = -1;
+    c->ring = NULL;
+
+    if (transport == TRANSPORT_SHM) {
+        c->shm_fd = shm_fd;
+        c->ring = ring_map(shm_fd);
+        if (!c->ring) {
+            c->fd = -1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int link_open(const struct link *l, int end, struct channel *c)
+{
+    if (l->transport == TRANSPORT_PIPE)
+        return channel_attach(c, TRANSPORT_PIPE, l->fds[end], -1, end == 1);
+    return channel_attach(c, TRANSPORT_SHM, l->fds[1], l->fds[0], end == 1);
+}
+
+void link_close_end(struct link *l, int end)
+{
+    if (l->transport != TRANSPORT_PIPE)
+        return;
+    if (l->fds[end] != -1) {
+        close(l->fds[end]);
+        l->fds[end] = -1;
+    }
+}
+
+void link_inherit(struct link *l, int end)
+{
+    if (l->transport == TRANSPORT_PIPE) {
+        link_close_end(l, 1 - end);
+        if (l->fds[end] != -1)
+            fcntl(l->fds[end], F_SETFD, 0);
+        return;
+    }
+    // Both ends of a ring use the shared object and the eventfd
+    for (int i = 0; i < 2; i++)
+        if (l->fds[i] != -1)
+            fcntl(l->fds[i], F_SETFD, 0);
+}
+
+void link_close(struct link *l)
+{
+    for (int i = 0; i < 2; i++) {
+        if (l->fds[i] != -1) {
+            close(l->fds[i]);
+            l->fds[i] = -1;
+        }
+    }
+}
+
+int channel_open(struct channel *c, const char *spec, int tx)
+{
+    int shm_fd, efd;
+    if (sscanf(spec, "shm:%d,%d", &shm_fd, &efd) == 2)
+        return channel_attach(c, TRANSPORT_SHM, efd, shm_fd, tx);
+    return channel_attach(c, TRANSPORT_PIPE, atoi(spec), -1, tx);
+}
+
+void channel_set_nonblock(struct channel *c)
+{
+    c->nonblock = 1;
+    if (!c->ring && c->fd != -1) {
+        int flags = fcntl(c->fd, F_GETFL, 0);
+        fcntl(c->fd, F_SETFL, flags | O_NONBLOCK);
+    }
+}
+
+int channel_set_capacity(struct channel *c, int bytes)
+{
+    // Rings have a fixed number of slots
+    if (c->ring || c->fd == -1)
+        return 0;
+    return fcntl(c->fd, F_SETPIPE_SZ, bytes) < 0 ? -1 : 0;
+}
+
+ssize_t channel_send(struct channel *c, const struct msg *m)
+{
+    if (c->fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+    if (!c->ring)
+        return write(c->fd, m, sizeof(*m));
+
+    struct shm_ring *r = c->ring;
+    if (__atomic_load_n(&r->rx_closed, __ATOMIC_ACQUIRE)) {
+        errno = EPIPE;
+        return -1;
+    }
+    int was_empty;
+    while (!ring_push(r, m, &was_empty)) {
+        if (__atomic_load_n(&r->rx_closed, __ATOMIC_ACQUIRE)) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (c->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+        // Ring full: the consumer is behind, give it time to drain
+        usleep(100);
+    }
+    if (was_empty)
+        ring_wake(c->fd);
+    return sizeof(*m);
+}
+
+ssize_t channel_recv(struct channel *c, struct msg *m)
+{
+    if (c->fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+    if (!c->ring)
+        return read(c->fd, m, sizeof(*m));
+
+    struct shm_ring *r = c->ring;
+    while (1) {
+        if (ring_pop(r, m))
+            return sizeof(*m);
+
+        // Empty: consume the pending wakeup first, then look again, so a
+        // push racing with us is either seen now or signalled afterwards
+        uint64_t v;
+        if (read(c->fd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+            return -1;
+        if (ring_pop(r, m))
+            return sizeof(*m);
+
+        if (__atomic_load_n(&r->tx_closed, __ATOMIC_ACQUIRE))
+            return ring_pop(r, m) ? (ssize_t)sizeof(*m) : 0;
+        if (c->nonblock) {
+            errno = EAGAIN;
+            return -1;
+        }
+
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+            return -1;
+    }
+}
+
+int channel_recv_batch(struct channel *c, struct msg *ms, int max)
+{
+    if (c->fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+    if (max > CHANNEL_BATCH)
+        max = CHANNEL_BATCH;
+
+    if (!c->ring) {
+        struct iovec iov[CHANNEL_BATCH];
+        for (int i = 0; i < max; i++) {
+            iov[i].iov_base = &ms[i];
+            iov[i].iov_len = sizeof(struct msg);
+        }
+        ssize_t n = readv(c->fd, iov, max);
+        if (n <= 0)
+            return (int)n;
+
+        // Writers only push whole records, but never hand out a torn one
+        size_t rem = n % sizeof(struct msg);
+        if (rem) {
+            char *p = (char *)ms + n;
+            size_t left = sizeof(struct msg) - rem;
+            while (left > 0) {
+                ssize_t r = read(c->fd, p, left);
+                if (r <= 0 && !(r < 0 && (errno == EAGAIN || errno == EINTR)))
+                    return (int)(n / sizeof(struct msg));
+                if (r > 0) {
+                    p += r;
+                    left -= r;
+                    n += r;
+                }
+            }
+        }
+        return (int)(n / sizeof(struct msg));
+    }
+
+    struct shm_ring *r = c->ring;
+    int k = 0;
+    while (k < max && ring_pop(r, &ms[k]))
+        k++;
+    if (k > 0)
+        return k;
+
+    ssize_t n = channel_recv(c, &ms[0]);
+    if (n <= 0)
+        return (int)n;
+    k = 1;
+    while (k < max && ring_pop(r, &ms[k]))
+        k++;
+    return k;
+}
+
+int channel_send_batch(struct channel *c, const struct msg *ms, int n)
+{
+    if (c->fd == -1) {
+        errno = EBADF;
+        return -1;
+    }
+
+    if (!c->ring) {
+        struct iovec iov[CHANNEL_BATCH];
+        int sent = 0;
+        while (sent < n) {
+            int k = n - sent;
+            if (k > CHANNEL_BATCH)
+                k = CHANNEL_BATCH;
+            for (int i = 0; i < k; i++) {
+                iov[i].iov_base = (void *)&ms[sent + i];
+                iov[i].iov_len = sizeof(struct msg);
+            }
+            ssize_t w = writev(c->fd, iov, k);
+            if (w < 0) {
+                if (errno == EINTR)
+                    continue;
+                // Non-blocking: report what the pipe took so far
+                if (errno == EAGAIN && sent > 0)
+                    return sent;
+                return -1;
+            }
+            // A pipe write of <= PIPE_BUF bytes is all or nothing
+            sent += (int)(w / sizeof(struct msg));
+        }
+        return n;
+    }
+
+    struct shm_ring *r = c->ring;
+    if (__atomic_load_n(&r->rx_closed, __ATOMIC_ACQUIRE)) {
+        errno = EPIPE;
+        return -1;
+    }
+    int wake = 0;
+    for (int i = 0; i < n; i++) {
+        int was_empty;
+        while (!ring_push(r, &ms[i], &was_empty)) {
+            if (wake) {
+                // Let the consumer start on what is already there
+                ring_wake(c->fd);
+                wake = 0;
+            }
+            if (__atomic_load_n(&r->rx_closed, __ATOMIC_ACQUIRE)) {
+                errno = EPIPE;
+                return -1;
+            }
+            if (c->nonblock) {
+                errno = EAGAIN;
+                return i > 0 ? i : -1;
+            }
+            usleep(100);
+        }
+        wake |= was_empty;
+    }
+    if (wake)
+        ring_wake(c->fd);
+    return n;
+}
+
+void channel_peer_gone(struct channel *c)
+{
+    // A pipe reports it by itself once the last descriptor of the peer is gone
+    if (!c->ring)
+        return;
+    if (c->tx) {
+        __atomic_store_n(&c->ring->rx_closed, 1, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&c->ring->tx_closed, 1, __ATOMIC_RELEASE);
+        // Make the consumer look again and find the EOF
+        ring_wake(c->fd);
+    }
+}
+
+void channel_close(struct channel *c)
+{
+    if (c->ring) {
+        if (c->tx) {
+            __atomic_store_n(&c->ring->tx_closed, 1, __ATOMIC_RELEASE);
+            ring_wake(c->fd);
+        } else {
+            __atomic_store_n(&c->ring->rx_closed, 1, __ATOMIC_RELEASE);
+        }
+        munmap(c->ring, sizeof(*c->ring));
+        c->ring = NULL;
+        close(c->shm_fd);
+        c->shm_fd = -1;
+    }
+    if (c->fd != -1)
+        close(c->fd);
+    c->fd = -1;
+}
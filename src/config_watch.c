@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../include/config_watch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+// Current size and mtime of the file (all zero if it does not exist)
+static void file_state(const struct config_watch *cw, time_t *mtime, long *mtime_ns, off_t *size)
+{
+    char path[sizeof(cw->dir) + sizeof(cw->name) + 1];
+    snprintf(path, sizeof(path), "%s/%s", cw->dir, cw->name);
+    struct stat sb;
+    if (stat(path, &sb) == -1) {
+        *mtime = 0;
+        *mtime_ns = 0;
+        *size = 0;
+        return;
+    }
+    *mtime = sb.st_mtim.tv_sec;
+    *mtime_ns = sb.st_mtim.tv_nsec;
+    *size = sb.st_size;
+}
+
+int cw_open(struct config_watch *cw, const char *path)
+{
+    memset(cw, 0, sizeof(*cw));
+    cw->ifd = cw->tfd = -1;
+
+    const char *slash = strrchr(path, '/');
+    if (slash) {
+        snprintf(cw->dir, sizeof(cw->dir), "%.*s", (int)(slash - path), path);
+        snprintf(cw->name, sizeof(cw->name), "%s", slash + 1);
+    } else {
+        snprintf(cw->dir, sizeof(cw->dir), ".");
+        snprintf(cw->name, sizeof(cw->name), "%s", path);
+    }
+
+    cw->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (cw->ifd != -1) {
+        if (inotify_add_watch(cw->ifd, cw->dir, IN_CLOSE_WRITE | IN_MOVED_TO) != -1)
+            return 0;
+        close(cw->ifd);
+        cw->ifd = -1;
+    }
+
+    // Fallback: poll the file state from a timer
+    cw->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (cw->tfd == -1)
+        return -1;
+    struct itimerspec its = {
+        .it_interval = {CW_POLL_MS / 1000, (CW_POLL_MS % 1000) * 1000000L},
+        .it_value = {CW_POLL_MS / 1000, (CW_POLL_MS % 1000) * 1000000L},
+    };
+    timerfd_settime(cw->tfd, 0, &its, NULL);
+    file_state(cw, &cw->mtime, &cw->mtime_ns, &cw->size);
+    return 0;
+}
+
+int cw_fd(const struct config_watch *cw)
+{
+    return cw->ifd != -1 ? cw->ifd : cw->tfd;
+}
+
+static int poll_inotify(struct config_watch *cw)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    for (;;) {
+        ssize_t n = read(cw->ifd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            break;  // EAGAIN: drained
+        }
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            // Events were lost: assume the file is among them
+            if (ev->mask & IN_Q_OVERFLOW)
+                changed = 1;
+            else if (ev->len > 0 && strcmp(ev->name, cw->name) == 0)
+                changed = 1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return changed;
+}
+
+static int poll_stat(struct config_watch *cw)
+{
+    uint64_t expirations;
+    if (read(cw->tfd, &expirations, sizeof(expirations)) <= 0)
+        return 0;   // Not time yet
+
+    time_t mtime;
+    long mtime_ns;
+    off_t size;
+    file_state(cw, &mtime, &mtime_ns, &size);
+    if (mtime == cw->mtime && mtime_ns == cw->mtime_ns && size == cw->size) {
+        cw->pending = 0;
+        return 0;
+    }
+    // Changed: report it once it stopped changing for a period
+    if (cw->pending && mtime == cw->p_mtime && mtime_ns == cw->p_mtime_ns && size == cw->p_size) {
+        cw->pending = 0;
+        cw->mtime = mtime;
+        cw->mtime_ns = mtime_ns;
+        cw->size = size;
+        return 1;
+    }
+    cw->pending = 1;
+    cw->p_mtime = mtime;
+    cw->p_mtime_ns = mtime_ns;
+    cw->p_size = size;
+    return 0;
+}
+
+int cw_poll(struct config_watch *cw)
+{
+    if (cw->ifd != -1)
+        return poll_inotify(cw);
+    if (cw->tfd != -1)
+        return poll_stat(cw);
+    return 0;
+}
+
+void cw_close(struct config_watch *cw)
+{
+    if (cw->ifd != -1)
+        close(cw->ifd);
+    if (cw->tfd != -1)
+        close(cw->tfd);
+    cw->ifd = cw->tfd = -1;
+}
@@ -0,0 +1,210 @@
+#include "../include/dronesim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DS_COLUMNS 16
+#define DS_ALIGN 32     // Bytes: every column starts on a vector boundary
+
+int ds_init(struct dronesim *ds, int n)
+{
+    memset(ds, 0, sizeof(*ds));
+    if (n < 0)
+        return -1;
+    // Whole vectors per column, so each one stays aligned
+    int per = DS_ALIGN / sizeof(float);
+    int cap = (n + per - 1) / per * per;
+    if (cap == 0)
+        cap = per;
+    ds->block = aligned_alloc(DS_ALIGN, (size_t)cap * DS_COLUMNS * sizeof(float));
+    if (!ds->block)
+        return -1;
+    memset(ds->block, 0, (size_t)cap * DS_COLUMNS * sizeof(float));
+
+    float **cols[DS_COLUMNS] = {
+        &ds->x, &ds->y, &ds->vx, &ds->vy, &ds->ux, &ds->uy,
+        &ds->fx, &ds->fy, &ds->sx, &ds->sy, &ds->svx, &ds->svy,
+        &ds->ax, &ds->ay, &ds->avx, &ds->avy,
+    };
+    for (int c = 0; c < DS_COLUMNS; c++)
+        *cols[c] = ds->block + (size_t)c * cap;
+    ds->n = n;
+    ds->cap = cap;
+    return 0;
+}
+
+void ds_free(struct dronesim *ds)
+{
+    free(ds->block);
+    memset(ds, 0, sizeof(*ds));
+}
+
+void ds_set_area(struct dronesim *ds, int w, int h)
+{
+    ds->w = w;
+    ds->h = h;
+}
+
+/*
+ * Column kernels. The dynamics do not couple the axes once the field is
+ * sampled, so each kernel handles one axis and runs once for x, once for y;
+ * restrict parameters let the compiler vectorize every loop.
+ */
+
+// f += u * USER_FORCE - K v
+static void add_linear(int n, float *restrict f, const float *restrict u, const float *restrict v, float uf, float k)
+{
+    for (int i = 0; i < n; i++)
+        f[i] += u[i] * uf - k * v[i];
+}
+
+// Semi-implicit Euler: velocity first, then position with it
+static void euler_axis(int n, float *restrict x, float *restrict v, const float *restrict f, float inv_m, float dt)
+{
+    for (int i = 0; i < n; i++) {
+        v[i] += f[i] * inv_m * dt;
+        x[i] += v[i] * dt;
+    }
+}
+
+// Verlet, first half: a = F / M, move, predict the end velocity
+static void verlet_drift(int n, float *restrict x, const float *restrict v, const float *restrict f,
+                         float *restrict a, float *restrict sv, float inv_m, float dt)
+{
+    for (int i = 0; i < n; i++) {
+        a[i] = f[i] * inv_m;
+        x[i] += (v[i] + 0.5f * a[i] * dt) * dt;
+        sv[i] = v[i] + a[i] * dt;
+    }
+}
+
+// Verlet, second half: average of the accelerations at both ends
+static void verlet_kick(int n, float *restrict v, const float *restrict a, const float *restrict f, float inv_m, float dt)
+{
+    for (int i = 0; i < n; i++)
+        v[i] += 0.5f * (a[i] + f[i] * inv_m) * dt;
+}
+
+// RK4 stage: add the derivatives (sv, F / M) with weight w, next stage state at c
+static void rk4_stage(int n, const float *restrict x, const float *restrict v, float *restrict sx, float *restrict sv,
+                      float *restrict ax, float *restrict av, const float *restrict f, float inv_m, float w, float c)
+{
+    for (int i = 0; i < n; i++) {
+        float kx = sv[i], kv = f[i] * inv_m;
+        ax[i] += w * kx;
+        av[i] += w * kv;
+        sx[i] = x[i] + c * kx;
+        sv[i] = v[i] + c * kv;
+    }
+}
+
+static void rk4_finish(int n, float *restrict x, float *restrict v, const float *restrict ax, const float *restrict av, float h)
+{
+    for (int i = 0; i < n; i++) {
+        x[i] += h * ax[i];
+        v[i] += h * av[i];
+    }
+}
+
+// Walls: a drone past one stops on it
+static void clamp_axis(int n, float *restrict x, float *restrict v, float max)
+{
+    for (int i = 0; i < n; i++) {
+        float c = x[i] < 1.0f ? 1.0f : x[i];
+        c = c > max ? max : c;
+        v[i] = c != x[i] ? 0.0f : v[i];
+        x[i] = c;
+    }
+}
+
+/*
+ * Total force at the given states into fx/fy: the field lookups first (a
+ * gather, scalar), then the linear terms over whole columns.
+ */
+static void forces(struct dronesim *ds, const struct ds_params *p, struct force_field *ff,
+                   const float *x, const float *y, const float *vx, const float *vy)
+{
+    if (p->exact)
+        for (int i = 0; i < ds->n; i++)
+            ff_sample_exact(ff, x[i], y[i], &ds->fx[i], &ds->fy[i]);
+    else
+        for (int i = 0; i < ds->n; i++)
+            ff_sample(ff, x[i], y[i], &ds->fx[i], &ds->fy[i]);
+    add_linear(ds->n, ds->fx, ds->ux, vx, p->USER_FORCE, p->K);
+    add_linear(ds->n, ds->fy, ds->uy, vy, p->USER_FORCE, p->K);
+}
+
+static void step_euler(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt)
+{
+    float inv_m = 1.0f / p->M;
+    forces(ds, p, ff, ds->x, ds->y, ds->vx, ds->vy);
+    euler_axis(ds->n, ds->x, ds->vx, ds->fx, inv_m, dt);
+    euler_axis(ds->n, ds->y, ds->vy, ds->fy, inv_m, dt);
+}
+
+// Velocity Verlet; the viscous term uses the predicted end velocity
+static void step_verlet(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt)
+{
+    float inv_m = 1.0f / p->M;
+    forces(ds, p, ff, ds->x, ds->y, ds->vx, ds->vy);
+    verlet_drift(ds->n, ds->x, ds->vx, ds->fx, ds->ax, ds->svx, inv_m, dt);
+    verlet_drift(ds->n, ds->y, ds->vy, ds->fy, ds->ay, ds->svy, inv_m, dt);
+    forces(ds, p, ff, ds->x, ds->y, ds->svx, ds->svy);
+    verlet_kick(ds->n, ds->vx, ds->ax, ds->fx, inv_m, dt);
+    verlet_kick(ds->n, ds->vy, ds->ay, ds->fy, inv_m, dt);
+}
+
+// Classic RK4 on (x, y, vx, vy): stage states in s*, weighted sum in a*
+static void step_rk4(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt)
+{
+    static const float weight[4] = { 1.0f, 2.0f, 2.0f, 1.0f };
+    static const float next[4] = { 0.5f, 0.5f, 1.0f, 0.0f };
+    int n = ds->n;
+    float inv_m = 1.0f / p->M;
+
+    memcpy(ds->sx, ds->x, n * sizeof(float));
+    memcpy(ds->sy, ds->y, n * sizeof(float));
+    memcpy(ds->svx, ds->vx, n * sizeof(float));
+    memcpy(ds->svy, ds->vy, n * sizeof(float));
+    memset(ds->ax, 0, n * sizeof(float));
+    memset(ds->ay, 0, n * sizeof(float));
+    memset(ds->avx, 0, n * sizeof(float));
+    memset(ds->avy, 0, n * sizeof(float));
+
+    for (int s = 0; s < 4; s++) {
+        forces(ds, p, ff, ds->sx, ds->sy, ds->svx, ds->svy);
+        rk4_stage(n, ds->x, ds->vx, ds->sx, ds->svx, ds->ax, ds->avx, ds->fx, inv_m, weight[s], next[s] * dt);
+        rk4_stage(n, ds->y, ds->vy, ds->sy, ds->svy, ds->ay, ds->avy, ds->fy, inv_m, weight[s], next[s] * dt);
+    }
+    rk4_finish(n, ds->x, ds->vx, ds->ax, ds->avx, dt / 6.0f);
+    rk4_finish(n, ds->y, ds->vy, ds->ay, ds->avy, dt / 6.0f);
+}
+
+void ds_step(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt)
+{
+    switch (p->integrator) {
+    case DS_VERLET: step_verlet(ds, p, ff, dt); break;
+    case DS_RK4:    step_rk4(ds, p, ff, dt); break;
+    default:        step_euler(ds, p, ff, dt); break;
+    }
+    if (ds->w > 2 && ds->h > 2) {
+        clamp_axis(ds->n, ds->x, ds->vx, (float)(ds->w - 2));
+        clamp_axis(ds->n, ds->y, ds->vy, (float)(ds->h - 2));
+    }
+}
+
+void ds_run(struct dronesim *ds, const struct ds_params *p, struct force_field *ff, float dt, long steps)
+{
+    for (long s = 0; s < steps; s++)
+        ds_step(ds, p, ff, dt);
+}
+
+void ds_force(const struct dronesim *ds, const struct ds_params *p, struct force_field *ff, int i, float *fx, float *fy)
+{
+    if (p->exact)
+        ff_sample_exact(ff, ds->x[i], ds->y[i], fx, fy);
+    else
+        ff_sample(ff, ds->x[i], ds->y[i], fx, fy);
+    *fx += ds->ux[i] * p->USER_FORCE - p->K * ds->vx[i];
+    *fy += ds->uy[i] * p->USER_FORCE - p->K * ds->vy[i];
+}
@@ -0,0 +1,214 @@
+#include "../include/entity_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ES_GEN_MASK (0xffffffffu >> ES_SLOT_BITS)
+
+static int grow(void **p, size_t elem, int n)
+{
+    void *q = realloc(*p, elem * (size_t)n);
+    if (!q)
+        return -1;
+    *p = q;
+    return 0;
+}
+
+// Room for slot index s
+static int reserve_slots(struct entity_store *es, int s)
+{
+    if (s < es->slots)
+        return 0;
+    if (s >= (int)ES_SLOT_MASK)
+        return -1;
+    int n = es->slots ? es->slots : 64;
+    while (n <= s)
+        n *= 2;
+    if (grow((void **)&es->gen, sizeof(*es->gen), n) || grow((void **)&es->dense, sizeof(*es->dense), n) ||
+        grow((void **)&es->prev, sizeof(*es->prev), n) || grow((void **)&es->next, sizeof(*es->next), n))
+        return -1;
+    for (int i = es->slots; i < n; i++) {
+        es->gen[i] = 0;
+        es->dense[i] = -1;
+        es->prev[i] = es->next[i] = ES_NONE;
+    }
+    es->slots = n;
+    return 0;
+}
+
+// Room for one more packed entity
+static int reserve_dense(struct entity_store *es)
+{
+    if (es->count < es->cap)
+        return 0;
+    int n = es->cap ? 2 * es->cap : 64;
+    if (grow((void **)&es->id, sizeof(*es->id), n) || grow((void **)&es->x, sizeof(*es->x), n) ||
+        grow((void **)&es->y, sizeof(*es->y), n) || grow((void **)&es->tag, sizeof(*es->tag), n) ||
+        grow((void **)&es->aux, sizeof(*es->aux), n))
+        return -1;
+    es->cap = n;
+    return 0;
+}
+
+// Make a free slot live with the given id, newest in insertion order
+static void attach(struct entity_store *es, uint32_t id, int32_t x, int32_t y, int32_t tag)
+{
+    int s = id & ES_SLOT_MASK;
+    int d = es->count++;
+    es->gen[s] = id >> ES_SLOT_BITS;
+    es->dense[s] = d;
+    es->id[d] = id;
+    es->x[d] = x;
+    es->y[d] = y;
+    es->tag[d] = tag;
+    es->aux[d] = -1;
+
+    es->prev[s] = es->tail;
+    es->next[s] = ES_NONE;
+    if (es->tail != ES_NONE)
+        es->next[es->tail & ES_SLOT_MASK] = id;
+    else
+        es->head = id;
+    es->tail = id;
+}
+
+void es_init(struct entity_store *es)
+{
+    memset(es, 0, sizeof(*es));
+    es->free_head = -1;
+    es->head = es->tail = ES_NONE;
+}
+
+void es_free(struct entity_store *es)
+{
+    free(es->id);
+    free(es->x);
+    free(es->y);
+    free(es->tag);
+    free(es->aux);
+    free(es->gen);
+    free(es->dense);
+    free(es->prev);
+    free(es->next);
+    es_init(es);
+}
+
+void es_clear(struct entity_store *es)
+{
+    while (es->count > 0)
+        es_remove(es, es->id[es->count - 1]);
+}
+
+int es_find(const struct entity_store *es, uint32_t id)
+{
+    if (id == ES_NONE)
+        return -1;
+    int s = id & ES_SLOT_MASK;
+    if (s >= es->slots || es->dense[s] < 0 || es->gen[s] != id >> ES_SLOT_BITS)
+        return -1;
+    return es->dense[s];
+}
+
+uint32_t es_insert(struct entity_store *es, int32_t x, int32_t y, int32_t tag)
+{
+    if (reserve_dense(es) < 0)
+        return ES_NONE;
+
+    int s = es->free_head;
+    if (s != -1) {
+        es->free_head = (int32_t)es->next[s];
+        if (es->free_head != -1)
+            es->prev[es->free_head] = ES_NONE;
+    } else {
+        s = es->top;
+        if (reserve_slots(es, s) < 0)
+            return ES_NONE;
+        es->top++;
+    }
+    uint32_t id = ((es->gen[s] & ES_GEN_MASK) << ES_SLOT_BITS) | (uint32_t)s;
+    attach(es, id, x, y, tag);
+    return id;
+}
+
+int es_put(struct entity_store *es, uint32_t id, int32_t x, int32_t y, int32_t tag)
+{
+    int d = es_find(es, id);
+    if (d >= 0) {
+        es->x[d] = x;
+        es->y[d] = y;
+        es->tag[d] = tag;
+        return 0;
+    }
+
+    int s = id & ES_SLOT_MASK;
+    if (id == ES_NONE || reserve_slots(es, s) < 0 || reserve_dense(es) < 0)
+        return -1;
+    if (s >= es->top)
+        es->top = s + 1;
+    // An older entity in the same slot was removed at the source
+    if (es->dense[s] >= 0)
+        es_remove(es, es->id[es->dense[s]]);
+    // The slot may sit on the free list: unlink it
+    if (es->free_head == s || es->prev[s] != ES_NONE) {
+        int32_t p = (int32_t)es->prev[s], n = (int32_t)es->next[s];
+        if (p != (int32_t)ES_NONE)
+            es->next[p] = (uint32_t)n;
+        else
+            es->free_head = n;
+        if (n != -1)
+            es->prev[n] = (uint32_t)p;
+    }
+    attach(es, id, x, y, tag);
+    return 0;
+}
+
+int es_update(struct entity_store *es, uint32_t id, int32_t x, int32_t y)
+{
+    int d = es_find(es, id);
+    if (d < 0)
+        return -1;
+    es->x[d] = x;
+    es->y[d] = y;
+    return 0;
+}
+
+int es_remove(struct entity_store *es, uint32_t id)
+{
+    int d = es_find(es, id);
+    if (d < 0)
+        return -1;
+    int s = id & ES_SLOT_MASK;
+
+    // Insertion order
+    uint32_t p = es->prev[s], n = es->next[s];
+    if (p != ES_NONE)
+        es->next[p & ES_SLOT_MASK] = n;
+    else
+        es->head = n;
+    if (n != ES_NONE)
+        es->prev[n & ES_SLOT_MASK] = p;
+    else
+        es->tail = p;
+
+    // Packed columns: the last entity fills the hole
+    int last = --es->count;
+    if (d != last) {
+        es->id[d] = es->id[last];
+        es->x[d] = es->x[last];
+        es->y[d] = es->y[last];
+        es->tag[d] = es->tag[last];
+        es->aux[d] = es->aux[last];
+        es->dense[es->id[d] & ES_SLOT_MASK] = d;
+    }
+
+    // The slot is free, its next id gets a new generation. The free list is
+    // doubly linked (slot numbers in prev/next) so es_put() can take any slot
+    es->dense[s] = -1;
+    es->gen[s] = (es->gen[s] + 1) & ES_GEN_MASK;
+    es->prev[s] = ES_NONE;
+    es->next[s] = (uint32_t)es->free_head;
+    if (es->free_head != -1)
+        es->prev[es->free_head] = (uint32_t)s;
+    es->free_head = s;
+    return 0;
+}
@@ -0,0 +1,187 @@
+#include "../include/force_field.h"
+#include "../include/repulsion.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void ff_init(struct force_field *ff)
+{
+    memset(ff, 0, sizeof(*ff));
+}
+
+void ff_free(struct force_field *ff)
+{
+    free(ff->fx);
+    free(ff->fy);
+    free(ff->obs_x);
+    free(ff->obs_y);
+    free(ff->obs_xf);
+    free(ff->obs_yf);
+    ff_init(ff);
+}
+
+void ff_set_area(struct force_field *ff, int w, int h)
+{
+    if (w == ff->w && h == ff->h)
+        return;
+    ff->w = w;
+    ff->h = h;
+    ff->dirty = 1;
+}
+
+void ff_set_params(struct force_field *ff, float rho, float ni)
+{
+    if (rho == ff->rho && ni == ff->ni)
+        return;
+    ff->rho = rho;
+    ff->ni = ni;
+    ff->dirty = 1;
+}
+
+void ff_set_obstacles(struct force_field *ff, const int *xs, const int *ys, int n)
+{
+    if (n == ff->num_obs && (n == 0 || (memcmp(xs, ff->obs_x, n * sizeof(int)) == 0 &&
+                                        memcmp(ys, ff->obs_y, n * sizeof(int)) == 0)))
+        return;
+    if (n > ff->cap_obs) {
+        int *ox = realloc(ff->obs_x, n * sizeof(int));
+        if (ox)
+            ff->obs_x = ox;
+        int *oy = realloc(ff->obs_y, n * sizeof(int));
+        if (oy)
+            ff->obs_y = oy;
+        float *oxf = realloc(ff->obs_xf, n * sizeof(float));
+        if (oxf)
+            ff->obs_xf = oxf;
+        float *oyf = realloc(ff->obs_yf, n * sizeof(float));
+        if (oyf)
+            ff->obs_yf = oyf;
+        if (!ox || !oy || !oxf || !oyf)
+            return;     // Keep the old set
+        ff->cap_obs = n;
+    }
+    if (n > 0) {
+        memcpy(ff->obs_x, xs, n * sizeof(int));
+        memcpy(ff->obs_y, ys, n * sizeof(int));
+    }
+    for (int i = 0; i < n; i++) {
+        ff->obs_xf[i] = (float)xs[i];
+        ff->obs_yf[i] = (float)ys[i];
+    }
+    ff->num_obs = n;
+    ff->dirty = 1;
+}
+
+// Magnitude of the repulsion at distance d (0 past the range)
+static float push(const struct force_field *ff, float d)
+{
+    // A node on the source itself would be infinite: one node away instead
+    if (d < 1.0f / FF_RES)
+        d = 1.0f / FF_RES;
+    return d < ff->rho ? ff->ni * (1.0f / d - 1.0f / ff->rho) : 0.0f;
+}
+
+// Add one obstacle to the nodes within its range
+static void stamp_obstacle(struct force_field *ff, int ox, int oy)
+{
+    int r = (int)ceilf(ff->rho * FF_RES);
+    int ci = ox * FF_RES, cj = oy * FF_RES;
+    for (int j = cj - r; j <= cj + r; j++) {
+        if (j < 0 || j >= ff->nh)
+            continue;
+        for (int i = ci - r; i <= ci + r; i++) {
+            if (i < 0 || i >= ff->nw || (i == ci && j == cj))
+                continue;
+            float dx = (float)(i - ci) / FF_RES, dy = (float)(j - cj) / FF_RES;
+            float d = sqrtf(dx * dx + dy * dy);
+            if (d >= ff->rho)
+                continue;
+            float f = push(ff, d) * FF_OBS_GAIN / d;
+            ff->fx[j * ff->nw + i] += f * dx;
+            ff->fy[j * ff->nw + i] += f * dy;
+        }
+    }
+}
+
+// Walls: strips of width RHO along the four borders
+static void stamp_walls(struct force_field *ff)
+{
+    int r = (int)ceilf(ff->rho * FF_RES);
+    for (int j = 0; j < ff->nh; j++) {
+        for (int i = 0; i < r && i < ff->nw; i++) {
+            float d = (float)i / FF_RES;
+            ff->fx[j * ff->nw + i] += push(ff, d);                  // Left
+            ff->fx[j * ff->nw + (ff->nw - 1 - i)] -= push(ff, d);   // Right
+        }
+    }
+    for (int j = 0; j < r && j < ff->nh; j++) {
+        float d = (float)j / FF_RES;
+        for (int i = 0; i < ff->nw; i++) {
+            ff->fy[j * ff->nw + i] += push(ff, d);                  // Top
+            ff->fy[(ff->nh - 1 - j) * ff->nw + i] -= push(ff, d);   // Bottom
+        }
+    }
+}
+
+static int rebuild(struct force_field *ff)
+{
+    int nw = ff->w * FF_RES + 1, nh = ff->h * FF_RES + 1;
+    if (nw != ff->nw || nh != ff->nh) {
+        float *fx = realloc(ff->fx, (size_t)nw * nh * sizeof(float));
+        if (fx)
+            ff->fx = fx;
+        float *fy = realloc(ff->fy, (size_t)nw * nh * sizeof(float));
+        if (fy)
+            ff->fy = fy;
+        if (!fx || !fy) {
+            ff->nw = ff->nh = 0;
+            return -1;
+        }
+        ff->nw = nw;
+        ff->nh = nh;
+    }
+    memset(ff->fx, 0, (size_t)nw * nh * sizeof(float));
+    memset(ff->fy, 0, (size_t)nw * nh * sizeof(float));
+
+    if (ff->rho > 0) {
+        stamp_walls(ff);
+        for (int k = 0; k < ff->num_obs; k++)
+            stamp_obstacle(ff, ff->obs_x[k], ff->obs_y[k]);
+    }
+    ff->dirty = 0;
+    ff->builds++;
+    return 0;
+}
+
+void ff_sample(struct force_field *ff, float x, float y, float *fx, float *fy)
+{
+    *fx = *fy = 0;
+    if (ff->w <= 0 || ff->h <= 0)
+        return;
+    if (ff->dirty && rebuild(ff) < 0)
+        return;
+
+    // Bilinear between the four nodes around (x, y)
+    float gx = fminf(fmaxf(x * FF_RES, 0.0f), (float)(ff->nw - 1));
+    float gy = fminf(fmaxf(y * FF_RES, 0.0f), (float)(ff->nh - 1));
+    int i = (int)gx, j = (int)gy;
+    if (i > ff->nw - 2)
+        i = ff->nw - 2;
+    if (j > ff->nh - 2)
+        j = ff->nh - 2;
+    float tx = gx - i, ty = gy - j;
+    int n00 = j * ff->nw + i, n10 = n00 + 1, n01 = n00 + ff->nw, n11 = n01 + 1;
+    *fx = (ff->fx[n00] * (1 - tx) + ff->fx[n10] * tx) * (1 - ty) + (ff->fx[n01] * (1 - tx) + ff->fx[n11] * tx) * ty;
+    *fy = (ff->fy[n00] * (1 - tx) + ff->fy[n10] * tx) * (1 - ty) + (ff->fy[n01] * (1 - tx) + ff->fy[n11] * tx) * ty;
+}
+
+void ff_sample_exact(const struct force_field *ff, float x, float y, float *fx, float *fy)
+{
+    *fx = *fy = 0;
+    if (ff->w <= 0 || ff->h <= 0 || ff->rho <= 0)
+        return;
+    rep_sum(ff->obs_xf, ff->obs_yf, ff->num_obs, x, y, ff->rho, ff->ni * FF_OBS_GAIN, fx, fy);
+    *fx += push(ff, x) - push(ff, ff->w - x);
+    *fy += push(ff, y) - push(ff, ff->h - y);
+}
@@ -0,0 +1,176 @@
+#include "../include/layout_gen.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#define LG_TRIES 32         // Failed darts in a row before the spacing shrinks
+#define LG_POINT_TRIES 64   // Candidates for a single point
+
+void lg_seed(struct lg_rng *r, uint64_t seed, uint64_t stream)
+{
+    r->s = seed ^ (stream * 0xd1b54a32d192ed03ull);
+    lg_next(r);
+}
+
+uint32_t lg_next(struct lg_rng *r)
+{
+    uint64_t z = (r->s += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+int lg_range(struct lg_rng *r, int lo, int hi)
+{
+    uint32_t span = (uint32_t)(hi - lo) + 1;
+    if (span == 0)
+        return (int)lg_next(r);
+    // Drop the top partial range so every value is equally likely
+    uint32_t limit = UINT32_MAX - UINT32_MAX % span;
+    uint32_t v;
+    do {
+        v = lg_next(r);
+    } while (v >= limit);
+    return lo + (int)(v % span);
+}
+
+static int excluded(const struct lg_params *p, int x, int y)
+{
+    for (int i = 0; i < p->num_zones; i++) {
+        long dx = x - p->zones[i].x, dy = y - p->zones[i].y;
+        long r = p->zones[i].r;
+        if (dx * dx + dy * dy < r * r)
+            return 1;
+    }
+    return 0;
+}
+
+static long isqrt(long v)
+{
+    long r = 0;
+    while ((r + 1) * (r + 1) <= v)
+        r++;
+    return r;
+}
+
+// Squared distance to the nearest occupied cell, LONG_MAX if none
+static long clearance(const struct lg_params *p, int x, int y)
+{
+    long best = LONG_MAX;
+    for (int i = 0; i < p->num_occ; i++) {
+        long dx = p->occ_x[i] - x, dy = p->occ_y[i] - y;
+        long d2 = dx * dx + dy * dy;
+        if (d2 < best)
+            best = d2;
+    }
+    return best;
+}
+
+int layout_gen_point(struct lg_rng *r, const struct lg_params *p, int *x, int *y)
+{
+    if (p->w < 3 || p->h < 3)
+        return -1;
+    long min2 = (long)p->min_dist * p->min_dist;
+    if (min2 < 1)
+        min2 = 1;
+    // Score of a try: its clearance, -1 inside a zone; the best one is kept
+    long best = -2;
+    for (int t = 0; t < LG_POINT_TRIES; t++) {
+        int cx = lg_range(r, 1, p->w - 2);
+        int cy = lg_range(r, 1, p->h - 2);
+        long score = excluded(p, cx, cy) ? -1 : clearance(p, cx, cy);
+        if (score > best) {
+            best = score;
+            *x = cx;
+            *y = cy;
+        }
+        if (score >= min2)
+            break;
+    }
+    return 0;
+}
+
+int layout_gen(const struct lg_params *p, int *xs, int *ys, int n)
+{
+    int aw = p->w - 2, ah = p->h - 2;
+    if (n <= 0 || aw < 1 || ah < 1)
+        return 0;
+
+    // Spacing for n points over the area: r = 0.7 * sqrt(area / n), well
+    // below what dart throwing saturates at, so the whole area gets covered
+    long min2 = (long)p->min_dist * p->min_dist;
+    long r2 = 49L * aw * ah / (100L * n);
+    if (r2 < min2)
+        r2 = min2;
+    if (r2 < 1)
+        r2 = 1;
+
+    // Background grid, one list of points per cell of side ~r
+    int cell = (int)isqrt(r2);
+    if (cell < 1)
+        cell = 1;
+    int cols = aw / cell + 1, rows = ah / cell + 1;
+    int *head = malloc((size_t)cols * rows * sizeof(int));
+    int *next = malloc((size_t)n * sizeof(int));
+    if (!head || !next) {
+        free(head);
+        free(next);
+        return 0;
+    }
+    for (int i = 0; i < cols * rows; i++)
+        head[i] = -1;
+
+    struct lg_rng rng;
+    lg_seed(&rng, p->seed, p->layout);
+
+    // Grid cells to visit around a dart: a conflict is closer than r
+    int k = (int)((isqrt(r2 - 1) + cell - 1) / cell);
+    int placed = 0, fails = 0;
+    while (placed < n) {
+        int x = lg_range(&rng, 1, aw);
+        int y = lg_range(&rng, 1, ah);
+        int ok = !excluded(p, x, y);
+
+        int c = (x - 1) / cell, rw = (y - 1) / cell;
+        for (int gy = rw - k; ok && gy <= rw + k; gy++) {
+            if (gy < 0 || gy >= rows)
+                continue;
+            for (int gx = c - k; ok && gx <= c + k; gx++) {
+                if (gx < 0 || gx >= cols)
+                    continue;
+                for (int j = head[gy * cols + gx]; j != -1; j = next[j]) {
+                    long dx = xs[j] - x, dy = ys[j] - y;
+                    if (dx * dx + dy * dy < r2) {
+                        ok = 0;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (ok) {
+            xs[placed] = x;
+            ys[placed] = y;
+            int b = rw * cols + c;
+            next[placed] = head[b];
+            head[b] = placed;
+            placed++;
+            fails = 0;
+        } else if (++fails >= LG_TRIES) {
+            // Crowded: shrink the spacing by ~10%, down to the hard bound
+            if (r2 <= min2 || r2 <= 1)
+                break;
+            r2 = r2 * 81 / 100;
+            if (r2 < min2)
+                r2 = min2;
+            if (r2 < 1)
+                r2 = 1;
+            k = (int)((isqrt(r2 - 1) + cell - 1) / cell);
+            fails = 0;
+        }
+    }
+
+    free(head);
+    free(next);
+    return placed;
+}
@@ -0,0 +1,141 @@
+#include "../include/lg_gen.h"
+
+#include <stdlib.h>
+
+static const struct lg_zone spawn = { DRONE_START_X, DRONE_START_Y, LAYOUT_SPAWN_CLEAR };
+
+// Message types and source of each kind
+static const struct {
+    int src, gen_reset, layout, new_point;
+} kinds[LAYOUT_PARTS] = {
+    [ENT_OBSTACLE] = { IDX_O, MSG_OBS_GEN_RESET, MSG_OBS_LAYOUT, MSG_OBS_NEW },
+    [ENT_TARGET]   = { IDX_T, MSG_TGT_GEN_RESET, MSG_TGT_LAYOUT, MSG_TGT_NEW },
+};
+
+void lg_gen_init(struct lg_gen *g, int kind, uint64_t seed, struct bb_shm *shm)
+{
+    *g = (struct lg_gen){ .kind = kind, .w = 155, .h = 30, .seed = seed, .shm = shm };
+    // Single points use their own stream, far from the layout numbers
+    lg_seed(&g->rng, seed, UINT64_MAX - kind);
+}
+
+void lg_gen_free(struct lg_gen *g)
+{
+    free(g->occ_x);
+    free(g->occ_y);
+    g->occ_x = g->occ_y = NULL;
+    g->num_occ = g->cap_occ = 0;
+    bb_snapshot_free(&g->live);
+}
+
+static int occ_reserve(struct lg_gen *g, int n)
+{
+    if (n <= g->cap_occ)
+        return 0;
+    int cap = g->cap_occ ? 2 * g->cap_occ : 64;
+    if (cap < n)
+        cap = n;
+    int *x = realloc(g->occ_x, cap * sizeof(int));
+    if (x)
+        g->occ_x = x;
+    int *y = x ? realloc(g->occ_y, cap * sizeof(int)) : NULL;
+    if (y)
+        g->occ_y = y;
+    if (!x || !y)
+        return -1;
+    g->cap_occ = cap;
+    return 0;
+}
+
+static void occ_add(struct lg_gen *g, const int *xs, const int *ys, int n)
+{
+    if (n <= 0 || occ_reserve(g, g->num_occ + n) < 0)
+        return;
+    for (int i = 0; i < n; i++) {
+        g->occ_x[g->num_occ] = xs[i];
+        g->occ_y[g->num_occ] = ys[i];
+        g->num_occ++;
+    }
+}
+
+static struct lg_params gen_params(const struct lg_gen *g)
+{
+    struct lg_params p = {
+        .w = g->w, .h = g->h,
+        .min_dist = LAYOUT_MIN_DIST,
+        .zones = &spawn, .num_zones = 1,
+        .seed = g->seed, .layout = g->layout_no,
+        .occ_x = g->occ_x, .occ_y = g->occ_y, .num_occ = g->num_occ,
+    };
+    return p;
+}
+
+int lg_gen_send_layout(struct lg_gen *g, struct channel *out)
+{
+    // Every part is generated and taken, this one is sent
+    struct lg_params p = gen_params(g);
+    int want = LAYOUT_PARTS * layout_count(g->w, g->h);
+    int *ax = malloc((want > 0 ? want : 1) * sizeof(int));
+    int *ay = malloc((want > 0 ? want : 1) * sizeof(int));
+    if (!ax || !ay) {
+        free(ax);
+        free(ay);
+        return -1;
+    }
+    int total = layout_gen(&p, ax, ay, want);
+    g->layout_no++;
+    g->num_occ = 0;
+    occ_add(g, ax, ay, total);
+
+    int n = 0;
+    for (int i = g->kind; i < total; i += LAYOUT_PARTS) {
+        ax[n] = ax[i];
+        ay[n] = ay[i];
+        n++;
+    }
+
+    struct msg m;
+    msg_init(&m, kinds[g->kind].src, kinds[g->kind].gen_reset, sizeof(struct pl_layout));
+    MSG_PL(&m, struct pl_layout)->w = g->w;
+    MSG_PL(&m, struct pl_layout)->h = g->h;
+    MSG_PL(&m, struct pl_layout)->count = n;
+    channel_send(out, &m);
+
+    for (int first = 0; first < n; first += PL_POINTS_MAX) {
+        int count = (n - first < PL_POINTS_MAX) ? n - first : PL_POINTS_MAX;
+        msg_init(&m, kinds[g->kind].src, kinds[g->kind].layout, 4 + count * 4);
+        struct pl_points *pts = MSG_PL(&m, struct pl_points);
+        pts->first = first;
+        pts->count = count;
+        for (int i = 0; i < count; i++) {
+            pts->pt[i].x = ax[first + i];
+            pts->pt[i].y = ay[first + i];
+        }
+        channel_send(out, &m);
+    }
+    free(ax);
+    free(ay);
+    return n;
+}
+
+int lg_gen_send_point(struct lg_gen *g, struct channel *out)
+{
+    if (g->shm) {
+        // The live state replaces what this generator remembers
+        const struct bb_snapshot *live = &g->live;
+        bb_shm_read(g->shm, &g->live);
+        g->num_occ = 0;
+        occ_add(g, live->obs_x, live->obs_y, live->num_obs);
+        occ_add(g, live->tgs_x, live->tgs_y, live->num_tgs);
+        occ_add(g, &live->drone_x, &live->drone_y, 1);
+    }
+    struct lg_params p = gen_params(g);
+    int x, y;
+    if (layout_gen_point(&g->rng, &p, &x, &y) < 0)
+        return -1;
+    occ_add(g, &x, &y, 1);
+
+    struct msg m;
+    msg_pos(&m, kinds[g->kind].src, kinds[g->kind].new_point, x, y);
+    return channel_send(out, &m) < 0 ? -1 : 0;
+}
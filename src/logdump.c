@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../include/common.h"
+#include "../include/trace.h"
+
+/*
+ * logdump: decode the binary traces of every process and print them as one
+ * timeline, merged by timestamp.
+ *
+ *   ./build/logdump                  (all the log/trace_*.bin of the last run)
+ *   ./build/logdump file.bin ...     (only the given files)
+ *
+ * Times are in seconds from the first record.
+ */
+
+struct entry {
+    uint64_t ts_ns;
+    uint32_t seq;
+    uint8_t proc;
+    uint8_t event;
+    int32_t args[4];
+    char *text;         // EV_TEXT: the reassembled line
+    const char *name;   // Process name from the file header
+};
+
+static struct entry *entries;
+static size_t num_entries, cap_entries;
+
+static struct entry *entry_new(void)
+{
+    if (num_entries == cap_entries) {
+        cap_entries = cap_entries ? 2 * cap_entries : 4096;
+        entries = realloc(entries, cap_entries * sizeof(*entries));
+        if (!entries) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return &entries[num_entries++];
+}
+
+/**
+ * Load the records still in the ring of one file, oldest first.
+ * Returns the number of records loaded, -1 if the file is not a trace.
+ */
+static long load_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return -1;
+
+    struct trace_hdr h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.version != TRACE_VERSION || h.rec_size != sizeof(struct trace_rec) ||
+        h.slots == 0 || (h.slots & (h.slots - 1)) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(f);
+        return -1;
+    }
+
+    struct trace_rec *recs = malloc((size_t)h.slots * sizeof(struct trace_rec));
+    if (!recs || fread(recs, sizeof(struct trace_rec), h.slots, f) != h.slots) {
+        fprintf(stderr, "%s: truncated trace file\n", path);
+        free(recs);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    h.name[sizeof(h.name) - 1] = '\0';
+    const char *name = strdup(h.name);
+
+    uint64_t n = h.head < h.slots ? h.head : h.slots;
+    long loaded = 0;
+    struct entry *line = NULL;   // EV_TEXT being reassembled
+    size_t line_len = 0;
+
+    for (uint64_t s = h.head - n; s < h.head; s++) {
+        const struct trace_rec *r = &recs[s & (h.slots - 1)];
+        // Overwritten while the process was running
+        if (r->seq != (uint32_t)s)
+            continue;
+
+        int len = r->len > TRACE_TEXT_BYTES ? TRACE_TEXT_BYTES : r->len;
+        if (r->event == EV_TEXT_CONT) {
+            // Continuation of a line whose head was overwritten: drop it
+            if (!line)
+                continue;
+            line->text = realloc(line->text, line_len + len + 1);
+            memcpy(line->text + line_len, r->args, len);
+            line_len += len;
+            line->text[line_len] = '\0';
+            continue;
+        }
+
+        struct entry *e = entry_new();
+        e->ts_ns = r->ts_ns;
+        e->seq = r->seq;
+        e->proc = r->proc;
+        e->event = r->event;
+        memcpy(e->args, r->args, sizeof(e->args));
+        e->text = NULL;
+        e->name = name;
+        line = NULL;
+        loaded++;
+
+        if (r->event == EV_TEXT) {
+            e->text = malloc(len + 1);
+            memcpy(e->text, r->args, len);
+            e->text[len] = '\0';
+            // Continuations follow before any other entry, so e stays valid
+            line = e;
+            line_len = len;
+        }
+    }
+    free(recs);
+    return loaded;
+}
+
+static int entry_cmp(const void *a, const void *b)
+{
+    const struct entry *x = a, *y = b;
+    if (x->ts_ns != y->ts_ns)
+        return x->ts_ns < y->ts_ns ? -1 : 1;
+    if (x->proc != y->proc)
+        return x->proc < y->proc ? -1 : 1;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+int main(int argc, char *argv[])
+{
+    int files = 0;
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++)
+            if (load_file(argv[i]) >= 0)
+                files++;
+    } else {
+        char path[64];
+        for (int p = 0; p <= NUM_PROCESSES; p++) {
+            snprintf(path, sizeof(path), "log/trace_%s.bin", trace_proc_name(p));
+            if (load_file(path) >= 0)
+                files++;
+        }
+    }
+
+    if (files == 0) {
+        fprintf(stderr, "Usage: %s [trace_file.bin ...]\n"
+                        "No trace found: run with ARP_LOG_BACKEND=binary\n", argv[0]);
+        return 1;
+    }
+
+    qsort(entries, num_entries, sizeof(*entries), entry_cmp);
+
+    uint64_t t0 = num_entries ? entries[0].ts_ns : 0;
+    for (size_t i = 0; i < num_entries; i++) {
+        const struct entry *e = &entries[i];
+        double t = (double)(e->ts_ns - t0) / 1e9;
+        if (e->event == EV_TEXT) {
+            printf("%12.6f %-10s %s\n", t, e->name, e->text);
+            free(e->text);
+        } else {
+            printf("%12.6f %-10s %s %d %d %d %d\n", t, e->name,
+                   trace_event_name(e->event), e->args[0], e->args[1], e->args[2], e->args[3]);
+        }
+    }
+    free(entries);
+    return 0;
+}
@@ -1,6 +1,6 @@
-#define _POSIX_C_SOURCE 200809L
-#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include <sys/select.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <stdlib.h>
@@ -10,6 +10,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <time.h>
+#include <math.h>
 
 /* ========================================================================
  * NETWORK MODE: Additional includes for socket communication
@@ -32,6 +33,10 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "MAIN"
 #include "../include/common.h"
+#include "../include/channel.h"
+#include "../include/trace.h"
+#include "../include/netconn.h"
+#include "../include/bb_shm.h"
 
 static const char *process_names[] = {
     [IDX_B] = "Blackboard",
@@ -66,52 +71,1292 @@ void handle_signal(int sig) {
     exit(0);
 }
 
-/* ========================================================================
- * NETWORK MODE: Helper function for reading null-terminated strings from socket
- * ======================================================================== */
-ssize_t read_line(int fd, char *buf, size_t maxlen) {
-    size_t i = 0;
-    char c;
-
-    while (i < maxlen - 1) {
-        ssize_t n = read(fd, &c, 1);
-        if (n == 1) {
-            buf[i++] = c;
-            if (c == '\0') break;
-        } else if (n == 0) {
-            return 0;   // connection closed
-        } else {
-            return -1;  // error
+struct link link_parent_to_child[NUM_PROCESSES]; // Child reads from end 0, parent writes to end 1
+struct link link_child_to_parent[NUM_PROCESSES]; // Parent reads from end 0, child writes to end 1
+int bb_shm_fd = -1;                              // Shared Blackboard state: Blackboard (writer) and its readers
+
+struct channel to_child[NUM_PROCESSES];   // Router side of parent->child edges
+struct channel from_child[NUM_PROCESSES]; // Router side of child->parent edges
+
+// Transport used for every edge, selected at launch (-t pipe|shm)
+int transport = TRANSPORT_PIPE;
+
+/**
+ * In a freshly forked child: close every edge except its own,
+ * and the router-side ends of its own edges. Only the child's ends
+ * survive exec() (the rest is close-on-exec anyway).
+ */
+void close_other_links(int keep) {
+    for (int i = 0; i < NUM_PROCESSES; i++) {
+        if (i != keep) {
+            link_close(&link_parent_to_child[i]);
+            link_close(&link_child_to_parent[i]);
         }
     }
-    buf[i] = '\0';
-    return i;
+    link_inherit(&link_parent_to_child[keep], 0);
+    link_inherit(&link_child_to_parent[keep], 1);
+    if (bb_shm_fd != -1 && (keep == IDX_I || keep == IDX_W)) close(bb_shm_fd);
 }
 
-
-int pipe_parent_to_child[NUM_PROCESSES][2]; // Child reads from [0], parent writes to [1]
-int pipe_child_to_parent[NUM_PROCESSES][2]; // Parent reads from [0], child writes to [1]
-
 // Route table structure
 typedef struct{
     int num;
     int dest[NUM_PROCESSES];
 } route_t;
 
+/* ========================================================================
+ * ROUTER: batched forwarding and messages-per-wakeup accounting
+ * ======================================================================== */
+#define ROUTER_STATS_PERIOD 1000   // Wakeups between two statistics log lines
+#define ROUTER_HIST_BUCKETS 8      // Buckets: 0, 1, 2-3, 4-7, ..., >=64
+
+struct router_stats {
+    unsigned long wakeups;                   // epoll_wait returns
+    unsigned long messages;                  // messages read in those wakeups
+    unsigned long max_batch;                 // largest number of messages in one wakeup
+    unsigned long filtered;                  // deliveries saved by subscriptions
+    unsigned long coalesced;                 // stale state messages overwritten before delivery
+    unsigned long dropped;                   // control messages refused by a full output queue
+    unsigned long hist[ROUTER_HIST_BUCKETS]; // log2 histogram of messages per wakeup
+};
+
+void router_stats_log(const struct router_stats *st) {
+    if (st->wakeups == 0) return;
+    LOG_INFO("Router: %lu wakeups, %lu msgs, %.2f msgs/wakeup, max %lu, filtered %lu, coalesced %lu, dropped %lu, hist [%lu %lu %lu %lu %lu %lu %lu %lu]",
+             st->wakeups, st->messages, (double)st->messages / st->wakeups, st->max_batch, st->filtered, st->coalesced, st->dropped,
+             st->hist[0], st->hist[1], st->hist[2], st->hist[3],
+             st->hist[4], st->hist[5], st->hist[6], st->hist[7]);
+}
+
+void router_stats_update(struct router_stats *st, unsigned long n) {
+    int b = 0;
+    while (b < ROUTER_HIST_BUCKETS - 1 && (1UL << b) <= n) b++;
+    st->hist[b]++;
+    st->wakeups++;
+    st->messages += n;
+    if (n > st->max_batch) st->max_batch = n;
+    if (st->wakeups % ROUTER_STATS_PERIOD == 0) router_stats_log(st);
+}
+
+/* ========================================================================
+ * ROUTER: subscription registry
+ * route_table says who may talk to whom, the subscription mask of the
+ * destination says which message types it actually wants.
+ * ======================================================================== */
+uint32_t subscriptions[NUM_PROCESSES];
+
+void subscriptions_init(void) {
+    for (int i = 0; i < NUM_PROCESSES; i++) subscriptions[i] = MSG_SUB_ALL;
+}
+
+/**
+ * Record a MSG_SUBSCRIBE received on the edge of src.
+ * Returns 1 if the message was a subscription (consumed by the router).
+ */
+int subscription_update(int src, const struct msg *m) {
+    if (m->hdr.version != MSG_VERSION || m->hdr.type != MSG_SUBSCRIBE) return 0;
+    subscriptions[src] = MSG_PL(m, const struct pl_subscribe)->mask;
+
+    LOG_INFO("Router: %s subscribed, mask 0x%08x", process_names[src], (unsigned)subscriptions[src]);
+    return 1;
+}
+
+/* ========================================================================
+ * ROUTER: per-destination output queues and delivery policies
+ * Control messages are delivered reliably and in order (FIFO). State
+ * messages only matter in their newest version: while a destination is
+ * behind, a newer one overwrites the pending one in place (latest-wins),
+ * so a slow consumer never renders positions that waited in a queue.
+ * ======================================================================== */
+enum { DELIVER_FIFO = 0, DELIVER_LATEST };
+
+// MSG_REMOTE_POS stays FIFO: one slot per type would merge different remote
+// drones, and a position must not overtake the MSG_REMOTE_GONE after it
+const unsigned char delivery_policy[MSG_TYPE_COUNT] = {
+    [MSG_DRONE_POS]  = DELIVER_LATEST,
+    [MSG_STATS]      = DELIVER_LATEST,
+    [MSG_OBS_NEAR]   = DELIVER_LATEST,
+};
+
+#define ROUTER_PIPE_SIZE (2 * 4096)  // Kernel buffer toward a child: bounds the queueing delay
+#define ROUTER_RETRY_MS  2           // Flush retry period when waiting on a ring (no EPOLLOUT)
+#define ROUTER_OUT_TAG   0x100       // epoll data tag for a writable parent->child edge
+#define ROUTER_OUTQ_MAX  4096        // Control messages queued per destination before dropping
+
+struct outq {
+    struct msg *fifo;                    // Pending control messages in [head, tail)
+    int head, tail, cap;
+    struct msg latest[MSG_TYPE_COUNT];   // Pending state messages, one slot per type
+    uint32_t latest_mask;                // Types with a pending latest[] slot
+    int armed;                           // EPOLLOUT registered for this edge
+    int overflow;                        // Full: dropping since the last warning
+};
+
+struct outq outq[NUM_PROCESSES];
+
+int outq_pending(int dst) {
+    return outq[dst].head != outq[dst].tail || outq[dst].latest_mask != 0;
+}
+
+void outq_push(int dst, const struct msg *m, struct router_stats *st) {
+    struct outq *q = &outq[dst];
+
+    if (m->hdr.version == MSG_VERSION && m->hdr.type < MSG_TYPE_COUNT &&
+        delivery_policy[m->hdr.type] == DELIVER_LATEST) {
+        uint32_t bit = MSG_BIT(m->hdr.type);
+        if (q->latest_mask & bit) {
+            st->coalesced++;
+            trace_event(EV_ROUTER_COALESCE, dst, m->hdr.type, 0, 0);
+        }
+        q->latest[m->hdr.type] = *m;
+        q->latest_mask |= bit;
+        return;
+    }
+
+    // A consumer this far behind is stuck: do not grow without limit
+    if (q->tail - q->head >= ROUTER_OUTQ_MAX) {
+        st->dropped++;
+        if (!q->overflow) {
+            LOG_WARN("Router: queue to %s full (%d msgs), dropping control messages",
+                     process_names[dst], ROUTER_OUTQ_MAX);
+            q->overflow = 1;
+        }
+        return;
+    }
+
+    if (q->tail == q->cap) {
+        if (q->head > 0) {
+            memmove(q->fifo, q->fifo + q->head, (q->tail - q->head) * sizeof(struct msg));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            int cap = q->cap ? 2 * q->cap : 256;
+            struct msg *fifo = realloc(q->fifo, cap * sizeof(struct msg));
+            if (!fifo) {
+                perror("realloc outq");
+                exit(EXIT_FAILURE);
+            }
+            q->fifo = fifo;
+            q->cap = cap;
+        }
+    }
+    q->fifo[q->tail++] = *m;
+}
+
+// Drop everything queued for a destination that closed its end
+void outq_reset(int dst, int n) {
+    perror("write to child");
+    fprintf(stderr, "Write failed dst=%s (%d msgs dropped)\n", process_names[dst], n);
+    LOG_ERROR("Router: write to %s failed, %d msgs dropped", process_names[dst], n);
+    outq[dst].head = outq[dst].tail = 0;
+    outq[dst].latest_mask = 0;
+    outq[dst].overflow = 0;
+}
+
+/**
+ * Send as much of the pending output as the destination accepts: control
+ * messages first, in order, then the latest-wins slots.
+ * Returns 1 if something is still pending.
+ */
+int outq_flush(int dst) {
+    struct outq *q = &outq[dst];
+
+    while (q->head != q->tail) {
+        int n = q->tail - q->head;
+        if (n > CHANNEL_BATCH) n = CHANNEL_BATCH;
+        int k = channel_send_batch(&to_child[dst], q->fifo + q->head, n);
+        if (k < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            outq_reset(dst, q->tail - q->head);
+            return 0;
+        }
+        q->head += k;
+    }
+    q->head = q->tail = 0;
+    q->overflow = 0;
+
+    while (q->latest_mask) {
+        struct msg batch[MSG_TYPE_COUNT];
+        int types[MSG_TYPE_COUNT];
+        int n = 0;
+        for (int t = 0; t < MSG_TYPE_COUNT; t++) {
+            if (q->latest_mask & MSG_BIT(t)) {
+                batch[n] = q->latest[t];
+                types[n++] = t;
+            }
+        }
+        int k = channel_send_batch(&to_child[dst], batch, n);
+        if (k < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            outq_reset(dst, n);
+            return 0;
+        }
+        for (int i = 0; i < k; i++) q->latest_mask &= ~MSG_BIT(types[i]);
+    }
+    return 0;
+}
+
+/**
+ * Deliver messages to a destination: straight to the channel when nothing
+ * is pending, through the output queue (with its policies) otherwise.
+ */
+void route_send(int dst, const struct msg *ms, int n, struct router_stats *st) {
+    if (to_child[dst].fd == -1) return;
+
+    int k = 0;
+    if (!outq_pending(dst)) {
+        k = channel_send_batch(&to_child[dst], ms, n);
+        if (k < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                outq_reset(dst, n);
+                return;
+            }
+            k = 0;
+        }
+    }
+    if (k < n) trace_event(EV_ROUTER_BLOCKED, dst, n - k, 0, 0);
+    for (int i = k; i < n; i++) outq_push(dst, &ms[i], st);
+}
+
+/**
+ * Retry every pending destination. Pipes are watched with EPOLLOUT (when
+ * epfd >= 0); rings cannot be, so the caller has to come back after the
+ * returned timeout. Returns the epoll/select timeout in ms, -1 = none.
+ */
+int outq_flush_all(int epfd) {
+    int timeout = -1;
+    for (int dst = 0; dst < NUM_PROCESSES; dst++) {
+        int pending = outq_pending(dst) && outq_flush(dst);
+        if (pending && (to_child[dst].ring || epfd < 0)) {
+            timeout = ROUTER_RETRY_MS;
+        } else if (pending && !outq[dst].armed) {
+            struct epoll_event ev = { .events = EPOLLOUT, .data.u32 = ROUTER_OUT_TAG | dst };
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, to_child[dst].fd, &ev) == 0) outq[dst].armed = 1;
+        } else if (!pending && outq[dst].armed) {
+            epoll_ctl(epfd, EPOLL_CTL_DEL, to_child[dst].fd, NULL);
+            outq[dst].armed = 0;
+        }
+    }
+    return timeout;
+}
+
+/**
+ * Drain one child->parent edge completely: read batches of messages (readv)
+ * and push to each destination of the route table (writev) the part of the
+ * batch it subscribed to.
+ * Returns the number of routed messages, -1 if the child closed its end.
+ */
+long route_drain(int src, const route_t *route_table, int *esc_received, struct router_stats *st) {
+    struct msg batch[CHANNEL_BATCH];
+    struct msg out[CHANNEL_BATCH];
+    long total = 0;
+
+    while (1) {
+        int n = channel_recv_batch(&from_child[src], batch, CHANNEL_BATCH);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            perror("read from child");
+            return -1;
+        }
+        if (n == 0) return -1;
+
+        // Subscriptions are for the router only, compact them away
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+            if (subscription_update(src, &batch[i])) continue;
+            if (batch[i].hdr.type == MSG_ESC) {
+                printf("ESC RECEIVED\n");
+                *esc_received = 1;
+            }
+            if (k != i) batch[k] = batch[i];
+            k++;
+        }
+        trace_event(EV_ROUTER_BATCH, src, n, k, 0);
+        if (k == 0) continue;
+
+        // Destination from route_table, filtered by its subscription
+        for (int d = 0; d < route_table[src].num; d++) {
+            int dst = route_table[src].dest[d];
+            const struct msg *send = batch;
+            int num = k;
+            if (subscriptions[dst] != MSG_SUB_ALL) {
+                num = 0;
+                for (int i = 0; i < k; i++)
+                    if (msg_wanted(subscriptions[dst], &batch[i])) out[num++] = batch[i];
+                send = out;
+                st->filtered += k - num;
+            }
+            if (num == 0) continue;
+            route_send(dst, send, num, st);
+        }
+        total += k;
+    }
+    return total;
+}
+
+/* ========================================================================
+ * ROUTER: dead children
+ * A ring does not notice that its peer died (nobody ran channel_close()),
+ * so SIGCHLD writes a byte on a self-pipe watched by the loop, and the
+ * loop reaps the child and marks its edges: what it wrote before dying is
+ * still routed, then its edge reads EOF, and its queue is dropped.
+ * ======================================================================== */
+#define ROUTER_CHILD_TAG 0x1000      // epoll data tag for the SIGCHLD self-pipe
+
+int sigchld_pipe[2] = {-1, -1};
+
+void handle_sigchld(int sig) {
+    (void)sig;
+    int saved = errno;
+    char c = 0;
+    if (write(sigchld_pipe[1], &c, 1) < 0) { /* Already pending */ }
+    errno = saved;
+}
+
+pid_t *child_pid(int idx) {
+    switch (idx) {
+    case IDX_B: return &pid_B;
+    case IDX_D: return &pid_D;
+    case IDX_I: return &pid_I;
+    case IDX_M: return &pid_M;
+    case IDX_O: return &pid_O;
+    case IDX_T: return &pid_T;
+    default:    return &pid_W;
+    }
+}
+
+void router_reap(int epfd) {
+    char buf[64];
+    while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0);
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        int idx = -1;
+        for (int i = 0; i < NUM_PROCESSES; i++)
+            if (*child_pid(i) == pid) idx = i;
+        if (idx < 0) continue;
+        *child_pid(idx) = 0;
+
+        if (WIFSIGNALED(status))
+            LOG_WARN("Router: %s (pid %d) killed by signal %d", process_names[idx], (int)pid, WTERMSIG(status));
+        else if (WEXITSTATUS(status) != 0)
+            LOG_WARN("Router: %s (pid %d) exited with status %d", process_names[idx], (int)pid, WEXITSTATUS(status));
+        else
+            LOG_INFO("Router: %s (pid %d) exited", process_names[idx], (int)pid);
+
+        if (from_child[idx].fd != -1) channel_peer_gone(&from_child[idx]);
+        if (to_child[idx].fd != -1) {
+            if (outq[idx].armed) epoll_ctl(epfd, EPOLL_CTL_DEL, to_child[idx].fd, NULL);
+            outq[idx].armed = 0;
+            outq[idx].head = outq[idx].tail = 0;
+            outq[idx].latest_mask = 0;
+            outq[idx].overflow = 0;
+            channel_close(&to_child[idx]);
+        }
+    }
+}
+
+/**
+ * Create the self-pipe and install the SIGCHLD handler (before any fork).
+ */
+void router_watch_children(void) {
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+        perror("pipe2 sigchld");
+        exit(EXIT_FAILURE);
+    }
+    struct sigaction sa;
+    sa.sa_handler = handle_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+}
+
+/**
+ * Watch the self-pipe from the router's epoll.
+ */
+void router_watch_epoll(int epfd) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = ROUTER_CHILD_TAG };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sigchld_pipe[0], &ev);
+}
+
 /* ========================================================================
  * NETWORK MODE: Global variables for network operation
  * - mode: Operating mode (STANDALONE=0, SERVER=1, CLIENT=2)
- * - network_fd: Socket file descriptor for network communication
  * - win_w, win_h: Window dimensions (fixed in network mode, dynamic in standalone)
  * ======================================================================== */
 int mode = 100;
-int server_fd, client_fd, network_fd = -1;
 int win_w = 155, win_h = 30;
 
-int main(){
+/* ========================================================================
+ * NETWORK MODE: Protocol state machine
+ * The CLIENT has one connection (the SERVER), the SERVER one per client,
+ * all watched by the same epoll loop as the children. Per connection at
+ * most one request/reply exchange is in flight (the legacy protocol is
+ * lock-step), but nobody blocks on it: replies are matched by the state
+ * when their frame arrives, and the router keeps routing in between.
+ * ======================================================================== */
+#define NET_REPLY_TIMEOUT_MS 2000   // Give up on a reply and go back to idle
+#define NET_CLOSE_FLUSH_MS   200    // Time left to the last frames at shutdown
+#define NET_MAX_PEERS        8      // SERVER: clients connected at the same time
+
+// epoll data tags (children use their index, ROUTER_OUT_TAG their output edge)
+#define NET_TAG_LISTEN 0x200        // SERVER: a client is connecting
+#define NET_TAG_PEER   0x400        // | peer slot: TCP connection
+#define NET_TAG_UDP    0x800        // | peer slot: UDP position socket
+#define NET_TAG_SLOT   0xff
+
+/* ========================================================================
+ * NETWORK MODE: Pipelined sync (optional)
+ * The SERVER offers it by appending " pipe" to the "size" frame (a legacy
+ * CLIENT parses "size %d,%d" and ignores it), the CLIENT accepts with
+ * "sok pipe". Then both peers push their drone as soon as it moves:
+ *   "P <seq> <ack> <x>,<y> <vx>,<vy>"   position and velocity (cells/s),
+ *                             seq = our update, ack = last seq received
+ *   "A <ack>"                 ack only, when we have nothing to send
+ * The velocity lets the receiver extrapolate between updates; it is sent
+ * again whenever it changes by NET_VEL_EPS, even within the same cell.
+ * Peers that send no velocity are accepted (it is then estimated).
+ * At most NET_PIPE_WINDOW updates are unacknowledged; when the window is
+ * full only the newest position is kept and sent once it opens again.
+ * ARP_NET_PIPELINE=0 keeps the lock-step protocol.
+ *
+ * With several clients the SERVER also relays to every pipelined client
+ * the drones of the others, identified by the id it gave them:
+ *   "R <id> <x>,<y> <vx>,<vy>" drone id moved
+ *   "G <id>"                  drone id left
+ * Relays are queued per client, newest position per drone, and written
+ * when the client's socket has drained what was sent before.
+ * ======================================================================== */
+#define NET_PIPE_WINDOW    64
+#define NET_ACK_DELAY_MS   20       // Longest wait before a standalone ack
+#define NET_VEL_EPS        0.5f     // Velocity change (cells/s) worth an update
+
+/* ========================================================================
+ * NETWORK MODE: UDP position transport (optional, on top of pipelined sync)
+ * With ARP_NET_UDP=1 the SERVER also offers "udp <port>" in the size frame,
+ * the CLIENT answers "sok pipe udp <port>". Positions then travel as
+ * datagrams "U <seq> <ts_ms> <x>,<y> <vx>,<vy>" with no ack and no retransmission:
+ * a lost position is superseded by the next one. The receiver drops
+ * datagrams older than the last one accepted (seq) and those delayed more
+ * than NET_UDP_STALE_MS beyond the best delay seen so far (ts; the two clocks
+ * are unrelated, only their difference is tracked). The handshake, the
+ * size exchange, the relays and q/qok stay on TCP.
+ * ======================================================================== */
+#define NET_UDP_REFRESH_MS   100    // Resend an unchanged position (covers losses)
+#define NET_UDP_STALE_MS     200    // Extra delay beyond which a position is stale
+#define NET_UDP_STALE_RESET  50     // Consecutive stale datagrams: relearn the base delay
+
+enum net_wait {
+    NET_IDLE = 0,
+    NET_WAIT_OOK,        // SERVER: sent "ok" to a client, waiting "ook"
+    NET_WAIT_SOK,        // SERVER: sent "size", waiting "sok"
+    NET_WAIT_OBST_POS,   // SERVER: sent "obst", waiting the client position
+    NET_WAIT_DOK,        // SERVER: sent "drone" + position, waiting "dok"
+    NET_WAIT_QOK,        // SERVER: sent "q", waiting "qok"
+    NET_WAIT_DRONE_POS,  // CLIENT: got "drone", waiting the server position
+    NET_WAIT_POK         // CLIENT: sent our position, waiting "pok"
+};
+
+// A drone as carried by the protocol
+struct net_pos {
+    int x, y;                             // Cell
+    float vx, vy;                         // Velocity, cells/s
+    int has_vel;                          // 0: legacy peer, position only
+};
+
+// One connection: CLIENT -> the SERVER (drone id 0), SERVER -> one client
+struct net_peer {
+    struct netconn conn;                  // conn.fd == -1: free slot
+    int id;                               // Id of the remote drone behind it
+    int events;                           // epoll events registered for conn.fd
+    int size_sent;                        // SERVER: window size accepted by the client
+    int wait;                             // enum net_wait
+    unsigned long wait_since_ms;          // When the pending request was sent
+    unsigned long last_drone_ms;          // SERVER: last drone sync
+    unsigned long last_obst_ms;           // SERVER: last obstacle request
+
+    /* Pipelined mode */
+    int pipelined;
+    int pos_dirty;                        // Local position not sent yet
+    uint32_t tx_seq;                      // Last update sent
+    uint32_t tx_acked;                    // Last update acknowledged by the peer
+    uint32_t rx_seq;                      // Last update received
+    uint32_t rx_acked;                    // Last rx_seq we acknowledged
+    unsigned long rx_unacked_ms;          // When rx_seq got ahead of rx_acked
+
+    /* SERVER: last position of this client's drone, and the other drones
+     * waiting to be relayed to it (one slot per peer slot) */
+    int has_pos;
+    struct net_pos pos;
+    uint32_t relay_mask;
+    int relay_id[NET_MAX_PEERS];
+    struct net_pos relay[NET_MAX_PEERS];
+
+    /* UDP transport */
+    int udp_fd;                           // -1 when positions go over TCP
+    int udp_on;                           // Negotiated: positions go over udp_fd
+    struct sockaddr_in udp_peer;          // Peer address (TCP peer IP, negotiated port)
+    uint32_t udp_tx_seq, udp_rx_seq;
+    unsigned long udp_last_tx_ms;
+    int32_t udp_base_delay;               // Smallest (local now - sender ts) seen
+    int udp_have_base;
+    int udp_stale_run;                    // Consecutive stale datagrams
+    unsigned long udp_rx, udp_old, udp_stale;
+};
+
+struct net_state {
+    int running;
+    int quit_requested;                   // SERVER: ESC pressed, "q" goes out when idle
+    int size_known;                       // SERVER: window size received from the Map
+    struct net_pos drone;                 // Our drone (position from the Blackboard, velocity from STATS)
+    float sent_vx, sent_vy;               // Velocity last pushed to the peers
+    int next_id;                          // SERVER: id of the next client (0 = the server)
+    int listen_fd;                        // SERVER: listening socket, -1 otherwise
+    int epfd;
+    struct router_stats *stats;
+    struct net_peer peers[NET_MAX_PEERS];
+};
+
+struct net_state net;
+
+void net_init(struct net_state *ns) {
+    memset(ns, 0, sizeof(*ns));
+    ns->listen_fd = -1;
+    ns->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ns->epfd == -1) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        ns->peers[i].conn.fd = -1;
+        ns->peers[i].udp_fd = -1;
+    }
+}
+
+unsigned long net_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+// Boolean environment switch ("0" = off, anything else = on)
+int net_env_flag(const char *name, int def) {
+    const char *v = getenv(name);
+    return v ? strcmp(v, "0") != 0 : def;
+}
+
+// Server host and TCP port: ARP_NET_HOST / ARP_NET_PORT, else the common.h defaults
+const char *net_host(void) {
+    const char *h = getenv("ARP_NET_HOST");
+    return h && *h ? h : HOST_NAME;
+}
+
+int net_port(void) {
+    const char *p = getenv("ARP_NET_PORT");
+    int port = p ? atoi(p) : 0;
+    return port > 0 && port < 65536 ? port : DEFAULT_PORT;
+}
+
+// "<x>,<y> <vx>,<vy>" (velocity optional on input)
+int net_pos_format(char *buf, size_t size, const struct net_pos *pos) {
+    return snprintf(buf, size, "%d,%d %.2f,%.2f", pos->x, pos->y, pos->vx, pos->vy);
+}
+
+int net_pos_parse(const char *s, struct net_pos *pos) {
+    int n = sscanf(s, "%d,%d %f,%f", &pos->x, &pos->y, &pos->vx, &pos->vy);
+    if (n < 2) return -1;
+    pos->has_vel = n == 4;
+    if (!pos->has_vel) pos->vx = pos->vy = 0;
+    return 0;
+}
+
+int net_slot(const struct net_state *ns, const struct net_peer *p) {
+    return (int)(p - ns->peers);
+}
+
+int net_peer_count(const struct net_state *ns) {
+    int n = 0;
+    for (int i = 0; i < NET_MAX_PEERS; i++)
+        if (ns->peers[i].conn.fd != -1) n++;
+    return n;
+}
+
+// Watch the connection for output only while it has queued bytes
+void net_watch(struct net_state *ns, struct net_peer *p) {
+    if (p->conn.fd == -1) return;
+    int events = EPOLLIN | (netconn_tx_pending(&p->conn) ? EPOLLOUT : 0);
+    if (events == p->events) return;
+    struct epoll_event ev = { .events = events, .data.u32 = NET_TAG_PEER | net_slot(ns, p) };
+    if (epoll_ctl(ns->epfd, p->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, p->conn.fd, &ev) == 0)
+        p->events = events;
+}
+
+void net_send(struct net_state *ns, struct net_peer *p, const char *frame) {
+    if (netconn_send(&p->conn, frame) < 0)
+        LOG_ERROR("NETWORK: send of '%s' to peer %d failed", frame, p->id);
+    net_watch(ns, p);
+}
+
+void net_expect(struct net_peer *p, int wait) {
+    p->wait = wait;
+    p->wait_since_ms = net_now_ms();
+}
+
+void net_shutdown(struct net_state *ns) {
+    LOG("MAIN: cleaning up children...");
+    clean_children();
+    ns->running = 0;
+}
+
+/**
+ * Take a connected socket. SERVER: the client gets the next drone id.
+ * Returns NULL if every slot is in use.
+ */
+struct net_peer *net_peer_add(struct net_state *ns, int fd) {
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p->conn.fd != -1) continue;
+        memset(p, 0, sizeof(*p));
+        p->udp_fd = -1;
+        netconn_init(&p->conn, fd);
+        p->id = mode == SERVER ? ++ns->next_id : 0;
+        net_watch(ns, p);
+        return p;
+    }
+    return NULL;
+}
+
+/* ========================================================================
+ * NETWORK MODE: UDP socket of one connection
+ * ======================================================================== */
+
+// Unbound-peer datagram socket on an ephemeral port
+int net_udp_open(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in a = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY) };
+    if (bind(fd, (struct sockaddr *)&a, sizeof(a)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int net_udp_port(int fd) {
+    struct sockaddr_in a;
+    socklen_t len = sizeof(a);
+    if (getsockname(fd, (struct sockaddr *)&a, &len) < 0) return -1;
+    return ntohs(a.sin_port);
+}
+
+void net_udp_close(struct net_state *ns, struct net_peer *p) {
+    if (p->udp_fd == -1) return;
+    if (p->udp_on)
+        LOG_INFO("NETWORK (UDP): peer %d: %lu positions received, %lu out of order, %lu stale",
+                 p->id, p->udp_rx, p->udp_old, p->udp_stale);
+    epoll_ctl(ns->epfd, EPOLL_CTL_DEL, p->udp_fd, NULL);
+    close(p->udp_fd);
+    p->udp_fd = -1;
+    p->udp_on = 0;
+}
+
+// Positions go to the TCP peer's address, on its negotiated port
+void net_udp_start(struct net_state *ns, struct net_peer *p, int port) {
+    socklen_t len = sizeof(p->udp_peer);
+    if (getpeername(p->conn.fd, (struct sockaddr *)&p->udp_peer, &len) < 0) {
+        LOG_ERROR("NETWORK: getpeername: %s, positions stay on TCP", strerror(errno));
+        net_udp_close(ns, p);
+        return;
+    }
+    p->udp_peer.sin_port = htons(port);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = NET_TAG_UDP | net_slot(ns, p) };
+    epoll_ctl(ns->epfd, EPOLL_CTL_ADD, p->udp_fd, &ev);
+    p->udp_on = 1;
+    LOG_INFO("NETWORK: UDP position transport enabled with peer %d (port %d)", p->id, port);
+}
+
+void net_udp_send(struct net_peer *p, const struct net_pos *pos) {
+    unsigned long now = net_now_ms();
+    char sbuf[96];
+    int len = snprintf(sbuf, sizeof(sbuf), "U %u %u ", ++p->udp_tx_seq, (uint32_t)now);
+    len += net_pos_format(sbuf + len, sizeof(sbuf) - len, pos);
+    // A datagram the kernel cannot take now is just a lost one
+    if (sendto(p->udp_fd, sbuf, len, 0, (struct sockaddr *)&p->udp_peer, sizeof(p->udp_peer)) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK)
+        LOG_WARN("NETWORK (UDP): sendto: %s", strerror(errno));
+    p->udp_last_tx_ms = now;
+}
+
+/* ========================================================================
+ * NETWORK MODE: remote drones
+ * ======================================================================== */
+
+// SERVER: write the pending relays of a client once its socket has drained
+void net_relay_flush(struct net_state *ns, struct net_peer *p) {
+    if (!p->relay_mask || netconn_tx_pending(&p->conn)) return;
+    char sbuf[96];
+    for (int s = 0; s < NET_MAX_PEERS; s++) {
+        if (!(p->relay_mask & (1u << s))) continue;
+        int len = snprintf(sbuf, sizeof(sbuf), "R %d ", p->relay_id[s]);
+        net_pos_format(sbuf + len, sizeof(sbuf) - len, &p->relay[s]);
+        net_send(ns, p, sbuf);
+    }
+    p->relay_mask = 0;
+}
+
+// Remote drone position -> Blackboard, as an obstacle; SERVER: -> the other clients
+void net_forward_remote(struct net_state *ns, struct net_peer *from, int id, const struct net_pos *pos) {
+    struct msg m;
+    msg_remote(&m, IDX_O, MSG_REMOTE_POS, id, pos->x, pos->y);
+    if (pos->has_vel) {
+        struct pl_remote *r = MSG_PL(&m, struct pl_remote);
+        r->vx = pos->vx;
+        r->vy = pos->vy;
+        r->flags = PL_REMOTE_VEL;
+    }
+    route_send(IDX_B, &m, 1, ns->stats);
+
+    if (mode != SERVER) return;
+    from->has_pos = 1;
+    from->pos = *pos;
+    int s = net_slot(ns, from);
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p == from || p->conn.fd == -1 || !p->pipelined) continue;
+        p->relay_mask |= 1u << s;
+        p->relay_id[s] = id;
+        p->relay[s] = *pos;
+        net_relay_flush(ns, p);
+    }
+}
+
+// SERVER: a client just joined the pipelined sync, tell it where the others are
+void net_relay_all(struct net_state *ns, struct net_peer *p) {
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *o = &ns->peers[i];
+        if (o == p || o->conn.fd == -1 || !o->has_pos) continue;
+        p->relay_mask |= 1u << i;
+        p->relay_id[i] = o->id;
+        p->relay[i] = o->pos;
+    }
+    net_relay_flush(ns, p);
+}
+
+// Position frame of the lock-step protocol
+void net_forward_frame(struct net_state *ns, struct net_peer *p, const char *frame) {
+    struct net_pos pos = {0};
+    if (sscanf(frame, "%d, %d", &pos.x, &pos.y) != 2) {
+        LOG_WARN("NETWORK: invalid position frame '%s'", frame);
+        return;
+    }
+    net_forward_remote(ns, p, p->id, &pos);
+}
+
+void net_remote_gone(struct net_state *ns, struct net_peer *from, int id) {
+    struct msg m;
+    msg_remote(&m, IDX_O, MSG_REMOTE_GONE, id, 0, 0);
+    route_send(IDX_B, &m, 1, ns->stats);
+
+    if (mode != SERVER) return;
+    char sbuf[32];
+    snprintf(sbuf, sizeof(sbuf), "G %d", id);
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p == from || p->conn.fd == -1 || !p->pipelined) continue;
+        p->relay_mask &= ~(1u << net_slot(ns, from));
+        net_send(ns, p, sbuf);
+    }
+}
+
+/**
+ * Close a connection at once: output the socket does not take right away is
+ * dropped, a stuck peer must not stall the loop. SERVER: its drone leaves
+ * the game of everybody else; the session goes on unless ESC is waiting
+ * for the last client.
+ */
+void net_peer_remove(struct net_state *ns, struct net_peer *p) {
+    net_udp_close(ns, p);
+    if (p->events) epoll_ctl(ns->epfd, EPOLL_CTL_DEL, p->conn.fd, NULL);
+    netconn_close(&p->conn, 0);
+    p->events = 0;
+
+    if (mode == SERVER) {
+        LOG_INFO("SERVER: client %d left, %d connected", p->id, net_peer_count(ns));
+        net_remote_gone(ns, p, p->id);
+        if (ns->quit_requested && net_peer_count(ns) == 0) net_shutdown(ns);
+    }
+}
+
+void net_peer_lost(struct net_state *ns, struct net_peer *p, const char *why) {
+    if (mode == CLIENT) {
+        LOG_ERROR("NETWORK: server %s", why);
+        net_shutdown(ns);
+        return;
+    }
+    LOG_WARN("NETWORK: client %d %s", p->id, why);
+    net_peer_remove(ns, p);
+}
+
+/* ========================================================================
+ * NETWORK MODE: pipelined sync of one connection
+ * ======================================================================== */
+void net_pipe_start(struct net_peer *p) {
+    p->pipelined = 1;
+    p->pos_dirty = 1;      // Announce where we are right away
+    LOG_INFO("NETWORK: pipelined sync enabled with peer %d", p->id);
+}
+
+/* Send our position if it changed and the window allows */
+void net_pipe_push(struct net_state *ns, struct net_peer *p) {
+    if (!p->pos_dirty) return;
+
+    if (p->udp_on) {
+        net_udp_send(p, &ns->drone);
+        p->pos_dirty = 0;
+        return;
+    }
+    if (p->tx_seq - p->tx_acked >= NET_PIPE_WINDOW) return;
+
+    char sbuf[96];
+    int len = snprintf(sbuf, sizeof(sbuf), "P %u %u ", ++p->tx_seq, p->rx_seq);
+    net_pos_format(sbuf + len, sizeof(sbuf) - len, &ns->drone);
+    net_send(ns, p, sbuf);
+    p->pos_dirty = 0;
+    p->rx_acked = p->rx_seq;
+}
+
+/**
+ * Consume a frame of the pipelined protocol ("P", "A"; CLIENT: "R", "G").
+ * Returns 1 if the frame belonged to it.
+ */
+int net_pipe_on_frame(struct net_state *ns, struct net_peer *p, const char *frame) {
+    uint32_t seq, ack;
+    int id, off = 0;
+    struct net_pos pos;
+
+    if (sscanf(frame, "P %u %u %n", &seq, &ack, &off) == 2 && off && net_pos_parse(frame + off, &pos) == 0) {
+        // Updates arrive in order over TCP: an old seq is a duplicate
+        if ((int32_t)(seq - p->rx_seq) > 0) {
+            if (p->rx_seq == p->rx_acked) p->rx_unacked_ms = net_now_ms();
+            p->rx_seq = seq;
+            net_forward_remote(ns, p, p->id, &pos);
+        }
+    } else if (sscanf(frame, "A %u", &ack) == 1) {
+        // Ack only
+    } else if (mode == CLIENT && sscanf(frame, "R %d %n", &id, &off) == 1 && off &&
+               net_pos_parse(frame + off, &pos) == 0) {
+        net_forward_remote(ns, p, id, &pos);
+        return 1;
+    } else if (mode == CLIENT && sscanf(frame, "G %d", &id) == 1) {
+        LOG_INFO("CLIENT: remote drone %d left", id);
+        net_remote_gone(ns, p, id);
+        return 1;
+    } else {
+        return 0;
+    }
+
+    if ((int32_t)(ack - p->tx_acked) > 0 && (int32_t)(ack - p->tx_seq) <= 0)
+        p->tx_acked = ack;
+    net_pipe_push(ns, p);
+    return 1;
+}
+
+/**
+ * Acknowledge updates not covered by an outgoing "P", refresh the UDP
+ * position. Returns the ms until the next duty (-1 = none).
+ */
+int net_pipe_tick(struct net_state *ns, struct net_peer *p, unsigned long now) {
+    if (p->udp_on) {
+        unsigned long since = now - p->udp_last_tx_ms;
+        if (since >= NET_UDP_REFRESH_MS) p->pos_dirty = 1;
+        net_pipe_push(ns, p);
+        return since >= NET_UDP_REFRESH_MS ? NET_UDP_REFRESH_MS : (int)(NET_UDP_REFRESH_MS - since);
+    }
+    net_pipe_push(ns, p);
+    if (p->rx_seq == p->rx_acked) return -1;
+
+    unsigned long waited = now - p->rx_unacked_ms;
+    if (waited < NET_ACK_DELAY_MS && p->rx_seq - p->rx_acked < NET_PIPE_WINDOW / 2)
+        return (int)(NET_ACK_DELAY_MS - waited);
+
+    char sbuf[32];
+    snprintf(sbuf, sizeof(sbuf), "A %u", p->rx_seq);
+    net_send(ns, p, sbuf);
+    p->rx_acked = p->rx_seq;
+    return -1;
+}
+
+/* NETWORK (UDP): drain the socket, forward only the newest valid position */
+void net_udp_recv(struct net_state *ns, struct net_peer *p) {
+    char buf[96];
+    int have = 0;
+    struct net_pos newest;
+
+    while (p->udp_fd != -1) {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        ssize_t n = recvfrom(p->udp_fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&from, &len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        buf[n] = '\0';
+
+        uint32_t seq, ts;
+        int off = 0;
+        struct net_pos pos;
+        if (from.sin_addr.s_addr != p->udp_peer.sin_addr.s_addr ||
+            sscanf(buf, "U %u %u %n", &seq, &ts, &off) != 2 || !off || net_pos_parse(buf + off, &pos) < 0)
+            continue;
+
+        if (p->udp_rx > 0 && (int32_t)(seq - p->udp_rx_seq) <= 0) {
+            p->udp_old++;
+            continue;
+        }
+        p->udp_rx_seq = seq;
+        p->udp_rx++;
+
+        int32_t delay = (int32_t)((uint32_t)net_now_ms() - ts);
+        if (!p->udp_have_base || delay < p->udp_base_delay) {
+            p->udp_base_delay = delay;
+            p->udp_have_base = 1;
+        }
+        if (delay - p->udp_base_delay > NET_UDP_STALE_MS) {
+            p->udp_stale++;
+            // A lasting shift (route change, clock step) is the new normal
+            if (++p->udp_stale_run >= NET_UDP_STALE_RESET) {
+                p->udp_have_base = 0;
+                p->udp_stale_run = 0;
+            }
+            continue;
+        }
+        p->udp_stale_run = 0;
+        have = 1;
+        newest = pos;
+    }
+
+    if (have) net_forward_remote(ns, p, p->id, &newest);
+}
+
+/* ========================================================================
+ * NETWORK MODE: handshake and lock-step exchanges
+ * ======================================================================== */
+
+// SERVER: window size, with the pipelined (and UDP) offer
+void net_send_size(struct net_state *ns, struct net_peer *p) {
+    char sbuf[64];
+    int len = snprintf(sbuf, sizeof(sbuf), "size %d,%d", win_w, win_h);
+    if (net_env_flag("ARP_NET_PIPELINE", 1)) {
+        len += snprintf(sbuf + len, sizeof(sbuf) - len, " pipe");
+        if (net_env_flag("ARP_NET_UDP", 0) && p->udp_fd == -1) p->udp_fd = net_udp_open();
+        if (p->udp_fd != -1)
+            snprintf(sbuf + len, sizeof(sbuf) - len, " udp %d", net_udp_port(p->udp_fd));
+    }
+    LOG_INFO("SERVER: Sending window size to client %d...", p->id);
+    net_send(ns, p, sbuf);
+    net_expect(p, NET_WAIT_SOK);
+}
+
+/* NETWORK: one complete frame from a peer */
+void net_on_frame(struct net_state *ns, struct net_peer *p, const char *frame) {
+    char sbuf[64];
+
+    if (p->pipelined && net_pipe_on_frame(ns, p, frame)) return;
+
+    if (mode == SERVER) {
+        switch (p->wait) {
+        case NET_WAIT_OOK:
+            if (strcmp(frame, "ook") != 0) break;
+            LOG_INFO("SERVER: Handshake 'ok/ook' with client %d successful", p->id);
+            p->wait = NET_IDLE;
+            if (ns->size_known) net_send_size(ns, p);
+            return;
+        case NET_WAIT_SOK: {
+            int port;
+            if (strcmp(frame, "sok") == 0) {
+                LOG_INFO("SERVER: Received 'sok' from client %d (lock-step sync)", p->id);
+            } else if (strncmp(frame, "sok pipe", 8) == 0) {
+                LOG_INFO("SERVER: Received '%s' from client %d", frame, p->id);
+                net_pipe_start(p);
+                if (p->udp_fd != -1 && sscanf(frame, "sok pipe udp %d", &port) == 1)
+                    net_udp_start(ns, p, port);
+                net_relay_all(ns, p);
+            } else {
+                break;
+            }
+            if (!p->udp_on) net_udp_close(ns, p);
+            p->size_sent = 1;
+            p->wait = NET_IDLE;
+            return;
+        }
+        case NET_WAIT_OBST_POS:
+            LOG_DEBUG("NETWORK (SERVER): obstacle position received");
+            net_forward_frame(ns, p, frame);
+            net_send(ns, p, "pok");
+            p->wait = NET_IDLE;
+            return;
+        case NET_WAIT_DOK:
+            if (strcmp(frame, "dok") != 0) break;
+            LOG_DEBUG("SERVER: Received 'dok' from client");
+            p->wait = NET_IDLE;
+            return;
+        case NET_WAIT_QOK:
+            if (strcmp(frame, "qok") != 0) break;
+            LOG_INFO("SERVER: Received 'qok' from client %d", p->id);
+            net_peer_remove(ns, p);
+            return;
+        }
+        LOG_WARN("NETWORK (SERVER): unexpected frame '%s' from client %d (state %d)", frame, p->id, p->wait);
+        return;
+    }
+
+    /* CLIENT */
+    if (p->wait == NET_WAIT_DRONE_POS) {
+        net_forward_frame(ns, p, frame);
+        net_send(ns, p, "dok");
+        LOG_DEBUG("NETWORK (CLIENT): Sent 'dok' to server");
+        p->wait = NET_IDLE;
+        return;
+    }
+    if (p->wait == NET_WAIT_POK) {
+        p->wait = NET_IDLE;
+        if (strcmp(frame, "pok") == 0) {
+            LOG_DEBUG("NETWORK (CLIENT): Received 'pok' from server");
+            return;
+        }
+        // A request instead of the ack: handle it below
+    }
+
+    if (strcmp(frame, "q") == 0) {
+        LOG("CLIENT: Received exit command 'q'");
+        net_send(ns, p, "qok");
+        net_shutdown(ns);
+    } else if (strcmp(frame, "drone") == 0) {
+        net_expect(p, NET_WAIT_DRONE_POS);
+    } else if (strcmp(frame, "obst") == 0) {
+        LOG_DEBUG("NETWORK (CLIENT): Received 'obst' request from server");
+        snprintf(sbuf, sizeof(sbuf), "%d, %d", ns->drone.x, ns->drone.y);
+        net_send(ns, p, sbuf);
+        net_expect(p, NET_WAIT_POK);
+    } else {
+        LOG_WARN("NETWORK (CLIENT): unexpected frame '%s'", frame);
+    }
+}
+
+/**
+ * SERVER: start the next exchange with a client when it is idle, expire a
+ * reply that never came. Pipelined mode (both sides): push and acknowledge.
+ * Returns the ms until the next deadline (-1 = none).
+ */
+int net_tick_peer(struct net_state *ns, struct net_peer *p, unsigned long now) {
+    int ack_ms = p->pipelined ? net_pipe_tick(ns, p, now) : -1;
+    if (mode != SERVER) return ack_ms;
+
+    if (p->wait != NET_IDLE) {
+        unsigned long waited = now - p->wait_since_ms;
+        if (waited < NET_REPLY_TIMEOUT_MS) return (int)(NET_REPLY_TIMEOUT_MS - waited);
+        LOG_WARN("NETWORK (SERVER): no reply from client %d in state %d, giving up", p->id, p->wait);
+        if (p->wait == NET_WAIT_QOK || p->wait == NET_WAIT_OOK) {
+            net_peer_remove(ns, p);
+            return -1;
+        }
+        p->wait = NET_IDLE;
+    }
+
+    if (ns->quit_requested) {
+        LOG_INFO("SERVER: Initiating shutdown protocol with client %d...", p->id);
+        net_send(ns, p, "q");
+        net_expect(p, NET_WAIT_QOK);
+        return NET_REPLY_TIMEOUT_MS;
+    }
+    if (!p->size_sent) return -1;
+    if (p->pipelined) return ack_ms;
+
+    /* NETWORK: Obstacle request (20Hz) */
+    if (now - p->last_obst_ms >= OBST_SYNC_MS) {
+        net_send(ns, p, "obst");
+        LOG_DEBUG("NETWORK (SERVER): Sent 'obst' request to client");
+        p->last_obst_ms = now;
+        net_expect(p, NET_WAIT_OBST_POS);
+        return NET_REPLY_TIMEOUT_MS;
+    }
+
+    /* NETWORK: Drone sync (10Hz) */
+    if (now - p->last_drone_ms >= DRONE_SYNC_MS) {
+        char sbuf[64];
+        net_send(ns, p, "drone");
+        snprintf(sbuf, sizeof(sbuf), "%d, %d", ns->drone.x, ns->drone.y);
+        net_send(ns, p, sbuf);
+        LOG_DEBUG("NETWORK (SERVER): Sent server drone position to client");
+        p->last_drone_ms = now;
+        net_expect(p, NET_WAIT_DOK);
+        return NET_REPLY_TIMEOUT_MS;
+    }
+
+    unsigned long next_obst = p->last_obst_ms + OBST_SYNC_MS - now;
+    unsigned long next_drone = p->last_drone_ms + DRONE_SYNC_MS - now;
+    return (int)(next_obst < next_drone ? next_obst : next_drone);
+}
+
+// Earliest deadline over every connection (-1 = none)
+int net_tick(struct net_state *ns) {
+    unsigned long now = net_now_ms();
+    int timeout = -1;
+    for (int i = 0; i < NET_MAX_PEERS && ns->running; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p->conn.fd == -1) continue;
+        int t = net_tick_peer(ns, p, now);
+        if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+    }
+    return timeout;
+}
+
+// SERVER: accept every pending client, the handshake goes on in the loop
+void net_accept(struct net_state *ns) {
+    while (1) {
+        int fd = accept4(ns->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) LOG_ERROR("accept: %s", strerror(errno));
+            return;
+        }
+        struct net_peer *p = net_peer_add(ns, fd);
+        if (!p) {
+            LOG_WARN("SERVER: %d clients already connected, connection refused", NET_MAX_PEERS);
+            close(fd);
+            continue;
+        }
+        LOG_INFO("SERVER: client %d connected, %d connected", p->id, net_peer_count(ns));
+        net_send(ns, p, "ok");
+        net_expect(p, NET_WAIT_OOK);
+    }
+}
+
+// Socket events of one connection
+void net_on_peer_event(struct net_state *ns, struct net_peer *p, uint32_t events) {
+    if (p->conn.fd == -1) return;
+
+    if (events & EPOLLOUT) {
+        if (netconn_flush(&p->conn) < 0) {
+            net_peer_lost(ns, p, "lost while sending");
+            return;
+        }
+        net_relay_flush(ns, p);
+        net_watch(ns, p);
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char frame[NETCONN_FRAME_MAX];
+        netconn_fill(&p->conn);
+        while (ns->running && p->conn.fd != -1 && netconn_next_frame(&p->conn, frame, sizeof(frame)))
+            net_on_frame(ns, p, frame);
+        if (ns->running && p->conn.fd != -1 && p->conn.eof)
+            net_peer_lost(ns, p, "closed the connection");
+    }
+}
+
+/* NETWORK: Window Size Handshake (SERVER only) */
+void net_on_resize(const struct msg *m, void *ctx) {
+    struct net_state *ns = ctx;
+    if (mode != SERVER || ns->size_known || m->src != IDX_M) return;
+
+    const struct pl_size *sz = MSG_PL(m, const struct pl_size);
+    win_w = sz->w;
+    win_h = sz->h;
+    ns->size_known = 1;
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p->conn.fd != -1 && p->wait == NET_IDLE && !p->size_sent) net_send_size(ns, p);
+    }
+}
+
+/* NETWORK: ESC Key Shutdown Protocol */
+void net_on_key(const struct msg *m, void *ctx) {
+    struct net_state *ns = ctx;
+    if (m->src != IDX_I || MSG_PL(m, const struct pl_key)->key != 27) return;
+
+    LOG("MAIN: ESC detected");
+    if (mode == SERVER && net_peer_count(ns) > 0) {
+        // "q" goes out to each client as soon as its pending exchange completes
+        ns->quit_requested = 1;
+        if (ns->listen_fd != -1) {
+            epoll_ctl(ns->epfd, EPOLL_CTL_DEL, ns->listen_fd, NULL);
+            close(ns->listen_fd);
+            ns->listen_fd = -1;
+        }
+        return;
+    }
+    net_shutdown(ns);
+}
+
+// Pipelined peers get our drone as soon as it changed
+void net_push_all(struct net_state *ns) {
+    ns->sent_vx = ns->drone.vx;
+    ns->sent_vy = ns->drone.vy;
+    for (int i = 0; i < NET_MAX_PEERS; i++) {
+        struct net_peer *p = &ns->peers[i];
+        if (p->conn.fd == -1 || !p->pipelined) continue;
+        p->pos_dirty = 1;
+        net_pipe_push(ns, p);
+    }
+}
+
+/* NETWORK: Track the local drone (lock-step: 'drone' sync / 'obst' replies, pipelined: pushed) */
+void net_on_drone_pos(const struct msg *m, void *ctx) {
+    struct net_state *ns = ctx;
+    if (m->src != IDX_B) return;
+
+    const struct pl_pos *pos = MSG_PL(m, const struct pl_pos);
+    if (pos->x == ns->drone.x && pos->y == ns->drone.y) return;
+    ns->drone.x = pos->x;
+    ns->drone.y = pos->y;
+    net_push_all(ns);
+}
+
+/* NETWORK: Track the local drone velocity (STATS forwarded by the Blackboard) */
+void net_on_stats(const struct msg *m, void *ctx) {
+    struct net_state *ns = ctx;
+    if (m->src != IDX_B) return;
+
+    const struct pl_stats *st = MSG_PL(m, const struct pl_stats);
+    ns->drone.vx = st->vx;
+    ns->drone.vy = st->vy;
+    ns->drone.has_vel = 1;
+    // A stop must go out even inside a cell, or the peers keep extrapolating
+    if (fabsf(st->vx - ns->sent_vx) < NET_VEL_EPS && fabsf(st->vy - ns->sent_vy) < NET_VEL_EPS &&
+        ((st->vx == 0 && st->vy == 0) == (ns->sent_vx == 0 && ns->sent_vy == 0)))
+        return;
+    net_push_all(ns);
+}
+
+const msg_handler net_handlers[MSG_TYPE_COUNT] = {
+    [MSG_RESIZE]    = net_on_resize,
+    [MSG_KEY]       = net_on_key,
+    [MSG_DRONE_POS] = net_on_drone_pos,
+    [MSG_STATS]     = net_on_stats,
+};
+
+int main(int argc, char *argv[]){
+    int opt;
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        if (opt == 't' && strcmp(optarg, "shm") == 0) {
+            transport = TRANSPORT_SHM;
+        } else if (opt == 't' && strcmp(optarg, "pipe") == 0) {
+            transport = TRANSPORT_PIPE;
+        } else {
+            fprintf(stderr, "Usage: %s [-t pipe|shm]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    subscriptions_init();
+    net_init(&net);
+
     unlink("log/watchdog.log");
     unlink("log/processes_pid.log");
     unlink("log/system.log");
+    trace_remove_files();
     while (1) {
         printf("Choose the mode: 0->STANDALONE, 1->SERVER, 2->CLIENT\n");
         fflush(stdout);
@@ -138,65 +1383,69 @@ int main(){
      * ========================================================================
      * STANDALONE mode: Skip all network setup
      * ======================================================================== */
-    int sockfd, newsockfd, clilen, n;
+    int sockfd, newsockfd;
+    socklen_t clilen;
     struct sockaddr_in serv_addr, cli_addr;
     struct hostent *server;
-    char msg_sock[100];
+    struct net_peer *first = NULL;
 
     /* ========================================================================
      * SERVER MODE
      * ======================================================================== */
     if(mode == SERVER) {
         /* SERVER socket initialization */
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
         if (sockfd < 0) 
-            LOG("ERROR opening socket");
+            LOG_ERROR("opening socket");
+        int one = 1;
+        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
         memset(&serv_addr, 0, sizeof(serv_addr));
         serv_addr.sin_family = AF_INET;
         serv_addr.sin_addr.s_addr = INADDR_ANY;
-        serv_addr.sin_port = htons(DEFAULT_PORT);
+        serv_addr.sin_port = htons(net_port());
         if (bind(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) 
-            LOG("ERROR on binding");
-        listen(sockfd,5);
+            LOG_ERROR("on binding");
+        listen(sockfd, NET_MAX_PEERS);
         clilen = sizeof(cli_addr);
         
-        /* SERVER: Wait for client connection */
-        LOG("[SERVER] Waiting for the client to connect");
-        newsockfd = accept(sockfd, (struct sockaddr *) &cli_addr, &clilen);
+        /* SERVER: Wait for the first client, the others join from the main loop */
+        LOG_INFO("[SERVER] Waiting for the client to connect on port %d", net_port());
+        newsockfd = accept4(sockfd, (struct sockaddr *) &cli_addr, &clilen, SOCK_CLOEXEC);
         if (newsockfd < 0) {
-            LOG("ERROR connecting");
+            LOG_ERROR("connecting");
             exit(0);
         }
         LOG("Connected to the client");
+        first = net_peer_add(&net, newsockfd);
+
+        /* SERVER: Keep listening for more clients */
+        fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = NET_TAG_LISTEN };
+        epoll_ctl(net.epfd, EPOLL_CTL_ADD, sockfd, &ev);
+        net.listen_fd = sockfd;
         
         /* SERVER: Initial handshake - send "ok", wait for "ook" */
-        char buf[128];
-        snprintf(buf, sizeof(buf), "ok");
-        if (write(newsockfd, buf, strlen(buf)+1) < 0) LOG("ERROR writing 'ok' to socket");
-        
-        memset(buf, 0, sizeof(buf));
-        if (read_line(newsockfd, buf, sizeof(buf)) < 0) LOG("ERROR reading 'ook' from socket");
+        char buf[NETCONN_FRAME_MAX] = "";
+        if (netconn_send(&first->conn, "ok") < 0) LOG_ERROR("writing 'ok' to socket");
+        if (netconn_wait_frame(&first->conn, buf, sizeof(buf), -1) < 0) LOG_ERROR("reading 'ook' from socket");
         if (strcmp(buf, "ook") == 0) {
             LOG("Handshake 'ok/ook' successful");
         } else {
-            char elog[128];
-            snprintf(elog, sizeof(elog), "Handshake failed: expected 'ook', got '%s'", buf);
-            LOG(elog);
+            LOG_ERROR("Handshake failed: expected 'ook', got '%s'", buf);
         }
-        network_fd = newsockfd;
     }
     /* ========================================================================
      * CLIENT MODE
      * ======================================================================== */
     else if (mode == CLIENT) {
         /* CLIENT socket initialization */
-        sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) LOG("ERROR opening socket");
+        sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sockfd < 0) LOG_ERROR("opening socket");
     
         /* CLIENT: Resolve server hostname */
-        server = gethostbyname(HOST_NAME);
+        server = gethostbyname(net_host());
         if (server == NULL) {
-            LOG("ERROR, no such host\n");
+            LOG_ERROR("no such host '%s'", net_host());
             exit(0);
         }
     
@@ -206,28 +1455,24 @@ int main(){
         memcpy(&serv_addr.sin_addr.s_addr, 
                 server->h_addr_list[0], 
                 server->h_length);
-        serv_addr.sin_port = htons(DEFAULT_PORT);
+        serv_addr.sin_port = htons(net_port());
     
         if (connect(sockfd,(struct sockaddr *)&serv_addr,sizeof(serv_addr)) < 0) {
-            LOG("ERROR connecting");
+            LOG_ERROR("connecting");
             exit(0);
         }
         LOG("Connected to the server");
     
         /* CLIENT: Initial handshake - wait for "ok", send "ook" */
-        char buf[128];
-        memset(buf, 0, sizeof(buf));
-        if (read_line(sockfd, buf, sizeof(buf)) < 0) LOG("ERROR reading 'ok' from socket");
+        first = net_peer_add(&net, sockfd);
+        char buf[NETCONN_FRAME_MAX] = "";
+        if (netconn_wait_frame(&first->conn, buf, sizeof(buf), -1) < 0) LOG_ERROR("reading 'ok' from socket");
         if (strcmp(buf, "ok") == 0) {
-            snprintf(buf, sizeof(buf), "ook");
-            if (write(sockfd, buf, strlen(buf)+1) < 0) LOG("ERROR writing 'ook' to socket");
+            if (netconn_send(&first->conn, "ook") < 0) LOG_ERROR("writing 'ook' to socket");
             LOG("Handshake 'ok/ook' successful");
         } else {
-            char elog[128];
-            snprintf(elog, sizeof(elog), "Handshake failed: expected 'ok', got '%s'", buf);
-            LOG(elog);
+            LOG_ERROR("Handshake failed: expected 'ok', got '%s'", buf);
         }
-        network_fd = sockfd;
     }
     
     signal(SIGPIPE, SIG_IGN);
@@ -238,45 +1483,54 @@ int main(){
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+    router_watch_children();
 
-    // Pipe creation
+    // Edge creation (pipes or shared-memory rings)
     for (int i = 0; i < NUM_PROCESSES; i++) {
-        if (pipe(pipe_parent_to_child[i]) == -1 ||
-            pipe(pipe_child_to_parent[i]) == -1) {
-            perror("pipe");
+        if (link_create(&link_parent_to_child[i], transport) == -1 ||
+            link_create(&link_child_to_parent[i], transport) == -1) {
+            perror("link_create");
             exit(EXIT_FAILURE);
         }
+        link_open(&link_parent_to_child[i], 1, &to_child[i]);
+        link_open(&link_child_to_parent[i], 0, &from_child[i]);
+        channel_set_nonblock(&from_child[i]);
+        // A full edge is handled by the router's output queue, not by blocking
+        channel_set_nonblock(&to_child[i]);
+        channel_set_capacity(&to_child[i], ROUTER_PIPE_SIZE);
     }
-    LOG("Pipes created");
+    LOG(transport == TRANSPORT_SHM ? "Shared-memory rings created" : "Pipes created");
 
-    for (int i = 0; i < NUM_PROCESSES; i++) {
-        int flags = fcntl(pipe_child_to_parent[i][0], F_GETFL, 0);
-        fcntl(pipe_child_to_parent[i][0], F_SETFL, flags | O_NONBLOCK);
-    }
-
-    char fd_pc[NUM_PROCESSES][16];
-    char fd_cp[NUM_PROCESSES][16];
+    char fd_pc[NUM_PROCESSES][32];
+    char fd_cp[NUM_PROCESSES][32];
     char mode_str[16];
     sprintf(mode_str, "%d", mode);
 
-    // String conversion for file descriptors
+    // Layout seed shared by Obstacles and Targets: ARP_LAYOUT_SEED replays a run
+    char seed_str[32];
+    const char *seed_env = getenv("ARP_LAYOUT_SEED");
+    unsigned long long layout_seed = (seed_env && *seed_env) ? strtoull(seed_env, NULL, 10)
+                                                            : (unsigned long long)(time(NULL) ^ getpid());
+    sprintf(seed_str, "%llu", layout_seed);
+    if (mode == STANDALONE) LOG_INFO("Layout seed %s", seed_str);
+
+    // Blackboard state shared with the Drone, the Map and the generators ("-": replicated with messages)
+    char bb_shm_str[16] = "-";
+    bb_shm_fd = bb_shm_create();
+    if (bb_shm_fd != -1) sprintf(bb_shm_str, "%d", bb_shm_fd);
+    else perror("bb_shm_create");
+
+    // Spec strings for the child ends (fd number or shm ring descriptors)
     for (int i = 0; i < NUM_PROCESSES; i++) {
-        sprintf(fd_pc[i], "%d", pipe_parent_to_child[i][0]); // Reading end
-        sprintf(fd_cp[i], "%d", pipe_child_to_parent[i][1]); // Writing end
+        link_spec(&link_parent_to_child[i], 0, fd_pc[i], sizeof(fd_pc[i])); // Reading end
+        link_spec(&link_child_to_parent[i], 1, fd_cp[i], sizeof(fd_cp[i])); // Writing end
     }
 
     //WATCHDOG
     if (mode == STANDALONE) {
         pid_W = fork();
         if (pid_W == 0) {
-            for (int i = 0; i < NUM_PROCESSES; i++) {
-                if (i != IDX_W) {
-                    close(pipe_parent_to_child[i][0]);
-                    close(pipe_parent_to_child[i][1]);
-                    close(pipe_child_to_parent[i][0]);
-                    close(pipe_child_to_parent[i][1]);
-                }
-            }
+            close_other_links(IDX_W);
             execl("./build/Watchdog", "./build/Watchdog", fd_pc[IDX_W], fd_cp[IDX_W], NULL);
             perror("execl watchdog");
             exit(EXIT_FAILURE);
@@ -295,25 +1549,33 @@ int main(){
      * ======================================================================== */
     if (mode == CLIENT) {
         LOG("CLIENT: Waiting for window size from server...");
-        char buf[128];
-        memset(buf, 0, sizeof(buf));
-        if (read_line(network_fd, buf, sizeof(buf)) < 0) {
-            perror("read size from server");
+        char buf[NETCONN_FRAME_MAX] = "";
+        if (netconn_wait_frame(&first->conn, buf, sizeof(buf), -1) < 0) {
+            LOG_ERROR("read size from server");
         }
         if (strncmp(buf, "size", 4) == 0) {
             sscanf(buf, "size %d,%d", &win_w, &win_h);
-            char slog[128];
-            snprintf(slog, sizeof(slog), "CLIENT: Received window size: %dx%d", win_w, win_h);
-            LOG(slog);
-
-            /* CLIENT: Send acknowledgment */
-            snprintf(buf, sizeof(buf), "sok");
-            write(network_fd, buf, strlen(buf)+1);
-            LOG("CLIENT: Sent 'sok' acknowledgment");
+            LOG_INFO("CLIENT: Received window size: %dx%d", win_w, win_h);
+
+            /* CLIENT: Send acknowledgment, accepting pipelined sync if offered */
+            char *udp = strstr(buf, " udp ");
+            int port;
+            if (strstr(buf, " pipe") && net_env_flag("ARP_NET_PIPELINE", 1)) {
+                char reply[64] = "sok pipe";
+                if (udp && sscanf(udp, " udp %d", &port) == 1 && net_env_flag("ARP_NET_UDP", 1) &&
+                    (first->udp_fd = net_udp_open()) != -1) {
+                    snprintf(reply, sizeof(reply), "sok pipe udp %d", net_udp_port(first->udp_fd));
+                    net_udp_start(&net, first, port);
+                }
+                netconn_send(&first->conn, reply);
+                net_pipe_start(first);
+                LOG_INFO("CLIENT: Sent '%s' acknowledgment", reply);
+            } else {
+                netconn_send(&first->conn, "sok");
+                LOG("CLIENT: Sent 'sok' acknowledgment");
+            }
         } else {
-            char elog[128];
-            snprintf(elog, sizeof(elog), "CLIENT: Handshake failed: expected 'size', got '%s'", buf);
-            LOG(elog);
+            LOG_ERROR("CLIENT: Handshake failed: expected 'size', got '%s'", buf);
         }
     }
 
@@ -321,19 +1583,10 @@ int main(){
     pid_B = fork();
     if (pid_B == 0) {
         // 
-        for (int i = 0; i < NUM_PROCESSES; i++) {
-            if (i != IDX_B) {
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_parent_to_child[i][1]);
-                close(pipe_child_to_parent[i][0]);
-                close(pipe_child_to_parent[i][1]);
-            }
-        }
-        close(pipe_parent_to_child[IDX_B][1]);
-        close(pipe_child_to_parent[IDX_B][0]);
+        close_other_links(IDX_B);
 
         // argv[1]=read_fd, argv[2]=write_fd
-        execl("./build/Blackboard", "./build/Blackboard", fd_pc[IDX_B], fd_cp[IDX_B], watchdog_pid, mode_str, NULL);
+        execl("./build/Blackboard", "./build/Blackboard", fd_pc[IDX_B], fd_cp[IDX_B], watchdog_pid, mode_str, bb_shm_str, NULL);
         perror("execl blackboard");
         _exit(EXIT_FAILURE);
     }
@@ -345,9 +1598,10 @@ int main(){
      * ======================================================================== */
     if (mode == CLIENT) {
         struct msg mb_size;
-        mb_size.src = IDX_M;
-        snprintf(mb_size.data, MSG_SIZE, "RESIZE %d %d", win_w, win_h);
-        write(pipe_parent_to_child[IDX_B][1], &mb_size, sizeof(mb_size));
+        msg_init(&mb_size, IDX_M, MSG_RESIZE, sizeof(struct pl_size));
+        MSG_PL(&mb_size, struct pl_size)->w = win_w;
+        MSG_PL(&mb_size, struct pl_size)->h = win_h;
+        channel_send(&to_child[IDX_B], &mb_size);
         LOG("CLIENT: Forwarded received window size to Blackboard");
     }
 
@@ -355,20 +1609,11 @@ int main(){
     pid_D = fork();
     if (pid_D == 0){
         // 
-        for (int i = 0; i < NUM_PROCESSES; i++) {
-            if (i != IDX_D) {
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_parent_to_child[i][1]);
-                close(pipe_child_to_parent[i][0]);
-                close(pipe_child_to_parent[i][1]);
-            }
-        }
+        close_other_links(IDX_D);
 
-        close(pipe_parent_to_child[IDX_D][1]);
-        close(pipe_child_to_parent[IDX_D][0]);
         // 
         // 
-        execl("./build/Drone", "./build/Drone", fd_pc[IDX_D], fd_cp[IDX_D], watchdog_pid, mode_str, NULL);
+        execl("./build/Drone", "./build/Drone", fd_pc[IDX_D], fd_cp[IDX_D], watchdog_pid, mode_str, bb_shm_str, NULL);
         perror("execl drone");
         exit(EXIT_FAILURE);
     }
@@ -377,17 +1622,8 @@ int main(){
     //KEYBOARD
     pid_I = fork();
     if (pid_I == 0)  {
-        for (int i = 0; i < NUM_PROCESSES; i++) {
-            if (i != IDX_I) {
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_parent_to_child[i][1]);
-                close(pipe_child_to_parent[i][0]);
-                close(pipe_child_to_parent[i][1]);
-            }
-        }
+        close_other_links(IDX_I);
         
-        close(pipe_parent_to_child[IDX_I][1]); // Keyboard doesn't write to parent->child
-        close(pipe_child_to_parent[IDX_I][0]); // Keyboard doesn't read from child->parent
 
         //
         execlp("konsole", "konsole", "-e", "./build/I_Keyboard",
@@ -400,23 +1636,14 @@ int main(){
     //MAP
     pid_M = fork();
     if (pid_M == 0) {
-        for (int i = 0; i < NUM_PROCESSES; i++) {
-            if (i != IDX_M) {
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_parent_to_child[i][1]);
-                close(pipe_child_to_parent[i][0]);
-                close(pipe_child_to_parent[i][1]);
-            }
-        }
+        close_other_links(IDX_M);
         // 
-        close(pipe_parent_to_child[IDX_M][1]); // Child doesn't write to parent->child
-        close(pipe_child_to_parent[IDX_M][0]); // Child doesn't read from child->parent
 
         char win_w_str[16], win_h_str[16];
         sprintf(win_w_str, "%d", win_w);
         sprintf(win_h_str, "%d", win_h);
 
-        execlp("konsole", "konsole", "-e", "./build/map", fd_pc[IDX_M], fd_cp[IDX_M], watchdog_pid, mode_str, win_w_str, win_h_str, NULL);
+        execlp("konsole", "konsole", "-e", "./build/map", fd_pc[IDX_M], fd_cp[IDX_M], watchdog_pid, mode_str, win_w_str, win_h_str, bb_shm_str, NULL);
         perror("execl konsole map");
         _exit(EXIT_FAILURE);
     }
@@ -426,18 +1653,9 @@ int main(){
     if (mode == STANDALONE) {
         pid_O = fork();
         if (pid_O == 0) {
-            for (int i = 0; i < NUM_PROCESSES; i++) {
-                if (i != IDX_O) {
-                    close(pipe_parent_to_child[i][0]);
-                    close(pipe_parent_to_child[i][1]);
-                    close(pipe_child_to_parent[i][0]);
-                    close(pipe_child_to_parent[i][1]);
-                }
-            }
+            close_other_links(IDX_O);
 
-            close(pipe_parent_to_child[IDX_O][1]);
-            close(pipe_child_to_parent[IDX_O][0]);
-            execl("./build/Obstacles", "./build/Obstacles", fd_pc[IDX_O], fd_cp[IDX_O], watchdog_pid, NULL);
+            execl("./build/Obstacles", "./build/Obstacles", fd_pc[IDX_O], fd_cp[IDX_O], watchdog_pid, seed_str, bb_shm_str, NULL);
             perror("execl obstacle");
             exit(EXIT_FAILURE);
         }
@@ -448,29 +1666,25 @@ int main(){
     if (mode == STANDALONE) {
         pid_T = fork();
         if (pid_T == 0) {
-            for (int i = 0; i < NUM_PROCESSES; i++) {
-                if (i != IDX_T) {
-                    close(pipe_parent_to_child[i][0]);
-                    close(pipe_parent_to_child[i][1]);
-                    close(pipe_child_to_parent[i][0]);
-                    close(pipe_child_to_parent[i][1]);
-                }
-            }
+            close_other_links(IDX_T);
 
-            close(pipe_parent_to_child[IDX_T][1]);
-            close(pipe_child_to_parent[IDX_T][0]);
-            execl("./build/Targets", "./build/Targets", fd_pc[IDX_T], fd_cp[IDX_T], watchdog_pid, NULL);
+            execl("./build/Targets", "./build/Targets", fd_pc[IDX_T], fd_cp[IDX_T], watchdog_pid, seed_str, bb_shm_str, NULL);
             perror("execl targets");
             exit(EXIT_FAILURE);
         }
         LOG("Targets fork");
     }
+    // The router never reads the shared state
+    if (bb_shm_fd != -1) {
+        close(bb_shm_fd);
+        bb_shm_fd = -1;
+    }
 
     if (mode == STANDALONE){
         // PARENT PROCESS MAIN LOOP
         for (int i = 0; i < NUM_PROCESSES; i++) {
-            close(pipe_parent_to_child[i][0]);
-            close(pipe_child_to_parent[i][1]);
+            link_close_end(&link_parent_to_child[i], 0);
+            link_close_end(&link_child_to_parent[i], 1);
         }
 
         route_t route_table[NUM_PROCESSES];
@@ -488,94 +1702,70 @@ int main(){
 
         LOG("Route table created");
 
-        while (1) {
-            LOG("waiting for a message to redirect");
-            fd_set rfds;
-            FD_ZERO(&rfds);
-
-            int maxfd = -1;
+        // Edge-triggered epoll over every child->parent edge
+        int epfd = epoll_create1(0);
+        if (epfd == -1) {
+            perror("epoll_create1");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < NUM_PROCESSES; i++) {
+            if (from_child[i].fd < 0) continue;
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.u32 = i };
+            epoll_ctl(epfd, EPOLL_CTL_ADD, from_child[i].fd, &ev);
+        }
+        router_watch_epoll(epfd);
 
-            // The parent must monitor all read ends of child->parent pipes
-            for (int i = 0; i < NUM_PROCESSES; i++) {
-                int fd = pipe_child_to_parent[i][0];
-                if (fd >= 0) {
-                    FD_SET(fd, &rfds);
-                    if (fd > maxfd) maxfd = fd;
-                }
-            }
+        struct router_stats stats = {0};
+        int esc_received = 0;
+        int timeout = -1;
 
-            // Wait for a message from ANY child
-            int ret = select(maxfd + 1, &rfds, NULL, NULL, NULL);
+        while (!esc_received) {
+            struct epoll_event evs[2 * NUM_PROCESSES];
+            int ret = epoll_wait(epfd, evs, 2 * NUM_PROCESSES, timeout);
             if (ret < 0) {
-                perror("select");
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
                 break;
             }
 
-            int esc_received = 0;
-            // Check which child sent data
-            for (int src = 0; src < NUM_PROCESSES; src++) {
-                int read_fd = pipe_child_to_parent[src][0];
-
-                if (FD_ISSET(read_fd, &rfds)) {
-                    struct msg m;
-                    int n = read(read_fd, &m, sizeof(m));
-
-                    if (n <= 0) {
-                        // Child terminated -> close its reading end
-                        close(read_fd);
-                        pipe_child_to_parent[src][0] = -1;
-                        continue;
-                    }
-
-                    if (src == IDX_I) {
-                        char dbg[64];
-                        snprintf(dbg, sizeof(dbg), "DEBUG: Main read from Keyboard: %d bytes, key=%c", n, m.data[0]);
-                        LOG(dbg);
-                    }
-
-                    if (strncmp(m.data, "ESC", 3) == 0){
-                        printf("ESC RECEIVED\n");
-                        esc_received = 1;
-                    }
-
-                    // Destination from route_table
-                    for (int d = 0; d < route_table[src].num; d++) {
-                        int dst = route_table[src].dest[d];
-                        int write_fd = pipe_parent_to_child[dst][1];
-
-                        ssize_t w = write(write_fd, &m, sizeof(m));
-                        if (w == -1) {
-                            perror("write to child");
-                            fprintf(stderr, "SIGPIPE likely on src=%d -> dst=%d fd=%d\n", src, dst, write_fd);
-                        } else if (w != n) {
-                            fprintf(stderr, "Partial write src=%d -> dst=%d fd=%d written=%zd expected=%d\n",
-                                src, dst, write_fd, w, n);
-                        } else {
-                            // Confirm write success
-                            if (src == IDX_I) {
-                                char tlog[128];
-                                snprintf(tlog, sizeof(tlog), "DEBUG: Main routed Keyboard msg (src=%d, key=%c) to BB (fd=%d)", m.src, m.data[0], write_fd);
-                                LOG(tlog);
-                            }
-                        }
-                        char log_msg[128];
-                        snprintf(log_msg, sizeof(log_msg), "Message redirected from %s to %s", process_names[src], process_names[dst]);
-                        LOG(log_msg);
-                    }
-                    
+            // Edge-triggered: every ready edge must be drained until EAGAIN
+            unsigned long routed = 0;
+            for (int e = 0; e < ret; e++) {
+                if (evs[e].data.u32 == ROUTER_CHILD_TAG) {
+                    router_reap(epfd);
+                    continue;
                 }
-            }
-            if (esc_received){
-                LOG("ESC received, closing...");
-                for (int i = 0; i < NUM_PROCESSES; i++) {
-                    int write_fd = pipe_parent_to_child[i][1];
-                    struct msg esc_msg;
-                    esc_msg.src = IDX_B;
-                    strncpy(esc_msg.data, "ESC", MSG_SIZE);
-                    write(write_fd, &esc_msg, sizeof(esc_msg));
+                // Writable parent->child edge: handled by the flush below
+                if (evs[e].data.u32 & ROUTER_OUT_TAG) continue;
+                int src = evs[e].data.u32;
+                int fd = from_child[src].fd;
+                long n = route_drain(src, route_table, &esc_received, &stats);
+                if (n < 0) {
+                    // Child terminated -> close its reading end
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+                    channel_close(&from_child[src]);
+                    continue;
                 }
-                break;
+                routed += n;
             }
+            if (ret > 0) router_stats_update(&stats, routed);
+            timeout = outq_flush_all(epfd);
+        }
+        router_stats_log(&stats);
+        close(epfd);
+
+        if (esc_received){
+            LOG("ESC received, closing...");
+            struct msg esc_msg;
+            msg_init(&esc_msg, IDX_B, MSG_ESC, 0);
+            for (int i = 0; i < NUM_PROCESSES; i++) {
+                // Stale state is useless now, ESC goes after the pending control messages
+                outq[i].latest_mask = 0;
+                route_send(i, &esc_msg, 1, &stats);
+            }
+            // Give slow children a bounded time to take it
+            for (int tries = 0; tries < 50 && outq_flush_all(-1) != -1; tries++)
+                usleep(ROUTER_RETRY_MS * 1000);
         }
     }
     /* ========================================================================
@@ -587,19 +1777,13 @@ int main(){
         else
             LOG("[CLIENT] Creating route table");
 
-        /* NETWORK: Close unused process pipes (Obstacles, Targets, Watchdog) */
+        /* NETWORK: Close unused process edges (Obstacles, Targets, Watchdog) */
         for (int i = 0; i < NUM_PROCESSES; i++) {
+            link_close_end(&link_parent_to_child[i], 0);
+            link_close_end(&link_child_to_parent[i], 1);
             if (i == IDX_O || i == IDX_T || i == IDX_W){
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_parent_to_child[i][1]);
-                close(pipe_child_to_parent[i][0]);
-                close(pipe_child_to_parent[i][1]);
-
-                pipe_parent_to_child[i][1] = -1;
-                pipe_child_to_parent[i][0] = -1;
-            } else {
-                close(pipe_parent_to_child[i][0]);
-                close(pipe_child_to_parent[i][1]);
+                channel_close(&to_child[i]);
+                channel_close(&from_child[i]);
             }
         }
 
@@ -616,262 +1800,108 @@ int main(){
         route_table[IDX_B].dest[route_table[IDX_B].num++] = IDX_O; // BB->Remote (virtual)
         route_table[IDX_O].dest[route_table[IDX_O].num++] = IDX_B; // Remote->BB (virtual)
         
-        /* NETWORK: State tracking variables */
-        static int size_sent = 0;                    // SERVER: Window size sent to CLIENT
-        static int local_drone_x = 0, local_drone_y = 0;  // CLIENT: Local drone position
-        static int server_drone_x = 0, server_drone_y = 0; // SERVER: Server drone position
-        static int server_drone_dirty = 0;           // SERVER: Drone position changed flag
-        
-        static unsigned long last_drone_ms = 0;      // Timestamp for drone sync
-        static unsigned long last_obst_ms = 0;       // Timestamp for obstacle request
+        struct router_stats stats = {0};
+        int timeout = -1;
+        net.stats = &stats;
 
-        /* NETWORK: Main event loop */
-        int running = 1;
-        while(running){
-            fd_set rfds;
-            FD_ZERO(&rfds);
-            int maxfd = -1;
-            
-            /* NETWORK: Monitor local process pipes */
-            for (int i = 0; i<NUM_PROCESSES; i++){
-                int fd = pipe_child_to_parent[i][0];
-                if(fd != -1){
-                    FD_SET(fd, &rfds);
-                    if (fd > maxfd) maxfd = fd;
-                }
-            }
-            
-            /* NETWORK: Monitor network socket for remote messages */
-            if (network_fd > 0){
-                FD_SET(network_fd, &rfds);
-                if (network_fd > maxfd) maxfd = network_fd;
-            }
+        /* NETWORK: children, connections and the listening socket share one epoll */
+        for (int i = 0; i < NUM_PROCESSES; i++) {
+            if (from_child[i].fd < 0) continue;
+            struct epoll_event ev = { .events = EPOLLIN | EPOLLET, .data.u32 = i };
+            epoll_ctl(net.epfd, EPOLL_CTL_ADD, from_child[i].fd, &ev);
+        }
+        router_watch_epoll(net.epfd);
 
-            /* Wait for activity on pipes or network socket */
-            int ret = select(maxfd +1, &rfds, NULL, NULL, NULL);
+        /* NETWORK: Main event loop */
+        net.running = 1;
+        while(net.running){
+            /* NETWORK: Sleep until the next protocol deadline or router retry */
+            int wait_ms = net_tick(&net);
+            if (!net.running) break;
+            if (timeout >= 0 && (wait_ms < 0 || timeout < wait_ms)) wait_ms = timeout;
+
+            struct epoll_event evs[2 * NUM_PROCESSES + 2 * NET_MAX_PEERS + 1];
+            int ret = epoll_wait(net.epfd, evs, sizeof(evs) / sizeof(evs[0]), wait_ms);
             if (ret < 0) {
-                perror("select server");
+                if (errno == EINTR) continue;
+                perror("epoll_wait network");
                 break;
             }
 
-            /* ====================================================================
-             * NETWORK PROTOCOL: CLIENT Message Handling
-             * ==================================================================== */
-            if (mode == CLIENT && network_fd > 0 && FD_ISSET(network_fd, &rfds)) {
-                char sbuf[128];
-                memset(sbuf, 0, sizeof(sbuf));
-                if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                    /* NETWORK: Handle exit command */
-                    if (strncmp(sbuf, "q", 1) == 0) {
-                        LOG("CLIENT: Received exit command 'q'");
-                        snprintf(sbuf, sizeof(sbuf), "qok");
-                        write(network_fd, sbuf, strlen(sbuf) + 1);
-                        LOG("MAIN (CLIENT): Cleaning up children...");
-                        clean_children();
-                        running = 0;
-                    }
-                    /* NETWORK: Receive SERVER drone position */
-                    else if (strncmp(sbuf, "drone", 5) == 0) {
-                        memset(sbuf, 0, sizeof(sbuf));
-                        if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                            int dx, dy;
-                            if (sscanf(sbuf, "%d, %d", &dx, &dy) == 2) {
-                                /* NETWORK: Acknowledge receipt */
-                                snprintf(sbuf, sizeof(sbuf), "dok");
-                                write(network_fd, sbuf, strlen(sbuf) + 1);
-                                LOG("NETWORK (CLIENT): Received 'dok' from server");
-                                /* NETWORK: Forward to Blackboard as remote obstacle */
-                                struct msg m_remote;
-                                m_remote.src = IDX_O;
-                                snprintf(m_remote.data, MSG_SIZE, "REMOTE %d, %d", dx, dy);
-                                write(pipe_parent_to_child[IDX_B][1], &m_remote, sizeof(m_remote));
-                            }
-                        }
-                    }
-                    /* NETWORK: Send CLIENT drone position to SERVER */
-                    else if (strncmp(sbuf, "obst", 4) == 0) {
-                        LOG("NETWORK (CLIENT): Received 'obst' request from server");
-                        // Server asking for Client's drone position (obst)
-                        snprintf(sbuf, sizeof(sbuf), "%d, %d", local_drone_x, local_drone_y);
-                        write(network_fd, sbuf, strlen(sbuf) + 1);
-                        LOG("NETWORK (CLIENT): Sent local drone position to server");
-                        
-                        /* NETWORK: Wait for acknowledgment */
-                        memset(sbuf, 0, sizeof(sbuf));
-                        if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                            if (strncmp(sbuf, "pok", 3) == 0) {
-                                LOG("NETWORK (CLIENT): Received 'pok' from server");
-                            }
-                        }
-                    }
+            for (int e = 0; e < ret && net.running; e++) {
+                uint32_t tag = evs[e].data.u32;
+
+                /* ================================================================
+                 * NETWORK PROTOCOL: new clients, frames from the peers, queued output
+                 * ================================================================ */
+                if (tag == ROUTER_CHILD_TAG) {
+                    router_reap(net.epfd);
+                    continue;
                 }
-            }
-            
-            /* ====================================================================
-             * NETWORK PROTOCOL: SERVER Time-Based Synchronization
-             * ==================================================================== */
-            struct timeval tv;
-            gettimeofday(&tv, NULL);
-            unsigned long current_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-            if (mode == SERVER && size_sent && network_fd > 0) {
-                /* NETWORK: Obstacle request (20Hz) */
-                if (current_ms - last_obst_ms >= OBST_SYNC_MS) {
-                    char remote_msg[100] = "obst";
-                    write(network_fd, &remote_msg, strlen(remote_msg)+1);
-                    LOG("NETWORK (SERVER): Sent 'obst' request to client");
-                    
-                    /* NETWORK: Receive CLIENT drone position */
-                    char sbuf[128];
-                    memset(sbuf, 0, sizeof(sbuf));
-                    if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                        int ox, oy;
-                        if (sscanf(sbuf, "%d, %d", &ox, &oy) == 2) {
-                            LOG("NETWORK (SERVER): Valid obstacle position received");
-                            
-                            /* NETWORK: Forward to Blackboard as obstacle */
-                            struct msg m_obst;
-                            m_obst.src = IDX_O;
-                            snprintf(m_obst.data, MSG_SIZE, "O=%d,%d", ox, oy);
-                            write(pipe_parent_to_child[IDX_B][1], &m_obst, sizeof(m_obst));
-                            
-                            /* NETWORK: Send acknowledgment */
-                            snprintf(remote_msg, sizeof(remote_msg), "pok");
-                            write(network_fd, &remote_msg, strlen(remote_msg)+1);
-                            LOG("NETWORK (SERVER): Sent 'pok' to client");
-                        }
-                    }
-                    last_obst_ms = current_ms;
+                if (tag == NET_TAG_LISTEN) {
+                    net_accept(&net);
+                    continue;
                 }
+                if (tag & NET_TAG_PEER) {
+                    net_on_peer_event(&net, &net.peers[tag & NET_TAG_SLOT], evs[e].events);
+                    continue;
+                }
+                if (tag & NET_TAG_UDP) {
+                    net_udp_recv(&net, &net.peers[tag & NET_TAG_SLOT]);
+                    continue;
+                }
+                // A parent->child edge drained: retried by outq_flush_all() below
+                if (tag & ROUTER_OUT_TAG) continue;
+
+                /* ================================================================
+                 * NETWORK MODE: Local Process Message Routing
+                 * ================================================================ */
+                int src = tag;
+                if (from_child[src].fd == -1) continue;
+                struct msg m;
+                while (1) {
+                    ssize_t n = channel_recv(&from_child[src], &m);
+                    if (n <= 0) {
+                        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break; 
+                        channel_close(&from_child[src]);
+                        break;
+                    }
+
+                    if (subscription_update(src, &m)) continue;
+
+                    /* NETWORK: size handshake, ESC shutdown, drone tracking */
+                    msg_dispatch(net_handlers, &m, &net);
+                    if (!net.running) break;
 
-                /* NETWORK: Drone sync (10Hz) */
-                //if (server_drone_dirty && (current_ms - last_drone_ms >= DRONE_SYNC_MS)) {
-                if ((current_ms - last_drone_ms >= DRONE_SYNC_MS)) {
-                    char remote_msg[100] = "drone";
-                    write(network_fd, &remote_msg, strlen(remote_msg)+1);
-                    LOG("NETWORK (SERVER): Sent 'drone' command to client");
-                    
-                    /* NETWORK: Send SERVER drone position */
-                    snprintf(remote_msg, sizeof(remote_msg), "%d, %d", server_drone_x, server_drone_y);
-                    write(network_fd, &remote_msg, strlen(remote_msg)+1);
-                    LOG("NETWORK (SERVER): Sent server drone position to client");
-                    
-                    /* NETWORK: Wait for acknowledgment */
-                    char sbuf[128];
-                    memset(sbuf, 0, sizeof(sbuf));
-                    if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                        if (strncmp(sbuf, "dok", 3) == 0) {
-                            LOG("SERVER: Received 'dok' from client");
-                        }
+                    /* ============================================================
+                     * NETWORK: Message Routing with Network
+                     * ============================================================ */
+                    for (int d = 0; d < route_table[src].num; d++) {
+                        int dst = route_table[src].dest[d];
+                        if (!msg_wanted(subscriptions[dst], &m)) continue;
+                        route_send(dst, &m, 1, &stats);
                     }
-                    server_drone_dirty = 0;
-                    last_drone_ms = current_ms;
                 }
             }
 
-            /* ====================================================================
-             * NETWORK MODE: Local Process Message Routing
-             * ==================================================================== */
-            for (int src = 0; src < NUM_PROCESSES; src++) {
-                int read_fd = pipe_child_to_parent[src][0];
-
-                if (read_fd != -1 && FD_ISSET(read_fd, &rfds)) {
-                    struct msg m;
-                    while (1) {
-                        ssize_t n = read(read_fd, &m, sizeof(m));
-                        if (n <= 0) {
-                            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break; 
-                            close(read_fd);
-                            pipe_child_to_parent[src][0] = -1;
-                            break;
-                        }
-
-                        /* ================================================================
-                         * NETWORK: Window Size Handshake (SERVER only)
-                         * ================================================================ */
-                        if (mode == SERVER && !size_sent && m.src == IDX_M && strncmp(m.data, "RESIZE", 6) == 0) {
-                            int w, h;
-                            sscanf(m.data, "RESIZE %d %d", &w, &h);
-                            char sbuf[128];
-                            memset(sbuf, 0, sizeof(sbuf));
-                            snprintf(sbuf, sizeof(sbuf), "size %d,%d", w, h);
-                            LOG("SERVER: Sending window size to client...");
-                            write(network_fd, sbuf, strlen(sbuf)+1);
-
-                            /* NETWORK: Wait for acknowledgment */
-                            memset(sbuf, 0, sizeof(sbuf));
-                            if (read_line(network_fd, sbuf, sizeof(sbuf)) > 0) {
-                                if (strncmp(sbuf, "sok", 3) == 0) {
-                                    LOG("SERVER: Received 'sok' from client");
-                                    size_sent = 1;
-                                }
-                            }
-                        }
-
-                        /* ================================================================
-                         * NETWORK: ESC Key Shutdown Protocol
-                         * ================================================================ */
-                        if (src == IDX_I && m.data[0] == 27) {
-                            if (mode == SERVER && network_fd > 0) {
-                                LOG("SERVER: Initiating shutdown protocol with client...");
-                                char qmsg[16] = "q";
-                                write(network_fd, qmsg, strlen(qmsg) + 1);
-                                
-                                char qbuf[128];
-                                memset(qbuf, 0, sizeof(qbuf));
-                                if (read_line(network_fd, qbuf, sizeof(qbuf)) > 0) {
-                                    if (strncmp(qbuf, "qok", 3) == 0) {
-                                        LOG("SERVER: Received 'qok', shutting down.");
-                                    }
-                                }
-                            }
-                            LOG("MAIN: ESC detected, cleaning up...");
-                            clean_children();
-                            running = 0;
-                            break;
-                        }
-
-                        /* ================================================================
-                         * NETWORK: Message Routing with Network
-                         * ================================================================ */
-                        for (int d = 0; d < route_table[src].num; d++) {
-                            int dst = route_table[src].dest[d];
-
-                            // Efficiency: Skip unnecessary processes
-                            if (src == IDX_B) {
-                                if (strncmp(m.data, "D=", 2) == 0 && dst == IDX_D) continue;
-                                if (strncmp(m.data, "STATS", 5) == 0 && dst == IDX_D) continue;
-                            }
-
-                            /* NETWORK: Track SERVER drone position for synchronization */
-                            if (mode == SERVER && src == IDX_B && strncmp(m.data, "D=", 2) == 0) {
-                                if (sscanf(m.data, "D=%d,%d", &server_drone_x, &server_drone_y) == 2) {
-                                    //server_drone_dirty = 1;
-                                }
-                            }
-                            
-                            /* NETWORK: Track CLIENT drone position for obstacle requests */
-                            if (mode == CLIENT && src == IDX_B && strncmp(m.data, "D=", 2) == 0) {
-                                sscanf(m.data, "D=%d,%d", &local_drone_x, &local_drone_y);
-                            }
-
-                            int write_fd = pipe_parent_to_child[dst][1];
-                            if (write_fd != -1){
-                                write(write_fd, &m, sizeof(m));
-                            }
-                        }
-                    }
-                }
-            }    
+            /* NETWORK: Retry the destinations that were full */
+            timeout = outq_flush_all(net.epfd);
+        }
+        router_stats_log(&stats);
+        for (int i = 0; i < NET_MAX_PEERS; i++) {
+            net_udp_close(&net, &net.peers[i]);
+            netconn_close(&net.peers[i].conn, NET_CLOSE_FLUSH_MS);
         }
+        if (net.listen_fd != -1) close(net.listen_fd);
     }
 
     clean_children();
 
-    waitpid(pid_B, NULL, 0);
-    waitpid(pid_D, NULL, 0);
-    waitpid(pid_I, NULL, 0);
-    waitpid(pid_M, NULL, 0);
+    // Children reaped by the loop are already 0
+    if (pid_B > 0) waitpid(pid_B, NULL, 0);
+    if (pid_D > 0) waitpid(pid_D, NULL, 0);
+    if (pid_I > 0) waitpid(pid_I, NULL, 0);
+    if (pid_M > 0) waitpid(pid_M, NULL, 0);
     if (pid_O > 0) waitpid(pid_O, NULL, 0);
     if (pid_T > 0) waitpid(pid_T, NULL, 0);
     if (pid_W > 0) waitpid(pid_W, NULL, 0);
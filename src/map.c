@@ -14,11 +14,14 @@
 #include "../include/process_log.h"
 #define PROCESS_NAME "MAP"
 #include "../include/common.h"
+#include "../include/channel.h"
+#include "../include/bb_shm.h"
+#include "../include/entity_store.h"
+#include "../include/periodic.h"
 
-int grabbed = 0;
-int height, width;
+#define MAP_PERIOD_NS 50000000L     // Redraw every 50 ms
 
-#define MAX_OBS 100
+int height, width;
 
 int mode;
 
@@ -64,7 +67,7 @@ void draw_window(WINDOW *win){
 /**
  * Draw all game elements (obstacles, targets, and drone) in the main window.
  */
-void draw_all(WINDOW *win, int obs_x[MAX_OBS], int obs_y[MAX_OBS], int num_obs, int tgs_x[MAX_OBS], int tgs_y[MAX_OBS], int num_tgs, int x, int y){
+void draw_all(WINDOW *win, const struct entity_store *obs, const struct entity_store *tgs, int x, int y){
     werase(win);
     //draw_window(win);
 
@@ -72,16 +75,16 @@ void draw_all(WINDOW *win, int obs_x[MAX_OBS], int obs_y[MAX_OBS], int num_obs,
     box(win, 0, 0);
     wattroff(win, COLOR_PAIR(2));
 
-    for (int i = 0; i < num_obs; i++){
+    for (int i = 0; i < obs->count; i++){
         wattron(win, COLOR_PAIR(2));
-        mvwaddch(win, obs_y[i], obs_x[i], 'O');
-        //mvwprintw(win, obs_y[i], obs_x[i], "%d,%d", obs_x[i], obs_y[i]);
+        mvwaddch(win, obs->y[i], obs->x[i], 'O');
+        //mvwprintw(win, obs->y[i], obs->x[i], "%d,%d", obs->x[i], obs->y[i]);
         wattroff(win, COLOR_PAIR(2));
     }
-    for (int i = 0; i < num_tgs; i++){
+    for (int i = 0; i < tgs->count; i++){
         wattron(win, COLOR_PAIR(4));
-        mvwprintw(win, tgs_y[i], tgs_x[i], "%d", i+1+grabbed);
-        //mvwprintw(win, tgs_y[i], tgs_x[i], "%d,%d", tgs_x[i], tgs_y[i]);
+        mvwprintw(win, tgs->y[i], tgs->x[i], "%d", tgs->tag[i]);
+        //mvwprintw(win, tgs->y[i], tgs->x[i], "%d,%d", tgs->x[i], tgs->y[i]);
         wattroff(win, COLOR_PAIR(4));
 
     }
@@ -95,6 +98,133 @@ void draw_all(WINDOW *win, int obs_x[MAX_OBS], int obs_y[MAX_OBS], int num_obs,
 
 }
 
+// Local copy of the world, rebuilt from the Blackboard messages
+struct map_state {
+    // Obstacles and targets, same ids as in the Blackboard
+    struct entity_store obs;
+    struct entity_store tgs;
+    // Redraw flags
+    int ready_o;
+    int ready_t;
+    // Drone position
+    int x, y;
+    int running;
+    WINDOW *win_stats;
+    int32_t snap_pass;  // Snapshots mirrored so far (aux of the entities seen)
+};
+
+// STATS forwarded by Blackboard
+static void on_stats(const struct msg *m, void *ctx) {
+    struct map_state *st = ctx;
+    const struct pl_stats *s = MSG_PL(m, const struct pl_stats);
+    werase(st->win_stats);
+    box(st->win_stats, 0, 0);
+    mvwprintw(st->win_stats, 1, 1, "DYNAMICS");
+    mvwprintw(st->win_stats, 2, 1, "Pos:   %.2f, %.2f", s->x, s->y);
+    mvwprintw(st->win_stats, 3, 1, "Vel:   %.2f, %.2f", s->vx, s->vy);
+    mvwprintw(st->win_stats, 4, 1, "Force: %.2f, %.2f", s->fx, s->fy);
+    wrefresh(st->win_stats);
+}
+
+// Entities inserted or moved by the Blackboard
+static void on_ent_put(const struct msg *m, void *ctx) {
+    struct map_state *st = ctx;
+    const struct pl_entities *pl = MSG_PL(m, const struct pl_entities);
+    struct entity_store *es = pl->kind == ENT_TARGET ? &st->tgs : &st->obs;
+    for (int i = 0; i < pl->count && i < PL_ENTITIES_MAX; i++)
+        es_put(es, pl->e[i].id, pl->e[i].x, pl->e[i].y, pl->e[i].tag);
+}
+
+// Entities removed by the Blackboard (a stale id is ignored)
+static void on_ent_del(const struct msg *m, void *ctx) {
+    struct map_state *st = ctx;
+    const struct pl_entities *pl = MSG_PL(m, const struct pl_entities);
+    struct entity_store *es = pl->kind == ENT_TARGET ? &st->tgs : &st->obs;
+    for (int i = 0; i < pl->count && i < PL_ENTITIES_MAX; i++)
+        es_remove(es, pl->e[i].id);
+}
+
+static void on_obs_clear(const struct msg *m, void *ctx) {
+    (void)m;
+    es_clear(&((struct map_state *)ctx)->obs);
+}
+
+static void on_tgt_clear(const struct msg *m, void *ctx) {
+    (void)m;
+    es_clear(&((struct map_state *)ctx)->tgs);
+}
+
+static void on_obs_redraw(const struct msg *m, void *ctx) {
+    (void)m;
+    ((struct map_state *)ctx)->ready_o = 1;
+}
+
+static void on_tgt_redraw(const struct msg *m, void *ctx) {
+    (void)m;
+    ((struct map_state *)ctx)->ready_t = 1;
+}
+
+// Drone position update
+static void on_drone_pos(const struct msg *m, void *ctx) {
+    struct map_state *st = ctx;
+    st->x = MSG_PL(m, const struct pl_pos)->x;
+    st->y = MSG_PL(m, const struct pl_pos)->y;
+}
+
+static void on_esc(const struct msg *m, void *ctx) {
+    (void)m;
+    printf("[MAP] EXIT\n");
+    LOG("Map received ESC, exiting");
+    ((struct map_state *)ctx)->running = 0;
+}
+
+// Shared state in use: only the diagnostics and the shutdown are messages
+static const msg_handler shm_handlers[MSG_TYPE_COUNT] = {
+    [MSG_STATS]      = on_stats,
+    [MSG_ESC]        = on_esc,
+};
+
+/**
+ * Bring a mirrored store in line with the entries of a snapshot, by id:
+ * es_put() moves or adds each one (new ids go last, as in the Blackboard),
+ * then the entities the snapshot no longer has are removed. aux marks the
+ * entities seen in this pass.
+ */
+static void mirror_entries(struct entity_store *es, const uint32_t *ids, const int32_t *xs, const int32_t *ys,
+                           const int32_t *tags, int n, int32_t pass) {
+    for (int i = 0; i < n; i++) {
+        if (es_put(es, ids[i], xs[i], ys[i], tags ? tags[i] : 0) < 0) continue;
+        es->aux[es_find(es, ids[i])] = pass;
+    }
+    // Removal moves the last entity into the hole: walk backwards
+    for (int d = es->count - 1; d >= 0; d--)
+        if (es->aux[d] != pass) es_remove(es, es->id[d]);
+}
+
+/**
+ * Take the obstacles, targets and drone from a Blackboard snapshot.
+ */
+static void map_from_snapshot(struct map_state *st, const struct bb_snapshot *s) {
+    st->snap_pass++;
+    mirror_entries(&st->obs, s->obs_id, s->obs_x, s->obs_y, NULL, s->num_obs, st->snap_pass);
+    mirror_entries(&st->tgs, s->tgs_id, s->tgs_x, s->tgs_y, s->tgs_tag, s->num_tgs, st->snap_pass);
+    st->x = s->drone_x;
+    st->y = s->drone_y;
+    st->ready_o = st->ready_t = 1;
+}
+
+static const msg_handler handlers[MSG_TYPE_COUNT] = {
+    [MSG_STATS]      = on_stats,
+    [MSG_ENT_PUT]    = on_ent_put,
+    [MSG_ENT_DEL]    = on_ent_del,
+    [MSG_OBS_CLEAR]  = on_obs_clear,
+    [MSG_TGT_CLEAR]  = on_tgt_clear,
+    [MSG_OBS_REDRAW] = on_obs_redraw,
+    [MSG_TGT_REDRAW] = on_tgt_redraw,
+    [MSG_DRONE_POS]  = on_drone_pos,
+    [MSG_ESC]        = on_esc,
+};
+
 int main(int argc, char *argv[]) {
 
     // Register process for logging
@@ -105,11 +235,22 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "Usage: %s <fd>\n", argv[0]);
         return 1;
     }
-    int fd_in = atoi(argv[1]);
-    int fd_out = atoi(argv[2]);
-
-    int flags = fcntl(fd_in, F_GETFL, 0);
-    fcntl(fd_in, F_SETFL, flags | O_NONBLOCK);
+    struct channel ch_in;
+    channel_open(&ch_in, argv[1], 0);
+    struct channel ch_out;
+    channel_open(&ch_out, argv[2], 1);
+
+    // Blackboard state: read from the shared segment if there is one
+    struct bb_shm *shm = bb_shm_open(argc >= 8 ? argv[7] : NULL, 0);
+    const msg_handler *table = shm ? shm_handlers : handlers;
+    LOG(shm ? "Reading the Blackboard state from shared memory" : "Rebuilding the Blackboard state from messages");
+
+    // Tell the router which message types this process consumes
+    struct msg sub;
+    msg_subscribe(&sub, IDX_M, msg_table_mask(table));
+    channel_send(&ch_out, &sub);
+
+    channel_set_nonblock(&ch_in);
     
     // Watchdog PID to send alive signals
     pid_t watchdog_pid = atoi(argv[3]);
@@ -150,16 +291,14 @@ int main(int argc, char *argv[]) {
 
     WINDOW *win_main = newwin(1, 1, 0, 0);
 
-    int x = 5;
-    int y = 5;
-
     draw_window(win_main);
     
     // Initial message to notify Blackboard of the terminal dimension
     struct msg mb_init;
-    mb_init.src = IDX_M;
-    snprintf(mb_init.data, MSG_SIZE, "RESIZE %d %d", width - STATS_WIDTH - MARGIN_X, height - MARGIN_Y);
-    write(fd_out, &mb_init, sizeof(mb_init));
+    msg_init(&mb_init, IDX_M, MSG_RESIZE, sizeof(struct pl_size));
+    MSG_PL(&mb_init, struct pl_size)->w = width - STATS_WIDTH - MARGIN_X;
+    MSG_PL(&mb_init, struct pl_size)->h = height - MARGIN_Y;
+    channel_send(&ch_out, &mb_init);
     
     // Stats window placement
     int m_y = (mode == STANDALONE) ? 6 : MARGIN_Y;
@@ -169,23 +308,17 @@ int main(int argc, char *argv[]) {
 
     LOG("Map initialized");
 
-    // Obstacles state
-    int obs_x[MAX_OBS];
-    int obs_y[MAX_OBS];
-    int num_obs = 0;
+    static struct map_state st = { .ready_o = 1, .ready_t = 1, .x = 5, .y = 5, .running = 1 };
+    st.win_stats = win_stats;
+    es_init(&st.obs);
+    es_init(&st.tgs);
+    uint32_t shm_seq = 1;   // Odd: no snapshot taken yet
+    struct bb_snapshot snap = {0};
 
-    // Targets state
-    int tgs_x[MAX_OBS];
-    int tgs_y[MAX_OBS];
-    int num_tgs = 0;
+    struct periodic pt;
+    if (pt_open(&pt, MAP_PERIOD_NS) < 0) perror("pt_open");
 
-    // Redraw flags
-    int ready_o = 1;
-    int ready_t = 1;
-
-    int running = 1;
-
-    while(running){
+    while(st.running){
         
         // Resizing logic only on standalone mode
         int ch = getch();
@@ -211,18 +344,20 @@ int main(int argc, char *argv[]) {
             
             //expected_obs = (int)(width * height) / 1000;
 
-            num_obs = 0;
-            num_tgs = 0;  
+            es_clear(&st.obs);
+            es_clear(&st.tgs);
 
             // Message to notify Blackboard of the terminal resize
             struct msg mb;
-            mb.src = IDX_M;
             // Send game area dimensions (Width - Sidebar - Margins)
-            snprintf(mb.data, MSG_SIZE, "RESIZE %d %d", width - STATS_WIDTH - MARGIN_X, height - MARGIN_Y);
-            write(fd_out, &mb, sizeof(mb));
+            msg_init(&mb, IDX_M, MSG_RESIZE, sizeof(struct pl_size));
+            MSG_PL(&mb, struct pl_size)->w = width - STATS_WIDTH - MARGIN_X;
+            MSG_PL(&mb, struct pl_size)->h = height - MARGIN_Y;
+            channel_send(&ch_out, &mb);
 
-            ready_o = 0;
-            ready_t = 0;
+            st.ready_o = 0;
+            st.ready_t = 0;
+            shm_seq = 1;    // Take the next snapshot even if unchanged
 
             draw_window(win_main);
             
@@ -236,7 +371,7 @@ int main(int argc, char *argv[]) {
         // Read incoming messages
         while(1){
             struct msg m;
-            ssize_t n = read(fd_in, &m, sizeof(m));
+            ssize_t n = channel_recv(&ch_in, &m);
             
             if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -247,94 +382,19 @@ int main(int argc, char *argv[]) {
             }
             if (n == 0) break;
 
-            // STATS forwarded by Blackboard
-            if (m.src == IDX_B && strncmp(m.data, "STATS", 5) == 0){
-                float sfx, sfy, svx, svy, sx, sy;
-                if (sscanf(m.data, "STATS Fx=%f Fy=%f Vx=%f Vy=%f X=%f Y=%f", &sfx, &sfy, &svx, &svy, &sx, &sy) == 6) {
-                    werase(win_stats);
-                    box(win_stats, 0, 0);
-                    mvwprintw(win_stats, 1, 1, "DYNAMICS");
-                    mvwprintw(win_stats, 2, 1, "Pos:   %.2f, %.2f", sx, sy);
-                    mvwprintw(win_stats, 3, 1, "Vel:   %.2f, %.2f", svx, svy);
-                    mvwprintw(win_stats, 4, 1, "Force: %.2f, %.2f", sfx, sfy);
-                    wrefresh(win_stats);
-                }
-            }
-            // Obstacle update
-            else if (m.src == IDX_B && strncmp(m.data, "O=", 2) == 0){
-                int o_x, o_y;
-                // LOG("MAP received obs position");
-                if (mode == SERVER || mode == CLIENT) num_obs = 0; // Only keep one obstacle in server/client remote mode
-                sscanf(m.data, "O=%d,%d", &o_x, &o_y);
-                obs_x[num_obs] = o_x;
-                obs_y[num_obs] = o_y;
-                num_obs++;
-            }
-            // Target update
-            else if (m.src == IDX_B && strncmp(m.data, "T[", 2) == 0){
-                int t_i, t_x, t_y;
-                sscanf(m.data, "T[%d]=%d,%d", &t_i, &t_x, &t_y);
-                if (t_i >= 0 && t_i < MAX_OBS) {
-                    tgs_x[t_i] = t_x;
-                    tgs_y[t_i] = t_y;
-                    if (t_i >= num_tgs) num_tgs = t_i + 1;
-                }
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "GOAL=", 5) == 0){
-                int t_x, t_y;
-                sscanf(m.data, "GOAL=%d,%d", &t_x, &t_y);
-                
-                for (int i = 0; i < num_tgs - 1; i++) {
-                        tgs_x[i] = tgs_x[i + 1];
-                        tgs_y[i] = tgs_y[i + 1];
-                }
-                if (num_tgs > 0) {
-                    tgs_x[num_tgs - 1] = t_x;
-                    tgs_y[num_tgs - 1] = t_y;
-                }
-                
-                grabbed++;
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "RESET_O", 7) == 0){
-                num_obs = 0;
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "O_SHIFT=", 8) == 0){
-                int x, y;
-                sscanf(m.data, "O_SHIFT=%d,%d", &x, &y);
-                if (num_obs > 0) {
-                    for (int i = 0; i < num_obs - 1; i++) {
-                        obs_x[i] = obs_x[i + 1];
-                        obs_y[i] = obs_y[i + 1];
-                    }
-                    obs_x[num_obs - 1] = x;
-                    obs_y[num_obs - 1] = y;
-                }
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "RESET_T", 7) == 0){
-                num_tgs = 0;
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "REDRAW_O", 8) == 0){
-                ready_o = 1;
-            }
-            else if (m.src == IDX_B && strncmp(m.data, "REDRAW_T", 8) == 0){
-                ready_t = 1;
-            }
-            // Drone position update
-            else if(m.src == IDX_B && strncmp(m.data, "D=", 2) == 0){
-                sscanf(m.data, "D=%d,%d", &x, &y);
-                // LOG(m.data);
-            }
-            else if (strncmp(m.data, "ESC", 3)== 0){
-                printf("[MAP] EXIT\n");
-                LOG("Map received ESC, exiting");
-                running = 0;
-                break;
-            }
+            msg_dispatch(table, &m, &st);
+            if (!st.running) break;
         }
         
-        if (!running) break;
-        if (ready_o && ready_t){
-            draw_all(win_main, obs_x, obs_y, num_obs, tgs_x ,tgs_y, num_tgs, x, y);
+        if (!st.running) break;
+
+        // Copy the shared state only when the Blackboard changed it
+        if (shm && bb_shm_seq(shm) != shm_seq) {
+            shm_seq = bb_shm_read(shm, &snap);
+            map_from_snapshot(&st, &snap);
+        }
+        if (st.ready_o && st.ready_t){
+            draw_all(win_main, &st.obs, &st.tgs, st.x, st.y);
             // LOG("Map redrawn"); // Too frequent in debug mode
         }
 
@@ -348,14 +408,30 @@ int main(int argc, char *argv[]) {
             sigqueue(watchdog_pid, SIGUSR1, val);
         }
 
-        usleep(50000);
+        // Next frame on an absolute deadline, whatever this one took
+        if (pt_wait(&pt) < 0)
+            usleep(MAP_PERIOD_NS / 1000);
+        if (pt_stats_due(&pt)) {
+            for (int l = 0; l < PT_LINES; l++) {
+                char stats[160];
+                pt_format(&pt, l, stats, sizeof(stats));
+                LOG_INFO("Loop %s", stats);
+            }
+            pt_reset_stats(&pt);
+        }
 
     }
 
+    pt_close(&pt);
+
     delwin(win_main);
     delwin(win_stats);
     endwin();
-    close(fd_in);
+    channel_close(&ch_in);
+    bb_snapshot_free(&snap);
+    bb_shm_close(shm);
+    es_free(&st.obs);
+    es_free(&st.tgs);
     LOG("Map terminated");
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "../include/netconn.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+void netconn_init(struct netconn *c, int fd)
+{
+    memset(c, 0, sizeof(*c));
+    c->fd = fd;
+    c->tx = NULL;
+    if (fd != -1) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        // The connection belongs to this process, not to the children it execs
+        fcntl(fd, F_SETFD, fcntl(fd, F_GETFD, 0) | FD_CLOEXEC);
+    }
+}
+
+ssize_t netconn_fill(struct netconn *c)
+{
+    if (c->fd == -1 || c->eof)
+        return -1;
+
+    ssize_t total = 0;
+    while (c->rx_len < sizeof(c->rx)) {
+        ssize_t n = read(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len);
+        if (n > 0) {
+            c->rx_len += n;
+            total += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        // EOF or hard error: frames already buffered can still be extracted
+        c->eof = 1;
+        return total > 0 ? total : -1;
+    }
+    return total;
+}
+
+int netconn_next_frame(struct netconn *c, char *out, size_t max)
+{
+    char *end = memchr(c->rx, '\0', c->rx_len);
+    if (!end) {
+        // A full buffer without terminator is garbage: drop it
+        if (c->rx_len == sizeof(c->rx))
+            c->rx_len = 0;
+        return 0;
+    }
+
+    size_t len = end - c->rx;
+    size_t n = len < max - 1 ? len : max - 1;
+    memcpy(out, c->rx, n);
+    out[n] = '\0';
+
+    memmove(c->rx, end + 1, c->rx_len - len - 1);
+    c->rx_len -= len + 1;
+    return 1;
+}
+
+int netconn_wait_frame(struct netconn *c, char *out, size_t max, int timeout_ms)
+{
+    long deadline = now_ms() + timeout_ms;
+    while (1) {
+        if (netconn_next_frame(c, out, max))
+            return 1;
+        if (c->eof)
+            return -1;
+
+        long left = -1;
+        if (timeout_ms >= 0 && (left = deadline - now_ms()) <= 0)
+            return 0;
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        if (poll(&pfd, 1, (int)left) < 0 && errno != EINTR)
+            return -1;
+        // Sets eof on close; frames read before it are still returned above
+        netconn_fill(c);
+    }
+}
+
+int netconn_flush(struct netconn *c)
+{
+    if (c->fd == -1)
+        return -1;
+
+    while (c->tx_off < c->tx_len) {
+        ssize_t w = write(c->fd, c->tx + c->tx_off, c->tx_len - c->tx_off);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            return -1;
+        }
+        c->tx_off += w;
+    }
+    c->tx_off = c->tx_len = 0;
+    return 0;
+}
+
+int netconn_send(struct netconn *c, const char *frame)
+{
+    if (c->fd == -1)
+        return -1;
+
+    size_t len = strlen(frame) + 1;
+    if (c->tx_off > 0 && c->tx_off == c->tx_len)
+        c->tx_off = c->tx_len = 0;
+    if (c->tx_len + len > c->tx_cap) {
+        // Reclaim the bytes already written before growing
+        if (c->tx_off > 0) {
+            memmove(c->tx, c->tx + c->tx_off, c->tx_len - c->tx_off);
+            c->tx_len -= c->tx_off;
+            c->tx_off = 0;
+        }
+        if (c->tx_len + len > c->tx_cap) {
+            size_t cap = c->tx_cap ? c->tx_cap : 1024;
+            while (cap < c->tx_len + len)
+                cap *= 2;
+            char *tx = realloc(c->tx, cap);
+            if (!tx)
+                return -1;
+            c->tx = tx;
+            c->tx_cap = cap;
+        }
+    }
+    memcpy(c->tx + c->tx_len, frame, len);
+    c->tx_len += len;
+
+    return netconn_flush(c) < 0 ? -1 : 0;
+}
+
+int netconn_tx_pending(const struct netconn *c)
+{
+    return c->fd != -1 && c->tx_off < c->tx_len;
+}
+
+void netconn_close(struct netconn *c, int timeout_ms)
+{
+    if (c->fd == -1)
+        return;
+
+    long deadline = now_ms() + timeout_ms;
+    while (netconn_flush(c) == 1) {
+        long left = deadline - now_ms();
+        if (left <= 0)
+            break;
+        struct pollfd pfd = { .fd = c->fd, .events = POLLOUT };
+        poll(&pfd, 1, (int)left);
+    }
+    close(c->fd);
+    c->fd = -1;
+    free(c->tx);
+    c->tx = NULL;
+    c->tx_off = c->tx_len = c->tx_cap = 0;
+}
@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+
+#include "../include/periodic.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+static struct timespec ts_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts;
+}
+
+static struct timespec ts_add(struct timespec t, long long ns)
+{
+    ns += t.tv_nsec;
+    t.tv_sec += ns / 1000000000LL;
+    t.tv_nsec = ns % 1000000000LL;
+    return t;
+}
+
+static long long ts_diff(struct timespec a, struct timespec b)
+{
+    return (a.tv_sec - b.tv_sec) * 1000000000LL + (a.tv_nsec - b.tv_nsec);
+}
+
+static void hist_add(struct pt_hist *h, long long ns)
+{
+    uint64_t us = ns > 0 ? (uint64_t)ns / 1000 : 0;
+    int b = us < 2 ? 0 : 63 - __builtin_clzll(us);
+    if (b >= PT_BUCKETS)
+        b = PT_BUCKETS - 1;
+    h->count[b]++;
+    h->n++;
+    if (us > h->max_us)
+        h->max_us = us;
+}
+
+// Upper bound (us) of the bucket holding the q-th fraction of the samples
+static uint64_t hist_quantile(const struct pt_hist *h, double q)
+{
+    uint64_t want = (uint64_t)(q * h->n + 0.999999), seen = 0;
+    for (int b = 0; b < PT_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen >= want && seen > 0)
+            return 2ULL << b;
+    }
+    return 2ULL << (PT_BUCKETS - 1);
+}
+
+// "p50<X p99<Y max Z [<2:n <4:n ...]"
+static int hist_format(const struct pt_hist *h, char *buf, size_t len)
+{
+    int w = snprintf(buf, len, "p50<%luus p99<%luus max %luus [",
+                     (unsigned long)hist_quantile(h, 0.5), (unsigned long)hist_quantile(h, 0.99),
+                     (unsigned long)h->max_us);
+    const char *sep = "";
+    for (int b = 0; b < PT_BUCKETS && w >= 0 && (size_t)w < len; b++) {
+        if (!h->count[b])
+            continue;
+        w += snprintf(buf + w, len - w, b < PT_BUCKETS - 1 ? "%s<%lu:%lu" : "%s>=%lu:%lu",
+                      sep, (unsigned long)(b < PT_BUCKETS - 1 ? 2UL << b : 1UL << b),
+                      (unsigned long)h->count[b]);
+        sep = " ";
+    }
+    if (w >= 0 && (size_t)w < len)
+        w += snprintf(buf + w, len - w, "]");
+    return w;
+}
+
+// First deadline one period from now, then every period
+static int arm(struct periodic *pt, long period_ns)
+{
+    if (period_ns <= 0)
+        return -1;
+    struct timespec now = ts_now();
+    struct itimerspec its = {
+        .it_interval = {period_ns / 1000000000L, period_ns % 1000000000L},
+        .it_value = ts_add(now, period_ns),
+    };
+    if (timerfd_settime(pt->tfd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        return -1;
+    pt->period_ns = period_ns;
+    pt->deadline = now;
+    return 0;
+}
+
+int pt_open(struct periodic *pt, long period_ns)
+{
+    memset(pt, 0, sizeof(*pt));
+    pt->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (pt->tfd == -1)
+        return -1;
+    if (arm(pt, period_ns) < 0) {
+        close(pt->tfd);
+        pt->tfd = -1;
+        return -1;
+    }
+    pt->woke = pt->deadline;
+    pt->report_at = ts_add(pt->woke, PT_REPORT_S * 1000000000LL);
+    return 0;
+}
+
+int pt_set_period(struct periodic *pt, long period_ns)
+{
+    if (period_ns == pt->period_ns)
+        return 0;
+    return arm(pt, period_ns);
+}
+
+int pt_wait(struct periodic *pt)
+{
+    if (pt->tfd == -1)
+        return -1;
+    hist_add(&pt->work, ts_diff(ts_now(), pt->woke));
+
+    uint64_t expirations;
+    ssize_t n;
+    while ((n = read(pt->tfd, &expirations, sizeof(expirations))) == -1 && errno == EINTR)
+        ;
+    if (n != sizeof(expirations))
+        return -1;
+
+    // The latest deadline that passed is the one of this tick
+    pt->deadline = ts_add(pt->deadline, (long long)pt->period_ns * expirations);
+    pt->woke = ts_now();
+    hist_add(&pt->jitter, ts_diff(pt->woke, pt->deadline));
+
+    uint64_t missed = expirations - 1;
+    pt->ticks++;
+    pt->ticks_report++;
+    pt->overruns += missed;
+    pt->overruns_report += missed;
+    return (int)missed;
+}
+
+int pt_stats_due(struct periodic *pt)
+{
+    if (ts_diff(pt->woke, pt->report_at) < 0)
+        return 0;
+    pt->report_at = ts_add(pt->woke, PT_REPORT_S * 1000000000LL);
+    return 1;
+}
+
+void pt_format(const struct periodic *pt, int line, char *buf, size_t len)
+{
+    switch (line) {
+    case PT_LINE_TICKS:
+        snprintf(buf, len, "%lu ticks of %.1f ms, %lu overruns (%lu total)",
+                 (unsigned long)pt->ticks_report, pt->period_ns / 1e6,
+                 (unsigned long)pt->overruns_report, (unsigned long)pt->overruns);
+        break;
+    case PT_LINE_JITTER:
+    case PT_LINE_WORK: {
+        int w = snprintf(buf, len, line == PT_LINE_JITTER ? "jitter " : "work ");
+        if (w >= 0 && (size_t)w < len)
+            hist_format(line == PT_LINE_JITTER ? &pt->jitter : &pt->work, buf + w, len - w);
+        break;
+    }
+    default:
+        if (len)
+            buf[0] = '\0';
+    }
+}
+
+void pt_reset_stats(struct periodic *pt)
+{
+    memset(&pt->jitter, 0, sizeof(pt->jitter));
+    memset(&pt->work, 0, sizeof(pt->work));
+    pt->ticks_report = 0;
+    pt->overruns_report = 0;
+}
+
+void pt_close(struct periodic *pt)
+{
+    if (pt->tfd != -1)
+        close(pt->tfd);
+    pt->tfd = -1;
+}
+
+int pt_realtime(int priority, int cpu)
+{
+    int ret = 0;
+    if (priority > 0) {
+        struct sched_param sp = { .sched_priority = priority };
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) == -1)
+            ret = -1;
+    }
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+            ret = -1;
+    }
+    return ret;
+}
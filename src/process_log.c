@@ -1,32 +1,323 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include "../include/process_log.h"
+#include "../include/trace.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/types.h>
 
 #define SYSTEM_LOG_FILE "log/system.log"
 
-void process_log(const char *process_name, const char *message)
+/*
+ * Asynchronous logger.
+ * process_log() only formats the line into a slot of an in-memory ring
+ * (bounded MPSC queue, one sequence number per slot), without syscalls or
+ * locks. A flusher thread wakes up every LOG_FLUSH_MS, drains the ring and
+ * appends the whole batch to the log with one O_APPEND write, so lines of
+ * different processes never interleave and nobody waits on a file lock.
+ * When the ring is full new lines are dropped and counted, never blocking.
+ *
+ * A process killed by SIGTERM or SIGHUP (the router's shutdown, a closed
+ * terminal) never reaches atexit: the handler drains the ring itself, then
+ * passes the signal on to whatever handled it before (by default, death).
+ *
+ * fsync policy, from the environment:
+ *   ARP_LOG_FSYNC=never|interval|on-error   (default interval)
+ *   ARP_LOG_FSYNC_MS=<ms>                   (interval policy, default 1000)
+ *
+ * ARP_LOG_BACKEND=binary replaces the text file with the per-process
+ * binary trace (trace.h): lines become EV_TEXT records, no thread is used.
+ */
+#define LOG_RING_SLOTS  4096        // Power of two
+#define LOG_LINE_MAX    192         // Longer lines are truncated
+#define LOG_FLUSH_MS    20          // Flusher period
+#define LOG_BATCH_BYTES (64 * 1024) // Largest single write
+
+enum { FSYNC_NEVER = 0, FSYNC_INTERVAL, FSYNC_ON_ERROR };
+enum { BACKEND_TEXT = 0, BACKEND_BINARY };
+enum { LOG_IDLE = 0, LOG_STARTING, LOG_RUNNING, LOG_OFF };
+
+struct log_slot {
+    uint64_t seq;               // == pos: free for the producer of pos, == pos+1: ready
+    int error;                  // Line logged at LOG_LEVEL_ERROR
+    int len;
+    char line[LOG_LINE_MAX];
+};
+
+static struct log_slot ring[LOG_RING_SLOTS];
+static uint64_t ring_tail;      // Next position to reserve (producers)
+static uint64_t ring_head;      // Next position to read (flusher only)
+static uint64_t dropped;        // Lines lost because the ring was full
+
+static int state;               // LOG_IDLE, LOG_STARTING, LOG_RUNNING, LOG_OFF
+static int backend = BACKEND_TEXT;
+static int stop;
+static int draining;            // One log_drain() at a time: flusher or signal handler
+static pthread_t flusher;
+static int log_fd = -1;
+static int fsync_policy = FSYNC_INTERVAL;
+static long fsync_ms = 1000;
+
+static const int term_signals[] = { SIGTERM, SIGHUP };
+static struct sigaction prev_action[sizeof(term_signals) / sizeof(term_signals[0])];
+
+#define RING_MASK (LOG_RING_SLOTS - 1)
+
+static long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0)
+            return;
+        buf += w;
+        len -= w;
+    }
+}
+
+// Body of log_drain(), with draining held
+static void log_drain_locked(void)
 {
-    int fd = open(SYSTEM_LOG_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd == -1)
+    static char buf[LOG_BATCH_BYTES];
+    static long last_sync;
+    size_t len = 0;
+    int error = 0;
+
+    if (log_fd == -1)
+        log_fd = open(SYSTEM_LOG_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    while (1) {
+        struct log_slot *s = &ring[ring_head & RING_MASK];
+        if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != ring_head + 1)
+            break;
+
+        if (len + s->len > sizeof(buf)) {
+            if (log_fd != -1)
+                write_all(log_fd, buf, len);
+            len = 0;
+        }
+        memcpy(buf + len, s->line, s->len);
+        len += s->len;
+        error |= s->error;
+
+        __atomic_store_n(&s->seq, ring_head + LOG_RING_SLOTS, __ATOMIC_RELEASE);
+        ring_head++;
+    }
+
+    uint64_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (lost > 0 && len + 64 <= sizeof(buf))
+        len += snprintf(buf + len, 64, "-- %lu log lines dropped (ring full)\n", (unsigned long)lost);
+
+    if (log_fd == -1 || len == 0)
         return;
+    write_all(log_fd, buf, len);
 
-    struct flock lock;
-    memset(&lock, 0, sizeof(lock));
-    lock.l_type = F_WRLCK;
-    lock.l_whence = SEEK_SET;
+    if ((fsync_policy == FSYNC_ON_ERROR && error) ||
+        (fsync_policy == FSYNC_INTERVAL && now_ms() - last_sync >= fsync_ms)) {
+        fsync(log_fd);
+        last_sync = now_ms();
+    }
+}
 
-    if (fcntl(fd, F_SETLKW, &lock) == -1) {
-        close(fd);
+/**
+ * Move everything in the ring to the log file, applying the fsync policy.
+ * Called by the flusher thread, the atexit handler after it stopped, or the
+ * termination handler; draining keeps them from overlapping.
+ */
+static void log_drain(void)
+{
+    while (__atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE))
+        ;
+    log_drain_locked();
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+}
+
+static void *log_flusher(void *arg)
+{
+    (void)arg;
+    struct timespec period = { 0, LOG_FLUSH_MS * 1000000L };
+    while (!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&period, NULL);
+        log_drain();
+    }
+    return NULL;
+}
+
+static void log_exit(void)
+{
+    if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != LOG_RUNNING)
+        return;
+    if (backend == BACKEND_BINARY) {
+        trace_close();
         return;
     }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    log_drain();
+    if (log_fd != -1 && fsync_policy != FSYNC_NEVER)
+        fsync(log_fd);
+}
+
+// SIGTERM/SIGHUP: write out what is queued, then hand the signal on
+static void log_on_signal(int sig, siginfo_t *info, void *uctx)
+{
+    size_t k = 0;
+    while (term_signals[k] != sig)
+        k++;
+    // Set by log_exit() as well: the process is already on its way out
+    if (!__atomic_exchange_n(&stop, 1, __ATOMIC_ACQ_REL)) {
+        log_drain();
+        if (log_fd != -1 && fsync_policy != FSYNC_NEVER)
+            fsync(log_fd);
+    }
+    if (prev_action[k].sa_flags & SA_SIGINFO) {
+        prev_action[k].sa_sigaction(sig, info, uctx);
+    } else if (prev_action[k].sa_handler != SIG_DFL && prev_action[k].sa_handler != SIG_IGN) {
+        prev_action[k].sa_handler(sig);
+    } else {
+        // Blocked until the handler returns, then the default action
+        sigaction(sig, &prev_action[k], NULL);
+        raise(sig);
+    }
+}
+
+// Catch the termination signals the process does not ignore
+static void log_catch_signals(void)
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = log_on_signal;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    for (size_t k = 0; k < sizeof(term_signals) / sizeof(term_signals[0]); k++)
+        sigaddset(&sa.sa_mask, term_signals[k]);
+    for (size_t k = 0; k < sizeof(term_signals) / sizeof(term_signals[0]); k++) {
+        struct sigaction cur;
+        if (sigaction(term_signals[k], NULL, &cur) == -1 || cur.sa_handler == SIG_IGN ||
+            ((cur.sa_flags & SA_SIGINFO) && cur.sa_sigaction == log_on_signal))
+            continue;
+        prev_action[k] = cur;
+        sigaction(term_signals[k], &sa, NULL);
+    }
+}
+
+// A forked child has no flusher: start over, the parent flushes its own lines.
+// The trace file belongs to the parent: its children stay silent until exec.
+static void log_atfork_child(void)
+{
+    for (int i = 0; i < LOG_RING_SLOTS; i++)
+        ring[i].seq = i;
+    ring_head = ring_tail = 0;
+    dropped = 0;
+    stop = 0;
+    draining = 0;
+    state = (backend == BACKEND_BINARY) ? LOG_OFF : LOG_IDLE;
+}
+
+static void log_start(const char *process_name)
+{
+    int expected = LOG_IDLE;
+    if (!__atomic_compare_exchange_n(&state, &expected, LOG_STARTING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) == LOG_STARTING)
+            ;
+        return;
+    }
+
+    const char *policy = getenv("ARP_LOG_FSYNC");
+    if (policy && strcmp(policy, "never") == 0)
+        fsync_policy = FSYNC_NEVER;
+    else if (policy && strcmp(policy, "on-error") == 0)
+        fsync_policy = FSYNC_ON_ERROR;
+    const char *ms = getenv("ARP_LOG_FSYNC_MS");
+    if (ms && atol(ms) > 0)
+        fsync_ms = atol(ms);
+
+    static int once;
+    if (!once) {
+        for (int i = 0; i < LOG_RING_SLOTS; i++)
+            ring[i].seq = i;
+        pthread_atfork(NULL, NULL, log_atfork_child);
+        atexit(log_exit);
+        once = 1;
+    }
+
+    const char *be = getenv("ARP_LOG_BACKEND");
+    if (be && strcmp(be, "binary") == 0 && trace_open(process_name) == 0)
+        backend = BACKEND_BINARY;
+    else {
+        // The signals go to the logging threads, never to the flusher
+        sigset_t set, old;
+        sigemptyset(&set);
+        for (size_t k = 0; k < sizeof(term_signals) / sizeof(term_signals[0]); k++)
+            sigaddset(&set, term_signals[k]);
+        pthread_sigmask(SIG_BLOCK, &set, &old);
+        pthread_create(&flusher, NULL, log_flusher, NULL);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        log_catch_signals();
+    }
+    __atomic_store_n(&state, LOG_RUNNING, __ATOMIC_RELEASE);
+}
+
+static const char *level_tag[] = {
+    [LOG_LEVEL_TRACE] = "TRACE: ",
+    [LOG_LEVEL_DEBUG] = "DEBUG: ",
+    [LOG_LEVEL_INFO]  = "",
+    [LOG_LEVEL_WARN]  = "WARNING: ",
+    [LOG_LEVEL_ERROR] = "ERROR: ",
+};
+
+static void log_push(const char *process_name, int level, const char *fmt, va_list ap)
+{
+    int st = __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+    if (st != LOG_RUNNING) {
+        if (st == LOG_OFF)
+            return;
+        log_start(process_name);
+        if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != LOG_RUNNING)
+            return;
+    }
+    if (level < LOG_LEVEL_TRACE || level > LOG_LEVEL_ERROR)
+        level = LOG_LEVEL_INFO;
+
+    if (backend == BACKEND_BINARY) {
+        char text[LOG_LINE_MAX];
+        int n = snprintf(text, sizeof(text), "%s", level_tag[level]);
+        vsnprintf(text + n, sizeof(text) - n, fmt, ap);
+        trace_text(text);
+        return;
+    }
+
+    // Reserve a slot
+    uint64_t pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+    struct log_slot *s;
+    while (1) {
+        s = &ring[pos & RING_MASK];
+        int64_t diff = (int64_t)__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - (int64_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&ring_tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0) {
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+        }
+    }
 
     time_t now = time(NULL);
     struct tm tm;
@@ -35,13 +326,31 @@ void process_log(const char *process_name, const char *message)
     char time_str[16];
     strftime(time_str, sizeof(time_str), "%H:%M:%S", &tm);
 
-    dprintf(fd, "%s %s %s\n", time_str, process_name, message);
+    // Format straight into the slot: "<time> <process> <tag><message>\n"
+    int len = snprintf(s->line, LOG_LINE_MAX, "%s %s %s", time_str, process_name, level_tag[level]);
+    if (len < LOG_LINE_MAX - 1)
+        len += vsnprintf(s->line + len, LOG_LINE_MAX - 1 - len, fmt, ap);
+    if (len > LOG_LINE_MAX - 2)
+        len = LOG_LINE_MAX - 2;
+    s->line[len++] = '\n';
+    s->len = len;
+    s->error = (level >= LOG_LEVEL_ERROR);
 
-    fsync(fd);
+    // Publish
+    __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+}
 
-    lock.l_type = F_UNLCK;
-    fcntl(fd, F_SETLK, &lock);
-    close(fd);
+void process_logf(const char *process_name, int level, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    log_push(process_name, level, fmt, ap);
+    va_end(ap);
+}
+
+void process_log(const char *process_name, const char *message)
+{
+    process_logf(process_name, LOG_LEVEL_INFO, "%s", message);
 }
 
 void register_process(const char *name){
@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../include/repulsion.h"
+
+/*
+ * rep_bench: throughput of the repulsion kernel on every path the CPU has,
+ * after checking each against the scalar one.
+ *
+ *   ./build/rep_bench                (1000 obstacles, 20000 query points)
+ *   ./build/rep_bench obstacles points
+ *
+ * Obstacles are spread over a 155x30 area, RHO 3 as in the game; the exit
+ * status is 1 if a path does not match within tolerance.
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_obs = argc > 1 ? atoi(argv[1]) : 1000;
+    int points = argc > 2 ? atoi(argv[2]) : 20000;
+    if (num_obs <= 0 || points <= 0) {
+        fprintf(stderr, "usage: %s [obstacles] [points]\n", argv[0]);
+        return 2;
+    }
+
+    float *ox = malloc(num_obs * sizeof(float));
+    float *oy = malloc(num_obs * sizeof(float));
+    float *px = malloc(points * sizeof(float));
+    float *py = malloc(points * sizeof(float));
+    if (!ox || !oy || !px || !py) {
+        perror("malloc");
+        return 2;
+    }
+    srand(1);
+    for (int i = 0; i < num_obs; i++) {
+        ox[i] = 1 + rand() % 153;
+        oy[i] = 1 + rand() % 28;
+    }
+    for (int i = 0; i < points; i++) {
+        px[i] = 1 + 153.0f * rand() / RAND_MAX;
+        py[i] = 1 + 28.0f * rand() / RAND_MAX;
+    }
+
+    printf("%d obstacles, %d points, selected path: %s\n", num_obs, points, rep_isa_name(rep_isa()));
+    int status = 0;
+    double base = 0;
+    for (int isa = REP_SCALAR; isa < REP_ISAS; isa++) {
+        if (!rep_supported(isa)) {
+            printf("%-8s not supported\n", rep_isa_name(isa));
+            continue;
+        }
+        float err;
+        int ok = rep_verify(isa, &err) == 0;
+        if (!ok)
+            status = 1;
+
+        // Keep the result live so the loop is not optimized away
+        volatile float sink = 0;
+        double t0 = now();
+        for (int i = 0; i < points; i++) {
+            float fx, fy;
+            rep_sum_isa(isa, ox, oy, num_obs, px[i], py[i], 3.0f, 200.0f, &fx, &fy);
+            sink += fx + fy;
+        }
+        double t = now() - t0;
+        double rate = (double)num_obs * points / t;
+        if (isa == REP_SCALAR)
+            base = rate;
+        printf("%-8s %8.1f M obstacles/s  x%.2f  max rel err %.2e %s\n",
+               rep_isa_name(isa), rate / 1e6, base > 0 ? rate / base : 1.0, err, ok ? "ok" : "MISMATCH");
+    }
+
+    free(ox);
+    free(oy);
+    free(px);
+    free(py);
+    return status;
+}
@@ -0,0 +1,198 @@
+#include "../include/repulsion.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REP_X86 1
+#endif
+
+static void sum_scalar(const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy)
+{
+    float rho2 = rho * rho, inv_rho = 1.0f / rho;
+    float sx = 0, sy = 0;
+    for (int i = 0; i < n; i++) {
+        float dx = px - ox[i], dy = py - oy[i];
+        float d2 = dx * dx + dy * dy;
+        if (d2 >= rho2)
+            continue;
+        float inv = 1.0f / sqrtf(d2 > REP_MIN_DIST * REP_MIN_DIST ? d2 : REP_MIN_DIST * REP_MIN_DIST);
+        float f = k * (inv - inv_rho) * inv;
+        sx += f * dx;
+        sy += f * dy;
+    }
+    *fx = sx;
+    *fy = sy;
+}
+
+#ifdef REP_X86
+/*
+ * Same terms, four or eight obstacles per iteration: the ones out of range
+ * are masked to zero, the tail goes through the scalar loop.
+ */
+__attribute__((target("sse2")))
+static void sum_sse(const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy)
+{
+    const __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py);
+    const __m128 rho2 = _mm_set1_ps(rho * rho), inv_rho = _mm_set1_ps(1.0f / rho);
+    const __m128 min2 = _mm_set1_ps(REP_MIN_DIST * REP_MIN_DIST), vk = _mm_set1_ps(k), one = _mm_set1_ps(1.0f);
+    __m128 sx = _mm_setzero_ps(), sy = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 dx = _mm_sub_ps(vpx, _mm_loadu_ps(ox + i));
+        __m128 dy = _mm_sub_ps(vpy, _mm_loadu_ps(oy + i));
+        __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 in = _mm_cmplt_ps(d2, rho2);
+        __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(d2, min2)));
+        __m128 f = _mm_and_ps(in, _mm_mul_ps(_mm_mul_ps(vk, _mm_sub_ps(inv, inv_rho)), inv));
+        sx = _mm_add_ps(sx, _mm_mul_ps(f, dx));
+        sy = _mm_add_ps(sy, _mm_mul_ps(f, dy));
+    }
+    float lx[4], ly[4];
+    _mm_storeu_ps(lx, sx);
+    _mm_storeu_ps(ly, sy);
+    float tx, ty;
+    sum_scalar(ox + i, oy + i, n - i, px, py, rho, k, &tx, &ty);
+    *fx = (lx[0] + lx[1]) + (lx[2] + lx[3]) + tx;
+    *fy = (ly[0] + ly[1]) + (ly[2] + ly[3]) + ty;
+}
+
+__attribute__((target("avx2,fma")))
+static void sum_avx2(const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy)
+{
+    const __m256 vpx = _mm256_set1_ps(px), vpy = _mm256_set1_ps(py);
+    const __m256 rho2 = _mm256_set1_ps(rho * rho), inv_rho = _mm256_set1_ps(1.0f / rho);
+    const __m256 min2 = _mm256_set1_ps(REP_MIN_DIST * REP_MIN_DIST), vk = _mm256_set1_ps(k), one = _mm256_set1_ps(1.0f);
+    __m256 sx = _mm256_setzero_ps(), sy = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 dx = _mm256_sub_ps(vpx, _mm256_loadu_ps(ox + i));
+        __m256 dy = _mm256_sub_ps(vpy, _mm256_loadu_ps(oy + i));
+        __m256 d2 = _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx));
+        __m256 in = _mm256_cmp_ps(d2, rho2, _CMP_LT_OQ);
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_max_ps(d2, min2)));
+        __m256 f = _mm256_and_ps(in, _mm256_mul_ps(_mm256_mul_ps(vk, _mm256_sub_ps(inv, inv_rho)), inv));
+        sx = _mm256_fmadd_ps(f, dx, sx);
+        sy = _mm256_fmadd_ps(f, dy, sy);
+    }
+    float lx[8], ly[8];
+    _mm256_storeu_ps(lx, sx);
+    _mm256_storeu_ps(ly, sy);
+    float tx, ty;
+    sum_scalar(ox + i, oy + i, n - i, px, py, rho, k, &tx, &ty);
+    *fx = ((lx[0] + lx[1]) + (lx[2] + lx[3])) + ((lx[4] + lx[5]) + (lx[6] + lx[7])) + tx;
+    *fy = ((ly[0] + ly[1]) + (ly[2] + ly[3])) + ((ly[4] + ly[5]) + (ly[6] + ly[7])) + ty;
+}
+#endif
+
+int rep_supported(int isa)
+{
+    switch (isa) {
+    case REP_SCALAR:
+        return 1;
+#ifdef REP_X86
+    case REP_SSE:
+        return __builtin_cpu_supports("sse2");
+    case REP_AVX2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const char *rep_isa_name(int isa)
+{
+    static const char *names[REP_ISAS] = { "scalar", "sse", "avx2" };
+    return isa >= 0 && isa < REP_ISAS ? names[isa] : "?";
+}
+
+void rep_sum_isa(int isa, const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy)
+{
+#ifdef REP_X86
+    if (isa == REP_AVX2 && rep_supported(REP_AVX2)) {
+        sum_avx2(ox, oy, n, px, py, rho, k, fx, fy);
+        return;
+    }
+    if (isa == REP_SSE && rep_supported(REP_SSE)) {
+        sum_sse(ox, oy, n, px, py, rho, k, fx, fy);
+        return;
+    }
+#endif
+    (void)isa;
+    sum_scalar(ox, oy, n, px, py, rho, k, fx, fy);
+}
+
+// xorshift32 for the sample: fixed, no dependency on the layout generator
+static float sample_next(uint32_t *s, float lo, float hi)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return lo + (hi - lo) * (float)(*s >> 8) / (float)(1u << 24);
+}
+
+int rep_verify(int isa, float *max_err)
+{
+    enum { OBS = 203, POINTS = 64 };    // Not a multiple of 8: the tail runs too
+    float ox[OBS], oy[OBS];
+    uint32_t s = 0x9e3779b9u;
+    for (int i = 0; i < OBS; i++) {
+        ox[i] = sample_next(&s, 0.0f, 40.0f);
+        oy[i] = sample_next(&s, 0.0f, 20.0f);
+    }
+    float worst = 0;
+    for (int q = 0; q < POINTS; q++) {
+        float px = sample_next(&s, 0.0f, 40.0f), py = sample_next(&s, 0.0f, 20.0f);
+        float rho = sample_next(&s, 1.0f, 8.0f);
+        float ax, ay, bx, by;
+        sum_scalar(ox, oy, OBS, px, py, rho, 200.0f, &ax, &ay);
+        rep_sum_isa(isa, ox, oy, OBS, px, py, rho, 200.0f, &bx, &by);
+        // Relative to the sum of the terms' sizes: cancellation is not an error
+        float scale = 0;
+        for (int i = 0; i < OBS; i++) {
+            float tx, ty;
+            sum_scalar(ox + i, oy + i, 1, px, py, rho, 200.0f, &tx, &ty);
+            scale += fabsf(tx) + fabsf(ty);
+        }
+        if (scale == 0)
+            scale = 1;
+        float err = fmaxf(fabsf(ax - bx), fabsf(ay - by)) / scale;
+        if (isnan(err))
+            err = INFINITY;
+        if (err > worst)
+            worst = err;
+    }
+    if (max_err)
+        *max_err = worst;
+    return worst <= REP_TOLERANCE ? 0 : -1;
+}
+
+static int selected = -1;
+
+int rep_isa(void)
+{
+    int isa = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    if (isa >= 0)
+        return isa;
+
+    int cap = REP_ISAS - 1;
+    const char *env = getenv("ARP_REP_ISA");
+    for (int i = 0; env && i < REP_ISAS; i++)
+        if (strcmp(env, rep_isa_name(i)) == 0)
+            cap = i;
+    // Best path available that also agrees with the scalar one
+    for (isa = cap; isa > REP_SCALAR; isa--)
+        if (rep_supported(isa) && rep_verify(isa, NULL) == 0)
+            break;
+    __atomic_store_n(&selected, isa, __ATOMIC_RELEASE);
+    return isa;
+}
+
+void rep_sum(const float *ox, const float *oy, int n, float px, float py, float rho, float k, float *fx, float *fy)
+{
+    rep_sum_isa(rep_isa(), ox, oy, n, px, py, rho, k, fx, fy);
+}
@@ -0,0 +1,169 @@
+#include "../include/spatial_grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static int clampi(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+static int bucket_of(const struct sgrid *g, int x, int y)
+{
+    int c = clampi(x / g->cell, 0, g->cols - 1);
+    int r = clampi(y / g->cell, 0, g->rows - 1);
+    return r * g->cols + c;
+}
+
+static void link_item(struct sgrid *g, int h, int b)
+{
+    struct sgrid_item *it = &g->items[h];
+    it->bucket = b;
+    it->prev = -1;
+    it->next = g->head[b];
+    if (it->next != -1)
+        g->items[it->next].prev = h;
+    g->head[b] = h;
+}
+
+static void unlink_item(struct sgrid *g, int h)
+{
+    struct sgrid_item *it = &g->items[h];
+    if (it->prev != -1)
+        g->items[it->prev].next = it->next;
+    else
+        g->head[it->bucket] = it->next;
+    if (it->next != -1)
+        g->items[it->next].prev = it->prev;
+}
+
+int sgrid_init(struct sgrid *g, int w, int h, int cell)
+{
+    memset(g, 0, sizeof(*g));
+    g->cell = cell > 0 ? cell : 1;
+    g->free_head = -1;
+    return sgrid_resize(g, w, h);
+}
+
+int sgrid_resize(struct sgrid *g, int w, int h)
+{
+    int cols = (w > 0 ? w : 1) / g->cell + 1;
+    int rows = (h > 0 ? h : 1) / g->cell + 1;
+    if (g->head && cols == g->cols && rows == g->rows)
+        return 0;
+
+    int *head = malloc((size_t)cols * rows * sizeof(int));
+    if (!head)
+        return -1;
+    for (int i = 0; i < cols * rows; i++)
+        head[i] = -1;
+
+    free(g->head);
+    g->head = head;
+    g->cols = cols;
+    g->rows = rows;
+    for (int i = 0; i < g->cap; i++)
+        if (g->items[i].bucket != -1)
+            link_item(g, i, bucket_of(g, g->items[i].x, g->items[i].y));
+    return 0;
+}
+
+int sgrid_insert(struct sgrid *g, int x, int y)
+{
+    if (g->free_head == -1) {
+        int cap = g->cap ? 2 * g->cap : 64;
+        struct sgrid_item *items = realloc(g->items, (size_t)cap * sizeof(*items));
+        if (!items)
+            return -1;
+        g->items = items;
+        // New slots go on the free list, lowest first
+        for (int i = cap - 1; i >= g->cap; i--) {
+            items[i].bucket = -1;
+            items[i].next = g->free_head;
+            g->free_head = i;
+        }
+        g->cap = cap;
+    }
+
+    int h = g->free_head;
+    g->free_head = g->items[h].next;
+    g->items[h].x = x;
+    g->items[h].y = y;
+    link_item(g, h, bucket_of(g, x, y));
+    g->count++;
+    return h;
+}
+
+void sgrid_remove(struct sgrid *g, int h)
+{
+    if (h < 0 || h >= g->cap || g->items[h].bucket == -1)
+        return;
+    unlink_item(g, h);
+    g->items[h].bucket = -1;
+    g->items[h].next = g->free_head;
+    g->free_head = h;
+    g->count--;
+}
+
+void sgrid_move(struct sgrid *g, int h, int x, int y)
+{
+    if (h < 0 || h >= g->cap || g->items[h].bucket == -1)
+        return;
+    struct sgrid_item *it = &g->items[h];
+    it->x = x;
+    it->y = y;
+    int b = bucket_of(g, x, y);
+    if (b == it->bucket)
+        return;
+    unlink_item(g, h);
+    link_item(g, h, b);
+}
+
+void sgrid_clear(struct sgrid *g)
+{
+    for (int i = 0; i < g->cols * g->rows; i++)
+        g->head[i] = -1;
+    g->free_head = -1;
+    for (int i = g->cap - 1; i >= 0; i--) {
+        g->items[i].bucket = -1;
+        g->items[i].next = g->free_head;
+        g->free_head = i;
+    }
+    g->count = 0;
+}
+
+int sgrid_query(const struct sgrid *g, int x, int y, int r, int *out, int max)
+{
+    if (g->count == 0)
+        return 0;
+
+    int k = (r + g->cell - 1) / g->cell;
+    int c0 = clampi(x / g->cell - k, 0, g->cols - 1), c1 = clampi(x / g->cell + k, 0, g->cols - 1);
+    int r0 = clampi(y / g->cell - k, 0, g->rows - 1), r1 = clampi(y / g->cell + k, 0, g->rows - 1);
+    int r2 = r * r;
+    int hits = 0;
+
+    for (int row = r0; row <= r1; row++) {
+        for (int col = c0; col <= c1; col++) {
+            for (int h = g->head[row * g->cols + col]; h != -1; h = g->items[h].next) {
+                int dx = g->items[h].x - x;
+                int dy = g->items[h].y - y;
+                int d2 = dx * dx + dy * dy;
+                if (d2 == 0 || d2 > r2)
+                    continue;
+                if (hits < max)
+                    out[hits] = h;
+                hits++;
+            }
+        }
+    }
+    return hits;
+}
+
+void sgrid_free(struct sgrid *g)
+{
+    free(g->head);
+    free(g->items);
+    memset(g, 0, sizeof(*g));
+    g->free_head = -1;
+}
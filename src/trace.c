@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+
+#include "../include/trace.h"
+#include "../include/common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#define TRACE_DIR "log"
+#define TRACE_FILE_SIZE (sizeof(struct trace_hdr) + (size_t)TRACE_SLOTS * sizeof(struct trace_rec))
+
+_Static_assert(sizeof(struct trace_rec) == 32, "trace records are 32 bytes");
+_Static_assert(sizeof(struct trace_hdr) == 64, "trace header is 64 bytes");
+
+// PROCESS_NAME of every process, in IDX_* order, then the router
+static const char *proc_names[NUM_PROCESSES + 1] = {
+    "BLACKBOARD", "DRONE", "KEYBOARD", "MAP", "OBSTACLES", "TARGETS", "WATCHDOG", "MAIN"
+};
+
+static const char *event_names[EV_COUNT] = {
+    [EV_NONE]            = "NONE",
+    [EV_TEXT]            = "TEXT",
+    [EV_TEXT_CONT]       = "TEXT",
+    [EV_ROUTER_BATCH]    = "ROUTER_BATCH",
+    [EV_ROUTER_COALESCE] = "ROUTER_COALESCE",
+    [EV_ROUTER_BLOCKED]  = "ROUTER_BLOCKED",
+};
+
+static struct trace_hdr *hdr;
+static struct trace_rec *recs;
+static uint8_t proc_idx = 0xff;
+
+static void trace_atfork_child(void)
+{
+    // The mapping is shared with the parent: a forked child must not write it
+    hdr = NULL;
+    recs = NULL;
+}
+
+int trace_open(const char *process_name)
+{
+    if (hdr)
+        return 0;
+
+    for (int i = 0; i <= NUM_PROCESSES; i++)
+        if (strcmp(process_name, proc_names[i]) == 0)
+            proc_idx = (uint8_t)i;
+
+    char path[64];
+    snprintf(path, sizeof(path), TRACE_DIR "/trace_%s.bin", process_name);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return -1;
+    // Preallocate: no page fault turns into a block allocation later on
+    if (posix_fallocate(fd, 0, TRACE_FILE_SIZE) != 0 && ftruncate(fd, TRACE_FILE_SIZE) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    void *p = mmap(NULL, TRACE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    struct trace_hdr *h = p;
+    memcpy(h->magic, TRACE_MAGIC, sizeof(h->magic));
+    h->version = TRACE_VERSION;
+    h->rec_size = sizeof(struct trace_rec);
+    h->slots = TRACE_SLOTS;
+    h->proc = proc_idx;
+    snprintf(h->name, sizeof(h->name), "%s", process_name);
+    h->head = 0;
+
+    static int once;
+    if (!once) {
+        pthread_atfork(NULL, NULL, trace_atfork_child);
+        once = 1;
+    }
+
+    recs = (struct trace_rec *)(h + 1);
+    __atomic_store_n(&hdr, h, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int trace_enabled(void)
+{
+    return hdr != NULL;
+}
+
+static struct trace_rec *trace_reserve(int event)
+{
+    uint64_t seq = __atomic_fetch_add(&hdr->head, 1, __ATOMIC_RELAXED);
+    struct trace_rec *r = &recs[seq & (TRACE_SLOTS - 1)];
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    r->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    r->proc = proc_idx;
+    r->event = (uint8_t)event;
+    r->len = 0;
+    r->seq = (uint32_t)seq;
+    return r;
+}
+
+void trace_event(int event, int32_t a0, int32_t a1, int32_t a2, int32_t a3)
+{
+    if (!hdr)
+        return;
+    struct trace_rec *r = trace_reserve(event);
+    r->args[0] = a0;
+    r->args[1] = a1;
+    r->args[2] = a2;
+    r->args[3] = a3;
+}
+
+void trace_text(const char *text)
+{
+    if (!hdr)
+        return;
+    size_t left = strlen(text);
+    int event = EV_TEXT;
+    do {
+        size_t n = left < TRACE_TEXT_BYTES ? left : TRACE_TEXT_BYTES;
+        struct trace_rec *r = trace_reserve(event);
+        memset(r->args, 0, sizeof(r->args));
+        memcpy(r->args, text, n);
+        r->len = (uint16_t)n;
+        text += n;
+        left -= n;
+        event = EV_TEXT_CONT;
+    } while (left > 0);
+}
+
+void trace_close(void)
+{
+    if (!hdr)
+        return;
+    struct trace_hdr *h = hdr;
+    hdr = NULL;
+    recs = NULL;
+    munmap(h, TRACE_FILE_SIZE);
+}
+
+void trace_remove_files(void)
+{
+    char path[64];
+    for (int i = 0; i <= NUM_PROCESSES; i++) {
+        snprintf(path, sizeof(path), TRACE_DIR "/trace_%s.bin", proc_names[i]);
+        unlink(path);
+    }
+}
+
+const char *trace_event_name(int event)
+{
+    return (event >= 0 && event < EV_COUNT && event_names[event]) ? event_names[event] : "?";
+}
+
+const char *trace_proc_name(int proc)
+{
+    return (proc >= 0 && proc <= NUM_PROCESSES) ? proc_names[proc] : "?";
+}